@@ -0,0 +1,152 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <execinfo.h>
+#include "alloc_trace.h"
+
+#define MAX_DEPTH       16
+#define MAX_SITES       32
+#define SKIP_FRAMES     2       // note_alloc() and the wrapper
+
+typedef struct {
+    void *pcs[MAX_DEPTH];
+    int depth;
+    uint64_t count;
+    uint64_t bytes;
+} alloc_site_t;
+
+static uint64_t s_total = 0;
+static uint64_t s_guarded = 0;
+static int s_guard_depth = 0;
+static bool s_in_trace = false;         // backtrace() may allocate on first use
+
+static alloc_site_t s_sites[MAX_SITES];
+static int s_num_sites = 0;
+static uint64_t s_untracked = 0;        // Guarded allocations from sites past MAX_SITES
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+int __real_posix_memalign(void **ptr, size_t align, size_t size);
+void *__real_aligned_alloc(size_t align, size_t size);
+char *__real_strdup(const char *s);
+char *__real_strndup(const char *s, size_t n);
+
+static __attribute__((noinline)) void note_alloc(size_t size)
+{
+    s_total++;
+    if (s_guard_depth == 0 || s_in_trace) {
+        return;
+    }
+    s_in_trace = true;
+    s_guarded++;
+
+    void *pcs[MAX_DEPTH + SKIP_FRAMES];
+    int n = backtrace(pcs, MAX_DEPTH + SKIP_FRAMES) - SKIP_FRAMES;
+    if (n < 0) {
+        n = 0;
+    }
+
+    alloc_site_t *site = NULL;
+    for (int i = 0; i < s_num_sites; i++) {
+        if (s_sites[i].depth == n && memcmp(s_sites[i].pcs, pcs + SKIP_FRAMES, n * sizeof(void *)) == 0) {
+            site = &s_sites[i];
+            break;
+        }
+    }
+    if (!site && s_num_sites < MAX_SITES) {
+        site = &s_sites[s_num_sites++];
+        memcpy(site->pcs, pcs + SKIP_FRAMES, n * sizeof(void *));
+        site->depth = n;
+    }
+    if (site) {
+        site->count++;
+        site->bytes += size;
+    } else {
+        s_untracked++;
+    }
+    s_in_trace = false;
+}
+
+void *__wrap_malloc(size_t size)
+{
+    note_alloc(size);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    note_alloc(n * size);
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    note_alloc(size);
+    return __real_realloc(ptr, size);
+}
+
+int __wrap_posix_memalign(void **ptr, size_t align, size_t size)
+{
+    note_alloc(size);
+    return __real_posix_memalign(ptr, align, size);
+}
+
+void *__wrap_aligned_alloc(size_t align, size_t size)
+{
+    note_alloc(size);
+    return __real_aligned_alloc(align, size);
+}
+
+char *__wrap_strdup(const char *s)
+{
+    note_alloc(strlen(s) + 1);
+    return __real_strdup(s);
+}
+
+char *__wrap_strndup(const char *s, size_t n)
+{
+    note_alloc(strnlen(s, n) + 1);
+    return __real_strndup(s, n);
+}
+
+void alloc_trace_begin(void)
+{
+    if (s_guard_depth++ == 0) {
+        // Load the unwinder now rather than inside the first traced allocation
+        void *pc;
+        backtrace(&pc, 1);
+    }
+}
+
+void alloc_trace_end(void)
+{
+    if (s_guard_depth > 0) {
+        s_guard_depth--;
+    }
+}
+
+uint64_t alloc_trace_total(void)
+{
+    return s_total;
+}
+
+uint64_t alloc_trace_guarded(void)
+{
+    return s_guarded;
+}
+
+void alloc_trace_report(FILE *out)
+{
+    for (int i = 0; i < s_num_sites; i++) {
+        const alloc_site_t *site = &s_sites[i];
+        fprintf(out, "%llu allocation(s), %llu bytes, from:\n",
+                (unsigned long long)site->count, (unsigned long long)site->bytes);
+        fflush(out);
+        // Symbols need -rdynamic; addr2line -e <binary> resolves the rest
+        backtrace_symbols_fd(site->pcs, site->depth, fileno(out));
+    }
+    if (s_untracked) {
+        fprintf(out, "%llu more allocation(s) from other call stacks\n", (unsigned long long)s_untracked);
+    }
+}
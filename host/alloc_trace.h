@@ -0,0 +1,26 @@
+#ifndef HOST_ALLOC_TRACE_H
+#define HOST_ALLOC_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Heap allocation tracing for the host tools.
+//
+// malloc, calloc, realloc, strdup and friends are wrapped at link time
+// (-Wl,--wrap, see CMakeLists.txt), so every allocation made by the control
+// core or the tools is counted. Allocations made while a guard is open are
+// also attributed to their call stack. Allocations libc makes internally
+// (stdio buffers and the like) are not seen.
+
+// Open/close a guarded region; they nest
+void alloc_trace_begin(void);
+void alloc_trace_end(void);
+
+// Allocations since start-up, and those made inside guarded regions
+uint64_t alloc_trace_total(void);
+uint64_t alloc_trace_guarded(void);
+
+// Print each distinct call stack that allocated inside a guard, with counts
+void alloc_trace_report(FILE *out);
+
+#endif // HOST_ALLOC_TRACE_H
@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "gale.h"
+#include "bench_cases.h"
+#include "sim.h"
+#include "alloc_trace.h"
+
+// Control-path microbenchmarks for the host build.
+//
+// Each case runs its operation in a loop sized to take at least
+// MIN_RUN_NS, RUNS times in a row, and keeps the fastest run (the least
+// disturbed by the rest of the machine). That is repeated for ROUNDS rounds,
+// going through all the cases in each round so that a burst of load on the
+// machine hits one round of several cases rather than every run of one case.
+// The fastest round is reported, along with the standard deviation across
+// rounds. Allocations are counted with alloc_trace.h, so they cover the
+// firmware code under test, not just this file, and come with call stacks
+// when a case allocates more than before.
+//
+// Results are compared against a baseline file holding each case's time,
+// spread and allocations. A case fails when its time per op grows by more
+// than the larger of the tolerance and three standard deviations of the
+// recording, plus NOISE_FLOOR_NS so nanosecond-scale cases don't flap, or
+// when it allocates more than the baseline. Times depend on the machine, so
+// the baseline is not part of the source tree: it lives in the build
+// directory, and a run without one records it instead of comparing.
+
+#define MIN_RUN_NS          20000000ULL     // 20 ms
+#define RUNS                5
+#define ROUNDS              7
+#define NOISE_FLOOR_NS      1.0
+#define DEFAULT_TOLERANCE   25.0            // Percent
+#define SIGMA_MARGIN        3.0
+#define MAX_CASES           16
+
+// --- Timing ---
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// CPU timestamp counter; 0 where there is none. On x86 this is the TSC,
+// which counts at a fixed reference rate rather than core cycles.
+static uint64_t now_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t v;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+#else
+    return 0;
+#endif
+}
+
+// --- Cases ---
+//
+// hr_parse, config_json_parse and matter_mapping come from main/bench_cases.c,
+// which the console benchmarks on the device run too.
+
+static volatile uint32_t s_sink;
+
+// HR values that walk through every zone, both directions
+static const uint8_t s_hr_walk[] = {
+    80, 95, 105, 112, 118, 125, 131, 137, 142, 150, 155, 148, 139, 128, 119, 110, 101, 92, 85, 78,
+};
+
+static void bench_zone_decision(uint32_t iters)
+{
+    for (uint32_t i = 0; i < iters; i++) {
+        calculate_fan_speed(s_hr_walk[i % sizeof(s_hr_walk)]);
+    }
+    s_sink = g_current_speed;
+}
+
+static void bench_hr_pipeline(uint32_t iters)
+{
+    for (uint32_t i = 0; i < iters; i++) {
+        uint32_t k = i % BENCH_NUM_PAYLOADS;
+        sim_advance_ms(1000);
+        hr_control_measurement(g_bench_payloads[k], g_bench_payload_lens[k]);
+    }
+}
+
+// Speed drop inside fanDelay: the common case, nothing to do yet
+static void bench_set_speed_hold(uint32_t iters)
+{
+    g_config.fanDelay = FAN_DELAY_MAX;
+    fan_control_set_speed_immediate(3);
+    for (uint32_t i = 0; i < iters; i++) {
+        fan_control_set_speed(1 + (i & 1));
+    }
+}
+
+// Every call switches the relays
+static void bench_set_speed_apply(uint32_t iters)
+{
+    g_config.fanDelay = 0;
+    for (uint32_t i = 0; i < iters; i++) {
+        sim_advance_ms(1);
+        fan_control_set_speed(1 + (i & 1));
+    }
+}
+
+typedef struct {
+    const char *name;
+    void (*fn)(uint32_t iters);
+} bench_case_t;
+
+static const bench_case_t s_cases[] = {
+    { "hr_parse",           bench_hr_parse },
+    { "zone_decision",      bench_zone_decision },
+    { "hr_pipeline",        bench_hr_pipeline },
+    { "set_speed_hold",     bench_set_speed_hold },
+    { "set_speed_apply",    bench_set_speed_apply },
+    { "config_json_parse",  bench_config_json },
+    { "matter_mapping",     bench_matter_mapping },
+};
+#define NUM_CASES (sizeof(s_cases) / sizeof(s_cases[0]))
+
+typedef struct {
+    double ns_per_op;
+    double cycles_per_op;
+    double allocs_per_op;
+    double stddev_ns;           // Across rounds
+} bench_result_t;
+
+// Loop size that makes one run of 'c' take about MIN_RUN_NS
+static uint32_t calibrate_case(const bench_case_t *c)
+{
+    uint32_t iters = 1000;
+    for (;;) {
+        uint64_t t0 = now_ns();
+        c->fn(iters);
+        if (now_ns() - t0 >= MIN_RUN_NS / 4 || iters >= (1u << 28)) {
+            break;
+        }
+        iters *= 4;
+    }
+    return iters * 4;
+}
+
+// One round: the fastest of RUNS runs of 'iters' ops each
+static void run_round(const bench_case_t *c, uint32_t iters, bench_result_t *r, uint64_t *allocs)
+{
+    r->ns_per_op = r->cycles_per_op = 1e300;
+    for (int run = 0; run < RUNS; run++) {
+        alloc_trace_begin();
+        uint64_t a0 = alloc_trace_total();
+        uint64_t c0 = now_cycles();
+        uint64_t t0 = now_ns();
+        c->fn(iters);
+        uint64_t t1 = now_ns();
+        uint64_t c1 = now_cycles();
+        *allocs += alloc_trace_total() - a0;
+        alloc_trace_end();
+
+        double ns = (double)(t1 - t0) / iters;
+        if (ns < r->ns_per_op) {
+            r->ns_per_op = ns;
+            r->cycles_per_op = (double)(c1 - c0) / iters;
+        }
+    }
+}
+
+// --- Baseline ---
+
+typedef struct {
+    char name[32];
+    double ns_per_op;
+    double allocs_per_op;
+    double stddev_ns;
+} baseline_entry_t;
+
+static int load_baseline(const char *path, baseline_entry_t *entries)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+    char line[128];
+    int n = 0;
+    while (n < MAX_CASES && fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') {
+            continue;
+        }
+        // Baselines from before the spread was recorded have three columns
+        entries[n].stddev_ns = 0;
+        if (sscanf(line, "%31s %lf %lf %lf", entries[n].name, &entries[n].ns_per_op,
+                   &entries[n].allocs_per_op, &entries[n].stddev_ns) >= 3) {
+            n++;
+        }
+    }
+    fclose(f);
+    return n;
+}
+
+static const baseline_entry_t *find_baseline(const baseline_entry_t *entries, int n, const char *name)
+{
+    for (int i = 0; i < n; i++) {
+        if (strcmp(entries[i].name, name) == 0) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [--baseline FILE] [--update] [--tolerance PCT] [--filter TEXT]\n"
+            "  --baseline FILE   baseline to compare with (default %s)\n"
+            "  --update          write the results as the new baseline\n"
+            "  --tolerance PCT   allowed slowdown before failing, unless the baseline\n"
+            "                    spread allows more (default %.0f)\n"
+            "  --filter TEXT     only run cases whose name contains TEXT\n",
+            prog, GALE_BENCH_BASELINE, DEFAULT_TOLERANCE);
+}
+
+int main(int argc, char **argv)
+{
+    const char *baseline_path = GALE_BENCH_BASELINE;
+    const char *filter = NULL;
+    double tolerance = DEFAULT_TOLERANCE;
+    bool update = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--update") == 0) {
+            update = true;
+        } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    // Firmware defaults, HRM connected, auto mode
+    nvs_config_load();
+    fan_control_init();
+    led_control_init();
+    hr_control_connected();
+
+    baseline_entry_t baseline[MAX_CASES];
+    int num_baseline = update ? 0 : load_baseline(baseline_path, baseline);
+    if (num_baseline < 0) {
+        printf("no baseline at %s; recording one\n", baseline_path);
+        num_baseline = 0;
+        update = true;
+    }
+
+    bench_result_t results[NUM_CASES];
+    bool ran[NUM_CASES] = { false };
+    uint32_t iters[NUM_CASES];
+    uint64_t allocs[NUM_CASES] = { 0 };
+    double sum[NUM_CASES] = { 0 }, sum_sq[NUM_CASES] = { 0 };
+    int regressions = 0;
+    bool alloc_regression = false;
+
+    for (size_t i = 0; i < NUM_CASES; i++) {
+        ran[i] = !filter || strstr(s_cases[i].name, filter);
+        if (ran[i]) {
+            iters[i] = calibrate_case(&s_cases[i]);
+            results[i].ns_per_op = 1e300;
+        }
+    }
+    for (int round = 0; round < ROUNDS; round++) {
+        for (size_t i = 0; i < NUM_CASES; i++) {
+            if (!ran[i]) {
+                continue;
+            }
+            bench_result_t r;
+            run_round(&s_cases[i], iters[i], &r, &allocs[i]);
+            sum[i] += r.ns_per_op;
+            sum_sq[i] += r.ns_per_op * r.ns_per_op;
+            if (r.ns_per_op < results[i].ns_per_op) {
+                results[i].ns_per_op = r.ns_per_op;
+                results[i].cycles_per_op = r.cycles_per_op;
+            }
+        }
+    }
+
+    printf("%-20s %12s %12s %12s %12s  %s\n", "case", "ns/op", "stddev", "cycles/op",
+           "allocs/op", "vs baseline");
+    for (size_t i = 0; i < NUM_CASES; i++) {
+        if (!ran[i]) {
+            continue;
+        }
+        const bench_case_t *c = &s_cases[i];
+        bench_result_t *r = &results[i];
+        double mean = sum[i] / ROUNDS;
+        double var = sum_sq[i] / ROUNDS - mean * mean;
+        r->stddev_ns = var > 0 ? sqrt(var * ROUNDS / (ROUNDS - 1)) : 0;
+        r->allocs_per_op = (double)allocs[i] / ((double)iters[i] * RUNS * ROUNDS);
+
+        char verdict[64] = "";
+        const baseline_entry_t *b = find_baseline(baseline, num_baseline, c->name);
+        if (update) {
+            snprintf(verdict, sizeof(verdict), "updated");
+        } else if (!b) {
+            snprintf(verdict, sizeof(verdict), "new");
+        } else {
+            double change = b->ns_per_op > 0 ? (r->ns_per_op / b->ns_per_op - 1) * 100 : 0;
+            double margin = fmax(b->ns_per_op * tolerance / 100, SIGMA_MARGIN * b->stddev_ns);
+            bool slower = r->ns_per_op - b->ns_per_op > margin + NOISE_FLOOR_NS;
+            bool more_allocs = r->allocs_per_op > b->allocs_per_op + 1e-9;
+            snprintf(verdict, sizeof(verdict), "%+.1f%% (allowed +%.2f ns)%s%s", change,
+                     margin + NOISE_FLOOR_NS, slower ? " REGRESSED" : "",
+                     more_allocs ? " MORE ALLOCS" : "");
+            regressions += slower || more_allocs;
+            alloc_regression |= more_allocs;
+        }
+        printf("%-20s %12.2f %12.2f %12.1f %12.3f  %s\n", c->name, r->ns_per_op, r->stddev_ns,
+               r->cycles_per_op, r->allocs_per_op, verdict);
+    }
+
+    if (update) {
+        FILE *f = fopen(baseline_path, "w");
+        if (!f) {
+            perror(baseline_path);
+            return 1;
+        }
+        fprintf(f, "# gale_bench baseline: <case> <ns/op> <allocs/op> <stddev ns>\n");
+        for (size_t i = 0; i < NUM_CASES; i++) {
+            if (ran[i]) {
+                fprintf(f, "%s %.2f %.3f %.3f\n", s_cases[i].name, results[i].ns_per_op,
+                        results[i].allocs_per_op, results[i].stddev_ns);
+            }
+        }
+        fclose(f);
+        printf("baseline written to %s\n", baseline_path);
+        return 0;
+    }
+
+    if (alloc_regression) {
+        printf("allocation call stacks:\n");
+        fflush(stdout);
+        alloc_trace_report(stdout);
+    }
+    if (regressions) {
+        printf("%d case(s) regressed past the baseline (tolerance %.0f%% or %.0f sigma)\n",
+               regressions, tolerance, SIGMA_MARGIN);
+        return 1;
+    }
+    return 0;
+}
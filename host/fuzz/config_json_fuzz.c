@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "gale.h"
+#include "config_json.h"
+
+// Fuzz harness for the streaming config parser (config_json.c).
+//
+// Every input is parsed three ways: in one feed, one byte per feed and in
+// chunks of varying size. The three must agree on the status and, when the
+// object is accepted, on the staged config, which must also pass
+// config_validate(). Errors must be sticky and carry a reason. Memory
+// errors are left to the sanitizers (configure with
+// -DCMAKE_C_FLAGS=-fsanitize=address,undefined).
+//
+// With clang, -DGALE_FUZZ_LIBFUZZER=ON builds this as a libFuzzer target.
+// Otherwise main() below generates inputs itself: mutations of a small
+// corpus of valid and near-valid objects plus random strings over a
+// JSON-heavy alphabet.
+
+#define MAX_INPUT       512
+
+static void fail_input(const char *what, const uint8_t *data, size_t len)
+{
+    fprintf(stderr, "config_json_fuzz: %s\ninput (%zu bytes): \"", what, len);
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = data[i];
+        if (c == '"' || c == '\\') {
+            fprintf(stderr, "\\%c", c);
+        } else if (c >= 0x20 && c < 0x7f) {
+            fputc(c, stderr);
+        } else {
+            fprintf(stderr, "\\x%02x", c);
+        }
+    }
+    fprintf(stderr, "\"\n");
+    abort();
+}
+
+// Parse 'data' feeding at most 'chunk' bytes at a time; chunk 0 varies the
+// chunk size from 1 to 8 bytes
+static config_json_status_t parse(const uint8_t *data, size_t len, size_t chunk,
+                                  config_json_parser_t *p)
+{
+    config_json_init(p, &g_config);
+
+    config_json_status_t status = CONFIG_JSON_MORE;
+    for (size_t pos = 0, n = 0; pos < len; pos += n) {
+        n = chunk ? chunk : 1 + (pos * 7 + data[pos]) % 8;
+        if (n > len - pos) {
+            n = len - pos;
+        }
+        config_json_status_t prev = status;
+        status = config_json_feed(p, (const char *)data + pos, n);
+        if (prev != CONFIG_JSON_MORE && status != prev) {
+            fail_input("error status not sticky", data, len);
+        }
+    }
+    return config_json_finish(p);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t len)
+{
+    config_json_parser_t whole, bytes, chunks;
+    config_json_status_t s_whole = parse(data, len, len ? len : 1, &whole);
+    config_json_status_t s_bytes = parse(data, len, 1, &bytes);
+    config_json_status_t s_chunks = parse(data, len, 0, &chunks);
+
+    if (s_whole != s_bytes || s_whole != s_chunks) {
+        fail_input("status depends on how the input was split", data, len);
+    }
+    if (s_whole == CONFIG_JSON_MORE) {
+        fail_input("finish returned MORE", data, len);
+    }
+    if (s_whole != CONFIG_JSON_DONE) {
+        if (!whole.error) {
+            fail_input("error without a reason", data, len);
+        }
+        return 0;
+    }
+
+    if (memcmp(&whole.staged, &bytes.staged, sizeof(config_t)) != 0 ||
+        memcmp(&whole.staged, &chunks.staged, sizeof(config_t)) != 0) {
+        fail_input("staged config depends on how the input was split", data, len);
+    }
+    const char *reason = NULL;
+    if (!config_validate(&whole.staged, &reason)) {
+        fail_input("accepted a config that fails config_validate()", data, len);
+    }
+    return 0;
+}
+
+#ifndef GALE_FUZZ_LIBFUZZER
+
+static const char *const s_corpus[] = {
+    "{\"hrMax\":185,\"hrResting\":55,\"zone1Percent\":0.33,\"zone2Percent\":0.64,"
+    "\"zone3Percent\":0.76,\"alwaysOn\":0,\"fanDelay\":60000,\"hrHysteresis\":15}",
+    "{\"hrMax\":190}",
+    "{ \"alwaysOn\" : true , \"fanDelay\" : 1.2e4 }",
+    "{\"zone1Percent\":5e-1,\"zone2Percent\":0.7,\"zone3Percent\":0.9}",
+    "{\"name\":\"x\\u0041\\\"y\",\"nested\":{\"a\":[1,2,{\"b\":null}]},\"hrResting\":60}",
+    "{\"hrHysteresis\":-1}",
+    "{\"hrMax\":\"185\"}",
+    "{\"aVeryLongUnknownKeyName\":false}",
+    "{}",
+};
+#define CORPUS_SIZE (sizeof(s_corpus) / sizeof(s_corpus[0]))
+
+static const char s_alphabet[] = "{}[]\":,.-+eE0123456789 \\/utrfnalsx";
+
+static uint64_t s_rng;
+
+static uint32_t rnd(uint32_t n)
+{
+    // xorshift64*
+    s_rng ^= s_rng >> 12;
+    s_rng ^= s_rng << 25;
+    s_rng ^= s_rng >> 27;
+    return (uint32_t)((s_rng * 0x2545F4914F6CDD1DULL) >> 32) % n;
+}
+
+static uint8_t rnd_byte(void)
+{
+    // Mostly JSON syntax, sometimes anything at all
+    return rnd(8) ? (uint8_t)s_alphabet[rnd(sizeof(s_alphabet) - 1)] : (uint8_t)rnd(256);
+}
+
+static size_t mutate(uint8_t *buf, size_t len)
+{
+    int rounds = 1 + rnd(4);
+    for (int i = 0; i < rounds; i++) {
+        size_t pos = len ? rnd(len) : 0;
+        switch (rnd(6)) {
+            case 0:     // Replace a byte
+                if (len) {
+                    buf[pos] = rnd_byte();
+                }
+                break;
+            case 1:     // Insert a byte
+                if (len < MAX_INPUT) {
+                    memmove(buf + pos + 1, buf + pos, len - pos);
+                    buf[pos] = rnd_byte();
+                    len++;
+                }
+                break;
+            case 2: {   // Delete a run
+                size_t n = len - pos ? 1 + rnd(len - pos < 8 ? len - pos : 8) : 0;
+                memmove(buf + pos, buf + pos + n, len - pos - n);
+                len -= n;
+                break;
+            }
+            case 3: {   // Duplicate a run
+                size_t n = len - pos ? 1 + rnd(len - pos < 16 ? len - pos : 16) : 0;
+                if (len + n <= MAX_INPUT) {
+                    memmove(buf + pos + n, buf + pos, len - pos);
+                    len += n;
+                }
+                break;
+            }
+            case 4:     // Truncate
+                len = pos;
+                break;
+            case 5: {   // Splice in part of another corpus entry
+                const char *s = s_corpus[rnd(CORPUS_SIZE)];
+                size_t slen = strlen(s);
+                size_t from = rnd(slen);
+                size_t n = 1 + rnd(slen - from);
+                if (len + n <= MAX_INPUT) {
+                    memmove(buf + pos + n, buf + pos, len - pos);
+                    memcpy(buf + pos, s + from, n);
+                    len += n;
+                }
+                break;
+            }
+        }
+    }
+    return len;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-n iterations] [-s seed]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long iterations = 200000;
+    uint64_t seed = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            iterations = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 0);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    s_rng = seed ? seed : 1;
+
+    uint8_t buf[MAX_INPUT];
+    unsigned long accepted = 0;
+    for (size_t i = 0; i < CORPUS_SIZE; i++) {
+        LLVMFuzzerTestOneInput((const uint8_t *)s_corpus[i], strlen(s_corpus[i]));
+    }
+    for (unsigned long i = 0; i < iterations; i++) {
+        size_t len;
+        if (rnd(4)) {
+            const char *s = s_corpus[rnd(CORPUS_SIZE)];
+            len = strlen(s);
+            memcpy(buf, s, len);
+            len = mutate(buf, len);
+        } else {
+            len = rnd(64);
+            for (size_t j = 0; j < len; j++) {
+                buf[j] = rnd_byte();
+            }
+        }
+
+        config_json_parser_t p;
+        accepted += parse(buf, len, len ? len : 1, &p) == CONFIG_JSON_DONE;
+        LLVMFuzzerTestOneInput(buf, len);
+    }
+
+    printf("config_json_fuzz: %lu inputs (seed %" PRIu64 "), %lu accepted\n",
+           iterations, seed, accepted);
+    return 0;
+}
+
+#endif // GALE_FUZZ_LIBFUZZER
@@ -0,0 +1,10 @@
+#ifndef HOST_ESP_CPU_H
+#define HOST_ESP_CPU_H
+
+// Host stand-in for esp_cpu.h: everything runs on "core 0"
+static inline int esp_cpu_get_core_id(void)
+{
+    return 0;
+}
+
+#endif // HOST_ESP_CPU_H
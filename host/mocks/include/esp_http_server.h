@@ -0,0 +1,10 @@
+#ifndef HOST_ESP_HTTP_SERVER_H
+#define HOST_ESP_HTTP_SERVER_H
+
+// Host stand-in for esp_http_server.h: just enough for module headers that
+// declare their registration functions
+
+typedef void *httpd_handle_t;
+typedef struct httpd_req httpd_req_t;
+
+#endif // HOST_ESP_HTTP_SERVER_H
@@ -0,0 +1,9 @@
+#ifndef HOST_ESP_PARTITION_H
+#define HOST_ESP_PARTITION_H
+
+#include <stdint.h>
+
+// Host stand-in for esp_partition.h (session_log.h types only)
+typedef uint32_t esp_partition_mmap_handle_t;
+
+#endif // HOST_ESP_PARTITION_H
@@ -0,0 +1,24 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+
+// Host stand-in for FreeRTOS.h. One tick is one millisecond of virtual time
+// (see sim.h); there is no scheduler, the simulator calls into the control
+// code directly.
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              pdTRUE
+#define portMAX_DELAY       ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS  1
+#define portNUM_PROCESSORS  1
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(ms))
+
+#endif // HOST_FREERTOS_H
@@ -0,0 +1,24 @@
+#ifndef HOST_FREERTOS_TASK_H
+#define HOST_FREERTOS_TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+// Host stand-in for task.h. Delays advance the virtual clock. Tasks are
+// never started: the simulator calls the work they would do directly.
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+typedef uint8_t StackType_t;                // Stack depths are in bytes, as in ESP-IDF
+typedef struct { void *unused; } StaticTask_t;
+
+#define tskNO_AFFINITY      0x7FFFFFFF
+
+TickType_t xTaskGetTickCount(void);
+void vTaskDelay(TickType_t ticks);
+BaseType_t xTaskDelayUntil(TickType_t *prev_wake, TickType_t increment);
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                       void *arg, UBaseType_t priority, TaskHandle_t *handle);
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                               void *arg, UBaseType_t priority, StackType_t *stack, StaticTask_t *tcb);
+
+#endif // HOST_FREERTOS_TASK_H
@@ -0,0 +1,7 @@
+#ifndef HOST_SDKCONFIG_H
+#define HOST_SDKCONFIG_H
+
+// Host build configuration. Mirrors the sdkconfig.defaults options the
+// control core looks at; CONFIG_DEBUG_MODE can be set with -DCONFIG_DEBUG_MODE.
+
+#endif // HOST_SDKCONFIG_H
@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "driver/ledc.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "sim.h"
+
+// Thin host implementations of the ESP-IDF and FreeRTOS calls the control
+// core makes. No threads: everything runs on the caller's stack against the
+// virtual clock.
+
+// --- Virtual clock ---
+
+static uint64_t s_now_us = 0;
+
+uint64_t sim_now_ms(void)
+{
+    return s_now_us / 1000;
+}
+
+void sim_set_time_ms(uint64_t t_ms)
+{
+    s_now_us = t_ms * 1000;
+}
+
+void sim_set_time_us(uint64_t t_us)
+{
+    s_now_us = t_us;
+}
+
+void sim_advance_ms(uint64_t ms)
+{
+    s_now_us += ms * 1000;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(s_now_us / 1000);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    sim_advance_ms(ticks);
+}
+
+BaseType_t xTaskDelayUntil(TickType_t *prev_wake, TickType_t increment)
+{
+    TickType_t now = xTaskGetTickCount();
+
+    *prev_wake += increment;
+    if ((int32_t)(*prev_wake - now) <= 0) {
+        return pdFALSE;
+    }
+    sim_advance_ms(*prev_wake - now);
+    return pdTRUE;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                       void *arg, UBaseType_t priority, TaskHandle_t *handle)
+{
+    if (handle) {
+        *handle = NULL;
+    }
+    return pdPASS;
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                               void *arg, UBaseType_t priority, StackType_t *stack, StaticTask_t *tcb)
+{
+    return tcb;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return (int64_t)s_now_us;
+}
+
+// --- Logging ---
+
+esp_log_level_t host_log_level = ESP_LOG_WARN;
+
+void host_log(esp_log_level_t level, const char *tag, const char *fmt, ...)
+{
+    static const char letters[] = "NEWIDV";
+    va_list args;
+
+    fprintf(stderr, "%c (%llu) %s: ", letters[level], (unsigned long long)sim_now_ms(), tag);
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *fmt, ...)
+{
+    va_list args;
+
+    if (level > host_log_level) {
+        return;
+    }
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return (uint32_t)sim_now_ms();
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+    case ESP_OK:                    return "ESP_OK";
+    case ESP_FAIL:                  return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:            return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:       return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:     return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:      return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:         return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:     return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:           return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_NVS_NOT_FOUND:     return "ESP_ERR_NVS_NOT_FOUND";
+    default:                        return "UNKNOWN ERROR";
+    }
+}
+
+// --- GPIO ---
+
+static uint8_t s_gpio_levels[GPIO_NUM_MAX];
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio_num)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_gpio_levels[gpio_num] = 0;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode)
+{
+    return (gpio_num >= 0 && gpio_num < GPIO_NUM_MAX) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_gpio_levels[gpio_num] = level ? 1 : 0;
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    return (gpio_num >= 0 && gpio_num < GPIO_NUM_MAX) ? s_gpio_levels[gpio_num] : 0;
+}
+
+// --- LEDC ---
+
+static uint32_t s_ledc_duty;
+static uint32_t s_ledc_pending_duty;
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *timer_conf)
+{
+    return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t *ledc_conf)
+{
+    s_ledc_duty = s_ledc_pending_duty = ledc_conf->duty;
+    return ESP_OK;
+}
+
+esp_err_t ledc_fade_func_install(int intr_alloc_flags)
+{
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t duty)
+{
+    s_ledc_pending_duty = duty;
+    return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t speed_mode, ledc_channel_t channel)
+{
+    s_ledc_duty = s_ledc_pending_duty;
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_fade_with_time(ledc_mode_t speed_mode, ledc_channel_t channel,
+                                  uint32_t target_duty, int max_fade_time_ms)
+{
+    s_ledc_pending_duty = target_duty;
+    return ESP_OK;
+}
+
+esp_err_t ledc_fade_start(ledc_mode_t speed_mode, ledc_channel_t channel, ledc_fade_mode_t fade_mode)
+{
+    s_ledc_duty = s_ledc_pending_duty;
+    return ESP_OK;
+}
+
+uint32_t ledc_get_duty(ledc_mode_t speed_mode, ledc_channel_t channel)
+{
+    return s_ledc_duty;
+}
+
+// --- NVS ---
+
+#define NVS_MAX_KEYS    16
+#define NVS_MAX_VALUE   16
+
+typedef struct {
+    char key[16];
+    size_t len;
+    uint8_t value[NVS_MAX_VALUE];
+} nvs_entry_t;
+
+static nvs_entry_t s_nvs[NVS_MAX_KEYS];
+static int s_nvs_count = 0;
+static uint32_t s_nvs_commits = 0;
+
+static nvs_entry_t *nvs_find(const char *key)
+{
+    for (int i = 0; i < s_nvs_count; i++) {
+        if (strcmp(s_nvs[i].key, key) == 0) {
+            return &s_nvs[i];
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t nvs_get(const char *key, void *out, size_t *len)
+{
+    nvs_entry_t *e = nvs_find(key);
+    if (!e) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (*len < e->len) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(out, e->value, e->len);
+    *len = e->len;
+    return ESP_OK;
+}
+
+static esp_err_t nvs_set(const char *key, const void *value, size_t len)
+{
+    nvs_entry_t *e = nvs_find(key);
+    if (!e) {
+        if (s_nvs_count == NVS_MAX_KEYS || strlen(key) >= sizeof(e->key)) {
+            return ESP_ERR_NO_MEM;
+        }
+        e = &s_nvs[s_nvs_count++];
+        strcpy(e->key, key);
+    }
+    if (len > NVS_MAX_VALUE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(e->value, value, len);
+    e->len = len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    s_nvs_count = 0;
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    // Like a fresh device, a read-only open fails until something was saved
+    if (open_mode == NVS_READONLY && s_nvs_count == 0) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    s_nvs_commits++;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out_value)
+{
+    size_t len = sizeof(*out_value);
+    return nvs_get(key, out_value, &len);
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value)
+{
+    size_t len = sizeof(*out_value);
+    return nvs_get(key, out_value, &len);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    return nvs_get(key, out_value, length);
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value)
+{
+    return nvs_set(key, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value)
+{
+    return nvs_set(key, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    return nvs_set(key, value, length);
+}
+
+uint32_t host_nvs_commit_count(void)
+{
+    return s_nvs_commits;
+}
@@ -0,0 +1,76 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_timer.h"
+#include "metrics.h"
+#include "telemetry.h"
+#include "session_log.h"
+#include "matter_device.h"
+#include "wifi_manager.h"
+#include "control_jitter.h"
+#include "mem_budget.h"
+
+// No-op versions of the modules around the control core (telemetry, session
+// log, Matter, WiFi, loop jitter, memory budget). Metrics are real counters
+// so the simulator can report relay switches; histograms are not kept.
+
+uint32_t g_metrics_counters[portNUM_PROCESSORS][METRIC_COUNT];
+
+void metrics_observe(metric_hist_t h, uint32_t value_us)
+{
+}
+
+void metrics_decision_stamp(void)
+{
+}
+
+void metrics_relay_applied(void)
+{
+}
+
+void metrics_register_task(TaskHandle_t task)
+{
+}
+
+void control_jitter_record(int64_t wake_us, uint32_t run_us)
+{
+}
+
+void mem_budget_add(const char *name, size_t bytes, size_t was_bytes, bool is_static, TaskHandle_t task)
+{
+}
+
+void telemetry_publish(uint8_t type, uint8_t value)
+{
+}
+
+void session_log_hr(uint8_t hr)
+{
+}
+
+void session_log_rr(uint16_t rr)
+{
+}
+
+void session_log_speed(uint8_t speed, bool matter_override)
+{
+}
+
+void session_log_event(uint8_t event)
+{
+}
+
+void matter_device_update_fan_state(uint8_t speed)
+{
+}
+
+void matter_device_update_hr(uint8_t heart_rate)
+{
+}
+
+void matter_device_set_workout_active(bool active)
+{
+}
+
+void wifi_manager_set_workout_mode(bool active)
+{
+}
@@ -0,0 +1,15 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+
+// Host simulation support: the virtual clock behind xTaskGetTickCount() and
+// esp_timer_get_time(). Time only moves when the driver (or a vTaskDelay
+// call) advances it.
+
+uint64_t sim_now_ms(void);
+void sim_set_time_ms(uint64_t t_ms);
+void sim_set_time_us(uint64_t t_us);
+void sim_advance_ms(uint64_t ms);
+
+#endif // SIM_H
@@ -0,0 +1,546 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include "esp_log.h"
+#include "gale.h"
+#include "metrics.h"
+#include "hr_trace.h"
+#include "hr_profile.h"
+#include "tracepoint.h"
+#include "binlog.h"
+#include "alloc_trace.h"
+#include "sim.h"
+
+// Replay driver for the host build. Feeds an HR trace through the control
+// core on the virtual clock: fan_control_tick() runs every
+// FAN_CONTROL_PERIOD_MS of trace time exactly as the fan task would, and HR
+// samples and HRM connection changes are delivered at their timestamps.
+// Nothing sleeps, so a multi-hour ride replays in milliseconds.
+//
+// Two trace formats are accepted:
+//  - .ghrt binary traces captured on the device (/api/trace, hr_trace.h).
+//    Raw notification payloads go through hr_control_measurement(), so
+//    parsing and arrival tracking run too.
+//  - CSV, one event per line, times in ms, '#' starts a comment:
+//      <t_ms>,<hr>             HR sample
+//      <t_ms>,connect          HRM connected
+//      <t_ms>,disconnect       HRM disconnected
+// A trace that starts with HR data is treated as connected from its first
+// sample.
+//
+// Instead of a trace, -g plays a synthetic profile (hr_profile.h) as
+// notifications at -r Hz, the same way /api/synth does on the device but
+// with a fixed seed, so a run is repeatable.
+
+typedef enum {
+    EV_HR = 0,                  // CSV sample
+    EV_NOTIFY,                  // Raw Heart Rate Measurement payload
+    EV_CONNECT,
+    EV_DISCONNECT,
+} sim_event_type_t;
+
+typedef struct {
+    sim_event_type_t type;
+    uint64_t t_us;
+    uint8_t hr;
+    const uint8_t *payload;
+    uint8_t len;
+} sim_event_t;
+
+typedef struct {
+    const char *path;
+    char *data;
+    size_t size;
+    bool binary;
+    bool synth;
+    hr_trace_reader_t reader;   // Binary traces
+    hr_profile_t profile;       // Synthetic source
+    uint64_t period_us;
+    uint64_t duration_us;
+    uint64_t next_us;
+    uint8_t payload[2];
+    char *line;                 // CSV: next line
+    int line_no;
+    uint64_t last_us;
+} sim_source_t;
+
+typedef struct {
+    uint64_t speed_ms[4];       // Time spent at each speed
+    uint32_t speed_changes;
+    uint32_t samples;
+    uint64_t last_change_ms;
+} sim_stats_t;
+
+static bool s_print_changes = true;
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-q] [-v] [-a] [-c name=value]... [-t out.json] <trace.csv|trace.ghrt>\n"
+            "       %s [options] -g profile [-r hz] [-d seconds]\n"
+            "  -q             print only the summary\n"
+            "  -v             control core log output (repeat for debug)\n"
+            "  -t out.json    write the tracepoints as Chrome trace JSON\n"
+            "                 (needs a -DGALE_TRACE=ON build)\n"
+            "  -a             fail if the HR sample -> relay path allocates from\n"
+            "                 the heap, and print the allocating call stacks\n"
+            "  -c name=value  override a setting (hrMax, hrResting, zone1Percent,\n"
+            "                 zone2Percent, zone3Percent, fanDelay, hrHysteresis, alwaysOn)\n"
+            "  -g profile     play a synthetic profile instead of a trace (steady,\n"
+            "                 intervals, ramp, noisy, dropout)\n"
+            "  -r hz          synthetic sample rate, 1-100 (default 1)\n"
+            "  -d seconds     synthetic run length (default 1800)\n",
+            prog, prog);
+}
+
+#ifdef CONFIG_GALE_TRACE
+static void trace_emit(const char *data, size_t len, void *ctx)
+{
+    fwrite(data, 1, len, (FILE *)ctx);
+}
+#endif
+
+static bool write_trace(const char *path)
+{
+#ifdef CONFIG_GALE_TRACE
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    tracepoint_export(trace_emit, f);
+    fclose(f);
+    return true;
+#else
+    fprintf(stderr, "%s: tracepoints are compiled out; rebuild with -DGALE_TRACE=ON\n", path);
+    return false;
+#endif
+}
+
+static bool set_config(config_t *config, const char *arg)
+{
+    const char *eq = strchr(arg, '=');
+    if (!eq) {
+        return false;
+    }
+    size_t len = eq - arg;
+    char *end;
+    double value = strtod(eq + 1, &end);
+    if (end == eq + 1 || *end != '\0') {
+        return false;
+    }
+
+#define MATCH(name) (len == strlen(name) && strncmp(arg, name, len) == 0)
+    if (MATCH("hrMax")) {
+        config->hrMax = (uint8_t)value;
+    } else if (MATCH("hrResting")) {
+        config->hrResting = (uint8_t)value;
+    } else if (MATCH("zone1Percent")) {
+        config->zone1Percent = (float)value;
+    } else if (MATCH("zone2Percent")) {
+        config->zone2Percent = (float)value;
+    } else if (MATCH("zone3Percent")) {
+        config->zone3Percent = (float)value;
+    } else if (MATCH("fanDelay")) {
+        config->fanDelay = (uint32_t)value;
+    } else if (MATCH("hrHysteresis")) {
+        config->hrHysteresis = (uint8_t)value;
+    } else if (MATCH("alwaysOn")) {
+        config->alwaysOn = (uint8_t)value;
+    } else {
+        return false;
+    }
+#undef MATCH
+    return true;
+}
+
+static void fmt_time(char *buf, size_t size, uint64_t t_ms)
+{
+    snprintf(buf, size, "%" PRIu64 ":%02" PRIu64 ":%02" PRIu64 ".%03" PRIu64,
+             t_ms / 3600000, t_ms / 60000 % 60, t_ms / 1000 % 60, t_ms % 1000);
+}
+
+static bool source_open(sim_source_t *src, const char *path)
+{
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+
+    size_t cap = 1 << 16;
+    src->path = path;
+    src->data = malloc(cap + 1);
+    src->size = 0;
+    size_t n;
+    while (src->data && (n = fread(src->data + src->size, 1, cap - src->size, f)) > 0) {
+        src->size += n;
+        if (src->size == cap) {
+            cap *= 2;
+            src->data = realloc(src->data, cap + 1);
+        }
+    }
+    if (f != stdin) {
+        fclose(f);
+    }
+    if (!src->data) {
+        fprintf(stderr, "%s: out of memory\n", path);
+        return false;
+    }
+    src->data[src->size] = '\0';
+
+    src->binary = src->size >= 4 && memcmp(src->data, HR_TRACE_MAGIC, 4) == 0;
+    if (src->binary) {
+        if (hr_trace_reader_init(&src->reader, (const uint8_t *)src->data, src->size) != ESP_OK) {
+            fprintf(stderr, "%s: unsupported trace version\n", path);
+            return false;
+        }
+    } else {
+        src->line = src->data;
+        src->line_no = 0;
+    }
+    src->last_us = 0;
+    return true;
+}
+
+// Synthetic source over the zones in effect, after any -c overrides
+static void source_synth(sim_source_t *src, hr_profile_kind_t kind, uint32_t rate_hz, uint32_t seconds)
+{
+    uint8_t low, high;
+
+    memset(src, 0, sizeof(*src));
+    src->synth = true;
+    src->period_us = 1000000 / rate_hz;
+    src->duration_us = (uint64_t)seconds * 1000000;
+    hr_profile_default_range(g_zone1, g_zone3, g_config.hrResting, g_config.hrMax, &low, &high);
+    hr_profile_init(&src->profile, kind, low, high, 1);
+    hr_control_set_synthetic(true);     // As hr_synth.c does on the device
+}
+
+static bool next_synth(sim_source_t *src, sim_event_t *ev)
+{
+    while (src->next_us < src->duration_us) {
+        uint64_t t_us = src->next_us;
+        src->next_us += src->period_us;
+
+        uint8_t hr;
+        if (hr_profile_sample(&src->profile, (uint32_t)(t_us / 1000), &hr)) {
+            src->payload[0] = 0;
+            src->payload[1] = hr;
+            ev->type = EV_NOTIFY;
+            ev->t_us = t_us;
+            ev->hr = hr;
+            ev->payload = src->payload;
+            ev->len = sizeof(src->payload);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool next_binary(sim_source_t *src, sim_event_t *ev)
+{
+    hr_trace_record_t rec;
+
+    while (hr_trace_next(&src->reader, &rec)) {
+        ev->t_us = rec.t_us;
+        ev->payload = rec.payload;
+        ev->len = rec.len;
+        switch (rec.type) {
+        case HR_TRACE_NOTIFY:
+            ev->type = EV_NOTIFY;
+            ev->hr = rec.len >= 2 ? rec.payload[1] : 0;
+            return true;
+        case HR_TRACE_CONNECT:
+            ev->type = EV_CONNECT;
+            return true;
+        case HR_TRACE_DISCONNECT:
+            ev->type = EV_DISCONNECT;
+            return true;
+        default:
+            break;      // Unknown record types are skipped
+        }
+    }
+    return false;
+}
+
+static bool next_csv(sim_source_t *src, sim_event_t *ev)
+{
+    while (src->line && *src->line) {
+        char *p = src->line;
+        char *nl = strchr(p, '\n');
+        if (nl) {
+            *nl = '\0';
+            src->line = nl + 1;
+        } else {
+            src->line = NULL;
+        }
+        src->line_no++;
+        p[strcspn(p, "\r")] = '\0';
+
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        if (*p == '#' || *p == '\0') {
+            continue;
+        }
+
+        char *end;
+        uint64_t t_us = strtoull(p, &end, 10) * 1000;
+        if (end == p || *end != ',') {
+            fprintf(stderr, "%s:%d: expected <t_ms>,<hr|connect|disconnect>\n", src->path, src->line_no);
+            continue;
+        }
+        if (t_us < src->last_us) {
+            fprintf(stderr, "%s:%d: time goes backwards, skipped\n", src->path, src->line_no);
+            continue;
+        }
+        p = end + 1;
+
+        if (strcmp(p, "connect") == 0) {
+            ev->type = EV_CONNECT;
+        } else if (strcmp(p, "disconnect") == 0) {
+            ev->type = EV_DISCONNECT;
+        } else {
+            unsigned long hr = strtoul(p, &end, 10);
+            if (end == p || *end != '\0' || hr > 255) {
+                fprintf(stderr, "%s:%d: bad heart rate '%s'\n", src->path, src->line_no, p);
+                continue;
+            }
+            ev->type = EV_HR;
+            ev->hr = (uint8_t)hr;
+        }
+        ev->t_us = src->last_us = t_us;
+        return true;
+    }
+    return false;
+}
+
+static bool source_next(sim_source_t *src, sim_event_t *ev)
+{
+    if (src->synth) {
+        return next_synth(src, ev);
+    }
+    return src->binary ? next_binary(src, ev) : next_csv(src, ev);
+}
+
+// Run fan ticks up to (and including) 't_ms', accounting time per speed
+static void run_until(uint64_t t_ms, uint64_t *next_tick_ms, sim_stats_t *stats, uint8_t hr)
+{
+    while (*next_tick_ms <= t_ms) {
+        sim_set_time_ms(*next_tick_ms);
+        uint8_t before = g_prev_speed;
+        alloc_trace_begin();
+        fan_control_tick();
+        alloc_trace_end();
+        if (g_prev_speed != before) {
+            uint64_t now = *next_tick_ms;
+            stats->speed_ms[before] += now - stats->last_change_ms;
+            stats->last_change_ms = now;
+            stats->speed_changes++;
+            if (s_print_changes) {
+                char ts[24];
+                fmt_time(ts, sizeof(ts), now);
+                printf("%s speed %u -> %u (hr %u)\n", ts, before, g_prev_speed, hr);
+            }
+        }
+        *next_tick_ms += FAN_CONTROL_PERIOD_MS;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = NULL;
+    const char *trace_path = NULL;
+    config_t overrides = { 0 };
+    bool have_overrides = false;
+    int verbose = 0;
+    bool check_allocs = false;
+    const char *profile_name = NULL;
+    uint32_t rate_hz = 1;
+    uint32_t seconds = 1800;
+
+    // Start from the firmware defaults, like a fresh device
+    nvs_config_load();
+    overrides = g_config;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-q") == 0) {
+            s_print_changes = false;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose++;
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            if (!set_config(&overrides, argv[++i])) {
+                fprintf(stderr, "bad setting: %s\n", argv[i]);
+                return 2;
+            }
+            have_overrides = true;
+        } else if (strcmp(argv[i], "-a") == 0) {
+            check_allocs = true;
+        } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            profile_name = argv[++i];
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            rate_hz = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            seconds = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if ((argv[i][0] == '-' && argv[i][1] != '\0') || path) {
+            usage(argv[0]);
+            return 2;
+        } else {
+            path = argv[i];
+        }
+    }
+    hr_profile_kind_t profile;
+    if ((path == NULL) == (profile_name == NULL)) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (profile_name && !hr_profile_from_name(profile_name, &profile)) {
+        fprintf(stderr, "unknown profile: %s\n", profile_name);
+        return 2;
+    }
+    if (rate_hz < 1 || rate_hz > 100) {
+        fprintf(stderr, "rate must be 1-100 Hz\n");
+        return 2;
+    }
+    host_log_level = verbose >= 2 ? ESP_LOG_DEBUG : verbose == 1 ? ESP_LOG_INFO : ESP_LOG_WARN;
+
+    if (have_overrides) {
+        const char *reason;
+        if (!config_validate(&overrides, &reason)) {
+            fprintf(stderr, "invalid configuration: %s\n", reason);
+            return 2;
+        }
+        g_config = overrides;
+        calculate_zones();
+    }
+
+    sim_source_t src;
+    if (profile_name) {
+        source_synth(&src, profile, rate_hz, seconds);
+    } else if (!source_open(&src, path)) {
+        return 1;
+    }
+
+    // Same bring-up order as app_main
+    if (fan_control_init() != ESP_OK) {
+        return 1;
+    }
+    led_control_init();
+    g_current_speed = g_config.alwaysOn;
+
+#ifdef CONFIG_GALE_TRACE
+    if (trace_path && tracepoint_start() != ESP_OK) {
+        fprintf(stderr, "%s: out of memory\n", trace_path);
+        return 1;
+    }
+#endif
+
+    struct timespec wall_start, wall_end;
+    clock_gettime(CLOCK_MONOTONIC, &wall_start);
+
+    sim_stats_t stats = { 0 };
+    uint64_t next_tick_ms = 0;
+    uint64_t first_ms = 0;
+    uint64_t t_ms = 0;
+    uint8_t last_hr = 0;
+    bool seen_event = false;
+    sim_event_t ev;
+
+    while (source_next(&src, &ev)) {
+        t_ms = ev.t_us / 1000;
+        if (!seen_event) {
+            // Start the clock at the first event
+            first_ms = next_tick_ms = t_ms;
+            stats.last_change_ms = t_ms;
+        }
+        run_until(t_ms, &next_tick_ms, &stats, last_hr);
+        sim_set_time_us(ev.t_us);
+
+        switch (ev.type) {
+        case EV_CONNECT:
+            hr_control_connected();
+            break;
+        case EV_DISCONNECT:
+            hr_control_disconnected();
+            break;
+        case EV_HR:
+        case EV_NOTIFY:
+            if (!g_ble_connected && !seen_event) {
+                hr_control_connected();
+            }
+            last_hr = ev.hr;
+            // Steady state: nothing from here to the relays may allocate
+            alloc_trace_begin();
+            if (ev.type == EV_NOTIFY) {
+                metrics_inc(METRIC_NOTIFY_RX);
+                TRACEPOINT(TP_NOTIFY_RX, ev.len);
+                hr_control_measurement(ev.payload, ev.len);
+            } else {
+                calculate_fan_speed(ev.hr);
+            }
+            alloc_trace_end();
+            stats.samples++;
+            break;
+        }
+        seen_event = true;
+#ifdef CONFIG_GALE_BINLOG
+        binlog_flush();
+#endif
+    }
+    free(src.data);
+
+    // Let pending speed drops (fanDelay) play out after the last event
+    uint64_t end_ms = t_ms + g_config.fanDelay + FAN_CONTROL_PERIOD_MS;
+    if (seen_event) {
+        run_until(end_ms, &next_tick_ms, &stats, last_hr);
+        stats.speed_ms[g_prev_speed] += end_ms - stats.last_change_ms;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &wall_end);
+    double wall_s = (wall_end.tv_sec - wall_start.tv_sec) + (wall_end.tv_nsec - wall_start.tv_nsec) / 1e9;
+
+    double sim_s = seen_event ? (end_ms - first_ms) / 1e3 : 0;
+    char ts[24];
+    fmt_time(ts, sizeof(ts), (uint64_t)(sim_s * 1000));
+
+    printf("simulated %s (%" PRIu32 " samples) in %.3f ms", ts, stats.samples, wall_s * 1e3);
+    if (wall_s > 0) {
+        printf(", %.0fx real time", sim_s / wall_s);
+    }
+    printf("\nzones: %.1f / %.1f / %.1f BPM\n", g_zone1, g_zone2, g_zone3);
+    if (src.binary || src.synth) {
+        printf("notifications: %" PRIu32 " received, %" PRIu32 " dropped, %" PRIu32 " lost in gaps\n",
+               g_metrics_counters[0][METRIC_NOTIFY_RX],
+               g_metrics_counters[0][METRIC_NOTIFY_DROPPED],
+               g_metrics_counters[0][METRIC_NOTIFY_LOST]);
+    }
+    printf("speed changes: %" PRIu32 ", relay switches: %" PRIu32 "/%" PRIu32 "/%" PRIu32 "\n",
+           stats.speed_changes,
+           g_metrics_counters[0][METRIC_RELAY1_SWITCHES],
+           g_metrics_counters[0][METRIC_RELAY2_SWITCHES],
+           g_metrics_counters[0][METRIC_RELAY3_SWITCHES]);
+    for (int s = 0; s < 4; s++) {
+        fmt_time(ts, sizeof(ts), stats.speed_ms[s]);
+        printf("speed %d: %s (%.1f%%)\n", s, ts, sim_s > 0 ? stats.speed_ms[s] / (sim_s * 10) : 0.0);
+    }
+    printf("final: speed %u, led mode %u\n", g_prev_speed, led_control_get_mode());
+
+    if (check_allocs) {
+        uint64_t allocs = alloc_trace_guarded();
+        printf("heap allocations on the HR -> relay path: %llu\n", (unsigned long long)allocs);
+        if (allocs) {
+            fflush(stdout);
+            alloc_trace_report(stdout);
+        }
+    }
+
+    if (trace_path && !write_trace(trace_path)) {
+        return 1;
+    }
+    return check_allocs && alloc_trace_guarded() ? 1 : 0;
+}
@@ -0,0 +1,48 @@
+#include "gale.h"
+#include "config_json.h"
+#include "bench_cases.h"
+
+// Results go to a volatile so the compiler can't drop the work
+static volatile uint32_t s_sink;
+
+const uint8_t g_bench_payloads[BENCH_NUM_PAYLOADS][6] = {
+    { 0x00, 72 },                               // 8-bit HR
+    { 0x10, 131, 0x40, 0x03 },                  // 8-bit HR + one RR interval
+    { 0x11, 155, 0x00, 0x80, 0x02, 0x00 },      // 16-bit HR + RR
+    { 0x00, 118 },
+};
+const uint8_t g_bench_payload_lens[BENCH_NUM_PAYLOADS] = { 2, 4, 6, 2 };
+
+static const char s_config_json[] =
+    "{\"hrMax\":185,\"hrResting\":55,\"zone1Percent\":0.33,\"zone2Percent\":0.64,"
+    "\"zone3Percent\":0.76,\"alwaysOn\":0,\"fanDelay\":60000,\"hrHysteresis\":15}";
+
+void bench_hr_parse(uint32_t iters)
+{
+    hrm_measurement_t m;
+    for (uint32_t i = 0; i < iters; i++) {
+        uint32_t k = i % BENCH_NUM_PAYLOADS;
+        hrm_parse_measurement(g_bench_payloads[k], g_bench_payload_lens[k], &m);
+        s_sink = m.hr;
+    }
+}
+
+void bench_config_json(uint32_t iters)
+{
+    config_json_parser_t p;
+    for (uint32_t i = 0; i < iters; i++) {
+        config_json_init(&p, &g_config);
+        config_json_feed(&p, s_config_json, sizeof(s_config_json) - 1);
+        s_sink = config_json_finish(&p);
+    }
+}
+
+void bench_matter_mapping(uint32_t iters)
+{
+    uint32_t acc = 0;
+    for (uint32_t i = 0; i < iters; i++) {
+        uint8_t speed = fan_percent_to_speed(i % 101);
+        acc += fan_speed_to_percent(speed);
+    }
+    s_sink = acc;
+}
@@ -0,0 +1,30 @@
+#ifndef BENCH_CASES_H
+#define BENCH_CASES_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Benchmark cases shared by the on-device console benchmarks (perf_bench.c)
+// and the host gale_bench (host/bench/bench_main.c), so both time the same
+// code. Only side-effect-free pieces of the control path belong here; each
+// function runs its operation 'iters' times.
+
+#define BENCH_NUM_PAYLOADS  4
+
+// Heart Rate Measurement values covering the parser's paths: 8 and 16-bit
+// HR, with and without RR intervals
+extern const uint8_t g_bench_payloads[BENCH_NUM_PAYLOADS][6];
+extern const uint8_t g_bench_payload_lens[BENCH_NUM_PAYLOADS];
+
+void bench_hr_parse(uint32_t iters);
+void bench_config_json(uint32_t iters);
+void bench_matter_mapping(uint32_t iters);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BENCH_CASES_H
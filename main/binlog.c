@@ -0,0 +1,115 @@
+#include "binlog.h"
+
+#ifdef CONFIG_GALE_BINLOG
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "metrics.h"
+#include "mem_budget.h"
+
+// Multi-producer ring, single consumer (the drain task). A producer claims
+// a slot by advancing s_head with a compare-and-swap (refusing when the ring
+// is full), fills it in, then publishes it by storing the slot's sequence
+// number. The drain stops at the first unpublished slot, so a producer
+// preempted mid-record only delays the records behind it.
+
+#define RING_SIZE           CONFIG_GALE_BINLOG_RECORDS
+_Static_assert((RING_SIZE & (RING_SIZE - 1)) == 0, "GALE_BINLOG_RECORDS must be a power of two");
+
+#define DRAIN_PERIOD_MS     100
+#define DRAIN_STACK_SIZE    3072
+#define DRAIN_PRIORITY      1           // Lowest; logging never delays control
+#define LINE_SIZE           160
+
+typedef struct {
+    uint32_t seq;                       // Position + 1 once published
+    uint32_t timestamp_ms;
+    const char *tag;
+    const char *fmt;
+    uint8_t level;
+    uint8_t num_args;
+    uint32_t args[BINLOG_MAX_ARGS];
+} binlog_record_t;
+
+static binlog_record_t s_ring[RING_SIZE];
+static uint32_t s_head = 0;             // Next position to claim
+static uint32_t s_tail = 0;             // Next position to print
+static uint32_t s_dropped = 0;          // Not yet reported by the drain
+static StackType_t s_drain_stack[DRAIN_STACK_SIZE];
+static StaticTask_t s_drain_tcb;
+
+void binlog_write(esp_log_level_t level, const char *tag, const char *fmt,
+                  const uint32_t *args, uint8_t num_args)
+{
+    uint32_t pos = __atomic_load_n(&s_head, __ATOMIC_RELAXED);
+    do {
+        if (pos - __atomic_load_n(&s_tail, __ATOMIC_ACQUIRE) >= RING_SIZE) {
+            __atomic_fetch_add(&s_dropped, 1, __ATOMIC_RELAXED);
+            metrics_inc(METRIC_BINLOG_DROPPED);
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&s_head, &pos, pos + 1, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    binlog_record_t *rec = &s_ring[pos & (RING_SIZE - 1)];
+    rec->timestamp_ms = esp_log_timestamp();
+    rec->tag = tag;
+    rec->fmt = fmt;
+    rec->level = level;
+    rec->num_args = num_args;
+    for (uint8_t i = 0; i < num_args; i++) {
+        rec->args[i] = args[i];
+    }
+    __atomic_store_n(&rec->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+void binlog_flush(void)
+{
+    static const char letters[] = "NEWIDV";
+    char line[LINE_SIZE];
+
+    uint32_t dropped = __atomic_exchange_n(&s_dropped, 0, __ATOMIC_RELAXED);
+    if (dropped) {
+        esp_log_write(ESP_LOG_WARN, "BINLOG", "W (%" PRIu32 ") BINLOG: %" PRIu32 " records dropped\n",
+                      esp_log_timestamp(), dropped);
+    }
+
+    uint32_t pos = s_tail;
+    for (;;) {
+        binlog_record_t *rec = &s_ring[pos & (RING_SIZE - 1)];
+        if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+            break;
+        }
+
+        // Unused trailing arguments are ignored by the format
+        const uint32_t *a = rec->args;
+        snprintf(line, sizeof(line), rec->fmt, a[0], a[1], a[2], a[3], a[4], a[5]);
+        esp_log_write(rec->level, rec->tag, "%c (%" PRIu32 ") %s: %s\n",
+                      letters[rec->level], rec->timestamp_ms, rec->tag, line);
+
+        pos++;
+        __atomic_store_n(&s_tail, pos, __ATOMIC_RELEASE);
+    }
+}
+
+static void binlog_task(void *pvParameters)
+{
+    while (1) {
+        binlog_flush();
+        vTaskDelay(pdMS_TO_TICKS(DRAIN_PERIOD_MS));
+    }
+}
+
+void binlog_init(void)
+{
+    TaskHandle_t task = xTaskCreateStatic(binlog_task, "binlog", DRAIN_STACK_SIZE, NULL,
+                                          DRAIN_PRIORITY, s_drain_stack, &s_drain_tcb);
+    metrics_register_task(task);
+    mem_budget_add("binlog", sizeof(s_drain_stack) + sizeof(s_drain_tcb) + sizeof(s_ring),
+                   DRAIN_STACK_SIZE + sizeof(StaticTask_t), true, task);
+}
+
+#endif // CONFIG_GALE_BINLOG
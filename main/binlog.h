@@ -0,0 +1,69 @@
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include <stdint.h>
+#include <inttypes.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Deferred binary logging for the HR notification path.
+//
+// BINLOGI(TAG, fmt, args...) looks like ESP_LOGI but, with CONFIG_GALE_BINLOG
+// enabled, only stores the level, tag and format pointers and the raw
+// arguments in a ring; a low-priority task formats and prints the records
+// later, with their original timestamps. The caller never formats or touches
+// the UART. When the option is off the macros are plain ESP_LOGx.
+//
+// Arguments are stored as uint32_t, at most BINLOG_MAX_ARGS of them, so
+// formats must use only 32-bit integer conversions (%" PRIu32 ", %" PRIx32 ",
+// ...) and take at least one argument. The format and tag must be string
+// literals or otherwise outlive the record.
+#define BINLOG_MAX_ARGS     6
+
+#ifdef CONFIG_GALE_BINLOG
+
+#define BINLOG_LEVEL(level, tag, fmt, ...) do {                                 \
+        if (LOG_LOCAL_LEVEL >= (level)) {                                       \
+            const uint32_t binlog_args_[] = { __VA_ARGS__ };                    \
+            _Static_assert(sizeof(binlog_args_) <= BINLOG_MAX_ARGS * sizeof(uint32_t), \
+                           "too many BINLOG arguments");                        \
+            binlog_write((level), (tag), (fmt), binlog_args_,                   \
+                         sizeof(binlog_args_) / sizeof(binlog_args_[0]));       \
+        }                                                                       \
+    } while (0)
+
+#else
+
+#define BINLOG_LEVEL(level, tag, fmt, ...) ESP_LOG_LEVEL_LOCAL(level, tag, fmt, __VA_ARGS__)
+
+#endif // CONFIG_GALE_BINLOG
+
+#define BINLOGE(tag, fmt, ...) BINLOG_LEVEL(ESP_LOG_ERROR, tag, fmt, __VA_ARGS__)
+#define BINLOGW(tag, fmt, ...) BINLOG_LEVEL(ESP_LOG_WARN, tag, fmt, __VA_ARGS__)
+#define BINLOGI(tag, fmt, ...) BINLOG_LEVEL(ESP_LOG_INFO, tag, fmt, __VA_ARGS__)
+#define BINLOGD(tag, fmt, ...) BINLOG_LEVEL(ESP_LOG_DEBUG, tag, fmt, __VA_ARGS__)
+
+#ifdef CONFIG_GALE_BINLOG
+
+// Queue a record; drops it (and counts the drop) when the ring is full
+void binlog_write(esp_log_level_t level, const char *tag, const char *fmt,
+                  const uint32_t *args, uint8_t num_args);
+
+// Format and print every queued record. Called by the drain task; the host
+// simulator calls it directly.
+void binlog_flush(void);
+
+// Start the drain task
+void binlog_init(void);
+
+#endif // CONFIG_GALE_BINLOG
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BINLOG_H
@@ -8,6 +8,12 @@
 #include "host/ble_gatt.h"
 #include "nimble/nimble_port.h"
 #include "gale.h"
+#include "metrics.h"
+#include "hr_recorder.h"
+#include "hr_synth.h"
+#include "tracepoint.h"
+#include "binlog.h"
+#include "esp_timer.h"
 
 static const char *TAG = "BLE_HRM";
 
@@ -25,6 +31,11 @@ static uint16_t hrm_conn_handle = BLE_HS_CONN_HANDLE_NONE;
 static bool is_scanning = false;
 static uint16_t hrm_chr_val_handle = 0;
 static uint16_t hrm_chr_cccd_handle = 0;
+static int64_t scan_start_us = 0;
+
+// Largest HR measurement kept; the rest of a longer notification is dropped.
+// Flags, a 16-bit HR and energy expended leave room for 26 RR intervals.
+#define NOTIFY_MAX_LEN      64
 
 // Forward declarations
 static void ble_hrm_scan_start(void);
@@ -35,43 +46,18 @@ static int ble_hrm_on_dsc_disc(uint16_t conn_handle,
                                const struct ble_gatt_dsc *dsc,
                                void *arg);
 
-// Calculate fan speed from heart rate data
-static void calculate_fan_speed(uint8_t heart_rate)
+// Copy a notification into 'buf'. The payload may span a chain of mbufs, so
+// OS_MBUF_DATA() only covers the first one.
+static uint16_t notify_copy(struct os_mbuf *om, uint8_t *buf)
 {
-    if (heart_rate == 0) return;
-
-    // Skip if Matter is overriding HRM control
-    if (g_matter_override) {
-        ESP_LOGD(TAG, "Heart Rate: %d BPM (Matter override active, ignoring)", heart_rate);
-        return;
-    }
-
-    uint8_t current_speed = g_current_speed;
-
-    // ZONE 0 -> FAN OFF (or minimum speed if alwaysOn)
-    if (current_speed > 0 && heart_rate < g_zone1) {
-        g_current_speed = g_config.alwaysOn;
-        g_speed_changed_time = xTaskGetTickCount() * portTICK_PERIOD_MS;
-    }
-    // ZONE 1
-    else if ((current_speed < 1 && heart_rate >= g_zone1 && heart_rate < g_zone2) ||
-             (current_speed > 1 && heart_rate < g_zone2 - g_config.hrHysteresis)) {
-        g_current_speed = 1;
-        g_speed_changed_time = xTaskGetTickCount() * portTICK_PERIOD_MS;
-    }
-    // ZONE 2
-    else if ((current_speed < 2 && heart_rate >= g_zone2 && heart_rate < g_zone3) ||
-             (current_speed > 2 && heart_rate < g_zone3 - g_config.hrHysteresis)) {
-        g_current_speed = 2;
-        g_speed_changed_time = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    uint16_t len = OS_MBUF_PKTLEN(om);
+    if (len > NOTIFY_MAX_LEN) {
+        len = NOTIFY_MAX_LEN;
     }
-    // ZONE 3
-    else if (current_speed < 3 && heart_rate >= g_zone3) {
-        g_current_speed = 3;
-        g_speed_changed_time = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    if (os_mbuf_copydata(om, 0, len, buf) != 0) {
+        return 0;
     }
-
-    ESP_LOGI(TAG, "Heart Rate: %d BPM, Current Speed: %d", heart_rate, g_current_speed);
+    return len;
 }
 
 // Callback for GATT attribute access (notifications)
@@ -81,28 +67,11 @@ static int ble_hrm_on_notify(uint16_t conn_handle,
                              void *arg)
 {
     if (error->status == 0 && attr && attr->om) {
-        uint8_t *data = OS_MBUF_DATA(attr->om, uint8_t *);
-        uint16_t len = OS_MBUF_PKTLEN(attr->om);
-
-        if (len >= 2) {
-            // Parse heart rate value (flags in byte 0, HR in byte 1 for 8-bit format)
-            uint8_t flags = data[0];
-            uint8_t hr;
-
-            if (flags & 0x01) {
-                // 16-bit heart rate value
-                if (len >= 3) {
-                    hr = data[1];  // Use lower byte
-                } else {
-                    return 0;
-                }
-            } else {
-                // 8-bit heart rate value
-                hr = data[1];
-            }
+        uint8_t data[NOTIFY_MAX_LEN];
+        uint16_t len = notify_copy(attr->om, data);
 
-            calculate_fan_speed(hr);
-        }
+        hr_recorder_notify(data, len);
+        hr_control_measurement(data, len);
     }
     return 0;
 }
@@ -220,13 +189,13 @@ static int ble_hrm_gap_event(struct ble_gap_event *event, void *arg)
             }
 
             if (found_hrm) {
-                char addr_str[18];
-                snprintf(addr_str, sizeof(addr_str),
-                         "%02x:%02x:%02x:%02x:%02x:%02x",
-                         event->disc.addr.val[5], event->disc.addr.val[4],
-                         event->disc.addr.val[3], event->disc.addr.val[2],
-                         event->disc.addr.val[1], event->disc.addr.val[0]);
-                ESP_LOGI(TAG, "Found HRM device: %s", addr_str);
+                const uint8_t *addr = event->disc.addr.val;
+                BINLOGI(TAG, "Found HRM device: %02" PRIx32 ":%02" PRIx32 ":%02" PRIx32
+                        ":%02" PRIx32 ":%02" PRIx32 ":%02" PRIx32,
+                        (uint32_t)addr[5], (uint32_t)addr[4], (uint32_t)addr[3],
+                        (uint32_t)addr[2], (uint32_t)addr[1], (uint32_t)addr[0]);
+                metrics_observe(HIST_SCAN_DURATION,
+                                (uint32_t)(esp_timer_get_time() - scan_start_us));
 
                 // Stop scanning and connect
                 ble_gap_disc_cancel();
@@ -247,22 +216,16 @@ static int ble_hrm_gap_event(struct ble_gap_event *event, void *arg)
         if (event->connect.status == 0) {
             ESP_LOGI(TAG, "Connected to HRM");
             hrm_conn_handle = event->connect.conn_handle;
-            g_ble_connected = true;
+            hr_recorder_connection(true);
+            hr_synth_hrm_connected();
+
+            // Workout starts: fan to low speed, LED pulsing
+            hr_control_connected();
 
             // Reset characteristic handles
             hrm_chr_val_handle = 0;
             hrm_chr_cccd_handle = 0;
 
-            // Turn on fan to low speed when HRM connects (unless Matter is overriding)
-            if (g_current_speed == 0 && !g_matter_override) {
-                g_current_speed = 1;
-                g_speed_changed_time = xTaskGetTickCount() * portTICK_PERIOD_MS;
-                ESP_LOGI(TAG, "HRM connected - fan set to low speed");
-            }
-
-            // Start LED pulsing at current speed
-            led_control_set_mode(g_current_speed);
-
             // Discover Heart Rate Service
             ble_gattc_disc_svc_by_uuid(hrm_conn_handle,
                                        &hrm_service_uuid.u,
@@ -281,11 +244,8 @@ static int ble_hrm_gap_event(struct ble_gap_event *event, void *arg)
         hrm_conn_handle = BLE_HS_CONN_HANDLE_NONE;
         hrm_chr_val_handle = 0;
         hrm_chr_cccd_handle = 0;
-        g_ble_connected = false;
-        g_disconnected_time = xTaskGetTickCount() * portTICK_PERIOD_MS;
-
-        led_control_off();  // Turn off LED immediately
-        // Fan will turn off after fanDelay timeout in fan_control_task
+        hr_recorder_connection(false);
+        hr_control_disconnected();
 
         // Restart scanning after delay
         vTaskDelay(pdMS_TO_TICKS(1000));
@@ -295,23 +255,13 @@ static int ble_hrm_gap_event(struct ble_gap_event *event, void *arg)
     case BLE_GAP_EVENT_NOTIFY_RX:
         // Handle incoming notification
         if (event->notify_rx.attr_handle == hrm_chr_val_handle) {
-            uint8_t *data = OS_MBUF_DATA(event->notify_rx.om, uint8_t *);
-            uint16_t len = OS_MBUF_PKTLEN(event->notify_rx.om);
-
-            if (len >= 2) {
-                uint8_t flags = data[0];
-                uint8_t hr;
-
-                if (flags & 0x01) {
-                    // 16-bit heart rate
-                    hr = (len >= 3) ? data[1] : 0;
-                } else {
-                    // 8-bit heart rate
-                    hr = data[1];
-                }
+            uint8_t data[NOTIFY_MAX_LEN];
+            uint16_t len = notify_copy(event->notify_rx.om, data);
 
-                calculate_fan_speed(hr);
-            }
+            metrics_inc(METRIC_NOTIFY_RX);
+            TRACEPOINT(TP_NOTIFY_RX, len);
+            hr_recorder_notify(data, len);
+            hr_control_measurement(data, len);
         }
         break;
 
@@ -352,6 +302,7 @@ static void ble_hrm_scan_start(void)
                           ble_hrm_gap_event, NULL);
     if (rc == 0) {
         is_scanning = true;
+        scan_start_us = esp_timer_get_time();
         ESP_LOGI(TAG, "Scanning started");
     } else {
         ESP_LOGE(TAG, "Failed to start scan, rc=%d", rc);
@@ -366,8 +317,9 @@ void ble_hrm_init(void)
     ESP_LOGI(TAG, "NimBLE HRM client initialized");
 }
 
-void ble_hrm_start_scan(void)
+bool ble_hrm_start_scan(void)
 {
     ESP_LOGI(TAG, "Starting HRM scan");
     ble_hrm_scan_start();
+    return is_scanning || g_ble_connected;
 }
@@ -0,0 +1,497 @@
+#include <string.h>
+#include "config_json.h"
+
+// Streaming single-pass JSON parser for the config API.
+//
+// The web server receives the request body in small chunks; each chunk is
+// fed straight into this state machine, which writes recognised values into
+// a staged config_t. Nothing is buffered beyond the current key, so memory
+// use is constant regardless of body size. The staged config only replaces
+// g_config once the whole object has parsed and passed config_validate().
+
+#define MAX_NUM_DIGITS   18    // Fits in uint64_t without overflow
+#define MAX_SKIP_DEPTH   16
+
+enum {
+    ST_BEGIN = 0,       // Expect '{'
+    ST_KEY_OR_END,      // After '{': expect '"' or '}'
+    ST_KEY_START,       // After ',': expect '"'
+    ST_KEY,             // Inside a key string
+    ST_COLON,
+    ST_VALUE,
+    ST_INT_FIRST,       // After '-': expect a digit
+    ST_INT,
+    ST_FRAC_FIRST,      // After '.': expect a digit
+    ST_FRAC,
+    ST_EXP_SIGN,        // After 'e'
+    ST_EXP_FIRST,
+    ST_EXP,
+    ST_LITERAL,         // Matching true/false/null
+    ST_STRING_SKIP,     // Inside a string value we ignore
+    ST_NESTED_SKIP,     // Inside an object/array value we ignore
+    ST_AFTER_VALUE,     // Expect ',' or '}'
+    ST_DONE,
+};
+
+typedef enum {
+    TYPE_U8,
+    TYPE_U32,
+    TYPE_BOOL,
+    TYPE_PERCENT,       // Fraction in (0, 1]
+} field_type_t;
+
+typedef struct {
+    const char *key;
+    field_type_t type;
+    uint32_t min;
+    uint32_t max;
+} field_desc_t;
+
+enum {
+    FIELD_UNKNOWN = 0,
+    FIELD_HR_MAX,
+    FIELD_HR_RESTING,
+    FIELD_ZONE1,
+    FIELD_ZONE2,
+    FIELD_ZONE3,
+    FIELD_ALWAYS_ON,
+    FIELD_FAN_DELAY,
+    FIELD_HR_HYSTERESIS,
+    FIELD_COUNT
+};
+
+// Per-field bounds; cross-field rules live in config_validate()
+static const field_desc_t s_fields[FIELD_COUNT] = {
+    [FIELD_UNKNOWN]       = { NULL,           TYPE_U8,      0,   0 },
+    [FIELD_HR_MAX]        = { "hrMax",        TYPE_U8,      HR_MAX_MIN, HR_MAX_MAX },
+    [FIELD_HR_RESTING]    = { "hrResting",    TYPE_U8,      HR_RESTING_MIN, HR_RESTING_MAX },
+    [FIELD_ZONE1]         = { "zone1Percent", TYPE_PERCENT, 0,   0 },
+    [FIELD_ZONE2]         = { "zone2Percent", TYPE_PERCENT, 0,   0 },
+    [FIELD_ZONE3]         = { "zone3Percent", TYPE_PERCENT, 0,   0 },
+    [FIELD_ALWAYS_ON]     = { "alwaysOn",     TYPE_BOOL,    0,   1 },
+    [FIELD_FAN_DELAY]     = { "fanDelay",     TYPE_U32,     0,   FAN_DELAY_MAX },
+    [FIELD_HR_HYSTERESIS] = { "hrHysteresis", TYPE_U8,      0,   HR_HYSTERESIS_MAX },
+};
+
+static config_json_status_t fail(config_json_parser_t *p, config_json_status_t status,
+                                 const char *error)
+{
+    p->status = status;
+    p->error = error;
+    return status;
+}
+
+static bool is_ws(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static int hex_val(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static uint8_t lookup_field(const config_json_parser_t *p)
+{
+    if (p->key_overflow) {
+        return FIELD_UNKNOWN;
+    }
+    for (uint8_t i = 1; i < FIELD_COUNT; i++) {
+        const char *k = s_fields[i].key;
+        if (strlen(k) == p->key_len && memcmp(k, p->key, p->key_len) == 0) {
+            return i;
+        }
+    }
+    return FIELD_UNKNOWN;
+}
+
+static void key_append(config_json_parser_t *p, char c)
+{
+    if (p->key_len < sizeof(p->key)) {
+        p->key[p->key_len++] = c;
+    } else {
+        p->key_overflow = true;
+    }
+}
+
+// Handle one character of a string body. Returns 1 when the closing quote
+// was consumed, 0 to continue, -1 on a syntax error. Decoded characters are
+// appended to the key when 'is_key' is set.
+static int string_char(config_json_parser_t *p, char c, bool is_key)
+{
+    if (p->esc == 1) {
+        char out;
+        switch (c) {
+            case '"':  out = '"';  break;
+            case '\\': out = '\\'; break;
+            case '/':  out = '/';  break;
+            case 'b':  out = '\b'; break;
+            case 'f':  out = '\f'; break;
+            case 'n':  out = '\n'; break;
+            case 'r':  out = '\r'; break;
+            case 't':  out = '\t'; break;
+            case 'u':
+                p->esc = 2;
+                p->num_mant = 0;
+                return 0;
+            default:
+                return -1;
+        }
+        if (is_key) key_append(p, out);
+        p->esc = 0;
+        return 0;
+    }
+
+    if (p->esc >= 2) {
+        int v = hex_val(c);
+        if (v < 0) return -1;
+        p->num_mant = (p->num_mant << 4) | (uint64_t)v;
+        if (++p->esc == 6) {
+            // None of our keys contain non-ASCII, so anything else is unknown
+            if (is_key) {
+                if (p->num_mant < 0x80) {
+                    key_append(p, (char)p->num_mant);
+                } else {
+                    p->key_overflow = true;
+                }
+            }
+            p->esc = 0;
+        }
+        return 0;
+    }
+
+    if (c == '\\') {
+        p->esc = 1;
+        return 0;
+    }
+    if (c == '"') {
+        return 1;
+    }
+    if ((unsigned char)c < 0x20) {
+        return -1;
+    }
+    if (is_key) key_append(p, c);
+    return 0;
+}
+
+static void number_begin(config_json_parser_t *p)
+{
+    p->num_neg = false;
+    p->num_frac = false;
+    p->num_digits = 0;
+    p->num_exp = 0;
+    p->num_exp_val = 0;
+    p->num_exp_neg = false;
+    p->num_mant = 0;
+}
+
+static void number_digit(config_json_parser_t *p, char c)
+{
+    if (p->num_mant == 0 && c == '0') {
+        // Leading zeros don't consume precision
+        if (p->num_frac) p->num_exp--;
+        return;
+    }
+    if (p->num_digits < MAX_NUM_DIGITS) {
+        p->num_mant = p->num_mant * 10 + (uint64_t)(c - '0');
+        p->num_digits++;
+        if (p->num_frac) p->num_exp--;
+    } else if (!p->num_frac) {
+        // Drop excess integer digits but keep the magnitude
+        p->num_exp++;
+    }
+}
+
+// Store a completed value into the staged config
+static config_json_status_t assign_number(config_json_parser_t *p)
+{
+    const field_desc_t *f = &s_fields[p->field];
+    if (p->field == FIELD_UNKNOWN) {
+        return CONFIG_JSON_MORE;
+    }
+
+    int32_t exp = p->num_exp + (p->num_exp_neg ? -p->num_exp_val : p->num_exp_val);
+    uint64_t mant = p->num_mant;
+
+    if (f->type == TYPE_PERCENT) {
+        if (p->num_neg) {
+            return fail(p, CONFIG_JSON_ERR_RANGE, "zone percent must be in (0, 1]");
+        }
+        double v = (double)mant;
+        for (; exp > 0 && v <= 1.0; exp--) v *= 10.0;
+        for (; exp < 0 && v > 0.0; exp++) v /= 10.0;
+        if (exp > 0 || v <= 0.0 || v > 1.0) {
+            return fail(p, CONFIG_JSON_ERR_RANGE, "zone percent must be in (0, 1]");
+        }
+        float fv = (float)v;
+        switch (p->field) {
+            case FIELD_ZONE1: p->staged.zone1Percent = fv; break;
+            case FIELD_ZONE2: p->staged.zone2Percent = fv; break;
+            default:          p->staged.zone3Percent = fv; break;
+        }
+        return CONFIG_JSON_MORE;
+    }
+
+    // Integer fields: the value must be integral and within bounds
+    for (; exp < 0 && mant != 0; exp++) {
+        if (mant % 10 != 0) {
+            return fail(p, CONFIG_JSON_ERR_TYPE, "expected an integer");
+        }
+        mant /= 10;
+    }
+    for (; exp > 0 && mant != 0; exp--) {
+        mant *= 10;
+        if (mant > f->max) break;
+    }
+    if ((p->num_neg && mant != 0) || mant < f->min || mant > f->max) {
+        return fail(p, CONFIG_JSON_ERR_RANGE, "value out of range");
+    }
+
+    switch (p->field) {
+        case FIELD_HR_MAX:        p->staged.hrMax = (uint8_t)mant; break;
+        case FIELD_HR_RESTING:    p->staged.hrResting = (uint8_t)mant; break;
+        case FIELD_ALWAYS_ON:     p->staged.alwaysOn = (uint8_t)mant; break;
+        case FIELD_FAN_DELAY:     p->staged.fanDelay = (uint32_t)mant; break;
+        case FIELD_HR_HYSTERESIS: p->staged.hrHysteresis = (uint8_t)mant; break;
+        default: break;
+    }
+    return CONFIG_JSON_MORE;
+}
+
+static config_json_status_t assign_literal(config_json_parser_t *p)
+{
+    if (p->field == FIELD_UNKNOWN) {
+        return CONFIG_JSON_MORE;
+    }
+    if (s_fields[p->field].type != TYPE_BOOL || p->lit[0] == 'n') {
+        return fail(p, CONFIG_JSON_ERR_TYPE, "unexpected literal");
+    }
+    p->staged.alwaysOn = (p->lit[0] == 't') ? 1 : 0;
+    return CONFIG_JSON_MORE;
+}
+
+void config_json_init(config_json_parser_t *p, const config_t *base)
+{
+    memset(p, 0, sizeof(*p));
+    p->staged = *base;
+    p->status = CONFIG_JSON_MORE;
+    p->state = ST_BEGIN;
+}
+
+// Process one character. Returns false when the character was not consumed
+// (a number ended) and must be fed again in the new state.
+static bool step(config_json_parser_t *p, char c)
+{
+    switch (p->state) {
+    case ST_BEGIN:
+        if (is_ws(c)) return true;
+        if (c != '{') { fail(p, CONFIG_JSON_ERR_SYNTAX, "expected '{'"); return true; }
+        p->state = ST_KEY_OR_END;
+        return true;
+
+    case ST_KEY_OR_END:
+    case ST_KEY_START:
+        if (is_ws(c)) return true;
+        if (c == '}' && p->state == ST_KEY_OR_END) {
+            p->state = ST_DONE;
+            return true;
+        }
+        if (c != '"') { fail(p, CONFIG_JSON_ERR_SYNTAX, "expected key"); return true; }
+        p->key_len = 0;
+        p->key_overflow = false;
+        p->esc = 0;
+        p->state = ST_KEY;
+        return true;
+
+    case ST_KEY: {
+        int r = string_char(p, c, true);
+        if (r < 0) { fail(p, CONFIG_JSON_ERR_SYNTAX, "bad string"); return true; }
+        if (r > 0) {
+            p->field = lookup_field(p);
+            p->state = ST_COLON;
+        }
+        return true;
+    }
+
+    case ST_COLON:
+        if (is_ws(c)) return true;
+        if (c != ':') { fail(p, CONFIG_JSON_ERR_SYNTAX, "expected ':'"); return true; }
+        p->state = ST_VALUE;
+        return true;
+
+    case ST_VALUE:
+        if (is_ws(c)) return true;
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            number_begin(p);
+            if (c == '-') {
+                p->num_neg = true;
+                p->state = ST_INT_FIRST;
+            } else {
+                number_digit(p, c);
+                p->state = ST_INT;
+            }
+            return true;
+        }
+        if (c == 't' || c == 'f' || c == 'n') {
+            p->lit = (c == 't') ? "true" : (c == 'f') ? "false" : "null";
+            p->lit_pos = 1;
+            p->state = ST_LITERAL;
+            return true;
+        }
+        if (p->field != FIELD_UNKNOWN) {
+            fail(p, CONFIG_JSON_ERR_TYPE, "expected a number");
+            return true;
+        }
+        if (c == '"') {
+            p->esc = 0;
+            p->state = ST_STRING_SKIP;
+            return true;
+        }
+        if (c == '{' || c == '[') {
+            p->depth = 1;
+            p->esc = 0;
+            p->skip_in_string = false;
+            p->state = ST_NESTED_SKIP;
+            return true;
+        }
+        fail(p, CONFIG_JSON_ERR_SYNTAX, "expected a value");
+        return true;
+
+    case ST_INT_FIRST:
+        if (c < '0' || c > '9') { fail(p, CONFIG_JSON_ERR_SYNTAX, "bad number"); return true; }
+        number_digit(p, c);
+        p->state = ST_INT;
+        return true;
+
+    case ST_INT:
+    case ST_FRAC:
+        if (c >= '0' && c <= '9') {
+            number_digit(p, c);
+            return true;
+        }
+        if (c == '.' && p->state == ST_INT) {
+            p->num_frac = true;
+            p->state = ST_FRAC_FIRST;
+            return true;
+        }
+        if (c == 'e' || c == 'E') {
+            p->state = ST_EXP_SIGN;
+            return true;
+        }
+        assign_number(p);
+        p->state = ST_AFTER_VALUE;
+        return false;
+
+    case ST_FRAC_FIRST:
+        if (c < '0' || c > '9') { fail(p, CONFIG_JSON_ERR_SYNTAX, "bad number"); return true; }
+        number_digit(p, c);
+        p->state = ST_FRAC;
+        return true;
+
+    case ST_EXP_SIGN:
+        if (c == '+' || c == '-') {
+            p->num_exp_neg = (c == '-');
+            p->state = ST_EXP_FIRST;
+            return true;
+        }
+        p->state = ST_EXP_FIRST;
+        return false;
+
+    case ST_EXP_FIRST:
+    case ST_EXP:
+        if (c >= '0' && c <= '9') {
+            // Clamp; anything this large is out of range for every field
+            if (p->num_exp_val < 1000) {
+                p->num_exp_val = p->num_exp_val * 10 + (c - '0');
+            }
+            p->state = ST_EXP;
+            return true;
+        }
+        if (p->state == ST_EXP_FIRST) { fail(p, CONFIG_JSON_ERR_SYNTAX, "bad number"); return true; }
+        assign_number(p);
+        p->state = ST_AFTER_VALUE;
+        return false;
+
+    case ST_LITERAL:
+        if (c != p->lit[p->lit_pos]) { fail(p, CONFIG_JSON_ERR_SYNTAX, "bad literal"); return true; }
+        if (p->lit[++p->lit_pos] == '\0') {
+            assign_literal(p);
+            p->state = ST_AFTER_VALUE;
+        }
+        return true;
+
+    case ST_STRING_SKIP: {
+        int r = string_char(p, c, false);
+        if (r < 0) { fail(p, CONFIG_JSON_ERR_SYNTAX, "bad string"); return true; }
+        if (r > 0) p->state = ST_AFTER_VALUE;
+        return true;
+    }
+
+    case ST_NESTED_SKIP:
+        if (p->skip_in_string) {
+            int r = string_char(p, c, false);
+            if (r < 0) { fail(p, CONFIG_JSON_ERR_SYNTAX, "bad string"); return true; }
+            if (r > 0) p->skip_in_string = false;
+            return true;
+        }
+        if (c == '"') {
+            p->skip_in_string = true;
+            p->esc = 0;
+        } else if (c == '{' || c == '[') {
+            if (++p->depth > MAX_SKIP_DEPTH) {
+                fail(p, CONFIG_JSON_ERR_SYNTAX, "nesting too deep");
+            }
+        } else if (c == '}' || c == ']') {
+            if (--p->depth == 0) p->state = ST_AFTER_VALUE;
+        }
+        return true;
+
+    case ST_AFTER_VALUE:
+        if (is_ws(c)) return true;
+        if (c == ',') {
+            p->state = ST_KEY_START;
+        } else if (c == '}') {
+            p->state = ST_DONE;
+        } else {
+            fail(p, CONFIG_JSON_ERR_SYNTAX, "expected ',' or '}'");
+        }
+        return true;
+
+    case ST_DONE:
+    default:
+        if (!is_ws(c)) fail(p, CONFIG_JSON_ERR_SYNTAX, "trailing data");
+        return true;
+    }
+}
+
+config_json_status_t config_json_feed(config_json_parser_t *p, const char *buf, size_t len)
+{
+    size_t i = 0;
+    while (i < len && p->status == CONFIG_JSON_MORE) {
+        if (step(p, buf[i])) {
+            i++;
+        }
+    }
+    return p->status;
+}
+
+config_json_status_t config_json_finish(config_json_parser_t *p)
+{
+    if (p->status != CONFIG_JSON_MORE) {
+        return p->status;
+    }
+    if (p->state != ST_DONE) {
+        return fail(p, CONFIG_JSON_ERR_SYNTAX, "unexpected end of input");
+    }
+
+    const char *reason = NULL;
+    if (!config_validate(&p->staged, &reason)) {
+        return fail(p, CONFIG_JSON_ERR_INVALID, reason);
+    }
+
+    p->status = CONFIG_JSON_DONE;
+    return p->status;
+}
@@ -0,0 +1,73 @@
+#ifndef CONFIG_JSON_H
+#define CONFIG_JSON_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "gale.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Longest key we care about ("hrHysteresis", "zone1Percent"); longer keys
+// are skipped as unknown rather than truncated into a false match
+#define CONFIG_JSON_MAX_KEY 16
+
+typedef enum {
+    CONFIG_JSON_MORE = 0,       // Need more input
+    CONFIG_JSON_DONE,           // Complete object parsed and validated
+    CONFIG_JSON_ERR_SYNTAX,     // Malformed JSON
+    CONFIG_JSON_ERR_TYPE,       // Known key with a value of the wrong type
+    CONFIG_JSON_ERR_RANGE,      // Value out of range for its field
+    CONFIG_JSON_ERR_INVALID,    // Fields are individually fine but inconsistent
+} config_json_status_t;
+
+// Streaming parser state. Parses a single JSON object into a staged copy of
+// config_t, one chunk at a time, in constant memory. Unknown keys (including
+// nested objects/arrays) are skipped.
+typedef struct {
+    config_t staged;
+    config_json_status_t status;
+    const char *error;          // Human readable reason when status is an error
+
+    uint8_t state;
+    uint8_t field;              // Field the current value belongs to
+    uint8_t depth;              // Nesting depth while skipping unknown values
+    uint8_t esc;                // Escape sequence progress inside a string
+    uint8_t key_len;
+    bool key_overflow;
+    bool skip_in_string;
+    char key[CONFIG_JSON_MAX_KEY];
+
+    // Literal (true/false/null) matching
+    const char *lit;
+    uint8_t lit_pos;
+
+    // Number accumulation
+    bool num_neg;
+    bool num_frac;
+    uint8_t num_digits;
+    int16_t num_exp;            // Decimal exponent applied to num_mant
+    int16_t num_exp_val;        // Explicit exponent ("e" part)
+    bool num_exp_neg;
+    uint64_t num_mant;
+} config_json_parser_t;
+
+// Start parsing; the staged config starts as a copy of base so that omitted
+// keys keep their current values
+void config_json_init(config_json_parser_t *p, const config_t *base);
+
+// Feed the next chunk. Returns CONFIG_JSON_MORE while the input is well
+// formed so far, or an error status. Errors are sticky.
+config_json_status_t config_json_feed(config_json_parser_t *p, const char *buf, size_t len);
+
+// Signal end of input. Returns CONFIG_JSON_DONE once a complete object has
+// been parsed and the staged config passes config_validate()
+config_json_status_t config_json_finish(config_json_parser_t *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CONFIG_JSON_H
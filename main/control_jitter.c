@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "gale.h"
+#include "control_jitter.h"
+
+static const char *TAG = "JITTER";
+
+// Samples go into log-linear histograms: exact below 16 µs, then 8 buckets
+// per power of two, so a percentile is within 12.5% of the true value and a
+// window of any length costs the same 1.3 KB. Only the fan task writes them;
+// the HTTP handler asks for a reset through s_reset_pending and reads the
+// counts without locking (a read racing a sample may be one behind).
+
+#define LINEAR_BUCKETS      16
+#define SUB_BUCKETS         8                       // Per power of two
+#define NUM_BUCKETS         (LINEAR_BUCKETS + 18 * SUB_BUCKETS) // Up to ~4.2 s
+#define DEFAULT_WINDOW_S    60
+#define MAX_WINDOW_S        3600
+
+typedef struct {
+    uint32_t buckets[NUM_BUCKETS];
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t sum_us;
+} jitter_hist_t;
+
+static jitter_hist_t s_wake;            // Deviation from the nominal period
+static jitter_hist_t s_run;             // fan_control_tick() duration
+static int64_t s_prev_wake_us = 0;
+static volatile int64_t s_end_us = 0;   // Window end; 0 = not measuring
+static volatile bool s_reset_pending = false;
+static uint32_t s_window_s = 0;
+
+static uint32_t bucket_of(uint32_t v)
+{
+    if (v < LINEAR_BUCKETS) {
+        return v;
+    }
+    uint32_t exp = 31 - __builtin_clz(v);           // >= 4
+    uint32_t sub = (v >> (exp - 3)) & (SUB_BUCKETS - 1);
+    uint32_t b = LINEAR_BUCKETS + (exp - 4) * SUB_BUCKETS + sub;
+    return b < NUM_BUCKETS ? b : NUM_BUCKETS - 1;
+}
+
+// Largest value that falls in bucket b
+static uint32_t bucket_upper(uint32_t b)
+{
+    if (b < LINEAR_BUCKETS) {
+        return b;
+    }
+    uint32_t exp = 4 + (b - LINEAR_BUCKETS) / SUB_BUCKETS;
+    uint32_t sub = (b - LINEAR_BUCKETS) % SUB_BUCKETS;
+    return ((SUB_BUCKETS + sub + 1) << (exp - 3)) - 1;
+}
+
+static void hist_add(jitter_hist_t *h, uint32_t v)
+{
+    h->buckets[bucket_of(v)]++;
+    h->count++;
+    h->sum_us += v;
+    if (v > h->max_us) {
+        h->max_us = v;
+    }
+}
+
+// Upper bound of the bucket holding the p-th per-mille sample, capped at the
+// largest sample seen
+static uint32_t hist_percentile(const jitter_hist_t *h, uint32_t permille)
+{
+    if (h->count == 0) {
+        return 0;
+    }
+    uint64_t rank = ((uint64_t)h->count * permille + 999) / 1000;
+    uint32_t seen = 0;
+    for (uint32_t b = 0; b < NUM_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen >= rank) {
+            uint32_t upper = bucket_upper(b);
+            return upper < h->max_us ? upper : h->max_us;
+        }
+    }
+    return h->max_us;
+}
+
+void control_jitter_record(int64_t wake_us, uint32_t run_us)
+{
+    if (s_reset_pending) {
+        memset(&s_wake, 0, sizeof(s_wake));
+        memset(&s_run, 0, sizeof(s_run));
+        s_prev_wake_us = 0;
+        s_reset_pending = false;
+    }
+    if (s_end_us == 0) {
+        return;
+    }
+
+    if (s_prev_wake_us != 0) {
+        int64_t period_us = (int64_t)FAN_CONTROL_PERIOD_MS * 1000;
+        int64_t dev = (wake_us - s_prev_wake_us) - period_us;
+        dev = dev < 0 ? -dev : dev;
+        hist_add(&s_wake, dev > UINT32_MAX ? UINT32_MAX : (uint32_t)dev);
+    }
+    s_prev_wake_us = wake_us;
+    hist_add(&s_run, run_us);
+
+    if (wake_us >= s_end_us) {
+        s_end_us = 0;
+        ESP_LOGI(TAG, "Measurement done: %" PRIu32 " loops, wake p99 %" PRIu32 " us, max %" PRIu32 " us",
+                 s_run.count, hist_percentile(&s_wake, 990), s_wake.max_us);
+    }
+}
+
+static int format_hist(char *out, size_t size, const char *name, const jitter_hist_t *h)
+{
+    return snprintf(out, size,
+                    "\"%s\":{\"p50\":%" PRIu32 ",\"p90\":%" PRIu32 ",\"p99\":%" PRIu32
+                    ",\"p999\":%" PRIu32 ",\"max\":%" PRIu32 ",\"mean\":%" PRIu32 "}",
+                    name, hist_percentile(h, 500), hist_percentile(h, 900),
+                    hist_percentile(h, 990), hist_percentile(h, 999), h->max_us,
+                    h->count ? (uint32_t)(h->sum_us / h->count) : 0);
+}
+
+static esp_err_t send_state(httpd_req_t *req)
+{
+    static char body[384];
+    int64_t end_us = s_end_us;
+    bool running = end_us != 0 || s_reset_pending;
+    int64_t remaining_us = end_us ? end_us - esp_timer_get_time() : 0;
+
+    int n = snprintf(body, sizeof(body),
+                     "{\"running\":%s,\"window_s\":%" PRIu32 ",\"remaining_s\":%" PRIu32
+                     ",\"core\":%d,\"priority\":%d,\"period_ms\":%d,\"loops\":%" PRIu32 ",",
+                     running ? "true" : "false", s_window_s,
+                     remaining_us > 0 ? (uint32_t)(remaining_us / 1000000) : 0,
+                     GALE_CONTROL_CORE == tskNO_AFFINITY ? -1 : GALE_CONTROL_CORE,
+                     CONFIG_GALE_FAN_TASK_PRIORITY, FAN_CONTROL_PERIOD_MS, s_run.count);
+    n += format_hist(body + n, sizeof(body) - n, "wake_jitter_us", &s_wake);
+    body[n++] = ',';
+    n += format_hist(body + n, sizeof(body) - n, "tick_us", &s_run);
+    snprintf(body + n, sizeof(body) - n, "}");
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_sendstr(req, body);
+}
+
+// HTTP POST handler for /api/jitter (start a measurement window)
+static esp_err_t jitter_post_handler(httpd_req_t *req)
+{
+    char query[32] = "";
+    char value[12];
+    uint32_t seconds = DEFAULT_WINDOW_S;
+
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    if (httpd_query_key_value(query, "seconds", value, sizeof(value)) == ESP_OK) {
+        seconds = strtoul(value, NULL, 10);
+        if (seconds < 1 || seconds > MAX_WINDOW_S) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "seconds must be 1-3600");
+            return ESP_FAIL;
+        }
+    }
+
+    s_window_s = seconds;
+    s_reset_pending = true;
+    s_end_us = esp_timer_get_time() + (int64_t)seconds * 1000000;
+    ESP_LOGI(TAG, "Measuring control loop timing for %" PRIu32 " s", seconds);
+    return send_state(req);
+}
+
+// HTTP GET handler for /api/jitter
+static esp_err_t jitter_get_handler(httpd_req_t *req)
+{
+    return send_state(req);
+}
+
+static const httpd_uri_t jitter_post_uri = {
+    .uri       = "/api/jitter",
+    .method    = HTTP_POST,
+    .handler   = jitter_post_handler,
+    .user_ctx  = NULL
+};
+
+static const httpd_uri_t jitter_get_uri = {
+    .uri       = "/api/jitter",
+    .method    = HTTP_GET,
+    .handler   = jitter_get_handler,
+    .user_ctx  = NULL
+};
+
+esp_err_t control_jitter_register(httpd_handle_t server)
+{
+    esp_err_t err = httpd_register_uri_handler(server, &jitter_post_uri);
+    if (err == ESP_OK) {
+        err = httpd_register_uri_handler(server, &jitter_get_uri);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register /api/jitter: %s", esp_err_to_name(err));
+    }
+    return err;
+}
@@ -0,0 +1,34 @@
+#ifndef CONTROL_JITTER_H
+#define CONTROL_JITTER_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Fan control loop timing, measured on demand.
+//
+//   POST /api/jitter[?seconds=N]   start a measurement window (default 60 s,
+//                                  at most 3600); clears the previous one
+//   GET  /api/jitter               percentiles of the current or last window
+//
+// Two distributions are kept: how far each loop wake-up is from the nominal
+// FAN_CONTROL_PERIOD_MS after the previous one (scheduling jitter), and how
+// long one fan_control_tick() takes. Start a window, load the device (an OTA
+// upload, a burst of HTTP requests, a Matter storm), then read the result.
+
+// Called by the fan control task once per loop: when it woke and how long
+// the tick ran. Does nothing outside a measurement window.
+void control_jitter_record(int64_t wake_us, uint32_t run_us);
+
+// Register the /api/jitter endpoints on the server
+esp_err_t control_jitter_register(httpd_handle_t server);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CONTROL_JITTER_H
@@ -5,32 +5,69 @@
 #include "esp_log.h"
 #include "gale.h"
 #include "matter_device.h"
+#include "telemetry.h"
+#include "metrics.h"
+#include "session_log.h"
+#include "tracepoint.h"
+#include "binlog.h"
+#include "control_jitter.h"
+#include "esp_timer.h"
 
 static const char *TAG = "FAN_CONTROL";
 
-void fan_control_init(void)
+// Fan speed state
+uint8_t g_current_speed = 1;  // Will be set from config.alwaysOn in setup
+uint8_t g_prev_speed = 0;
+uint32_t g_speed_changed_time = 0;
+
+// Matter override mode (true = Matter controls fan, false = HRM auto mode)
+bool g_matter_override = false;
+
+esp_err_t fan_control_init(void)
 {
+    esp_err_t err = ESP_OK;
+
     ESP_LOGI(TAG, "Initializing fan control");
 
     // Configure relay GPIO pins as outputs
-    for (int i = 0; i < NUM_RELAYS; i++) {
-        gpio_reset_pin(g_config.relayGPIO[i]);
-        gpio_set_direction(g_config.relayGPIO[i], GPIO_MODE_OUTPUT);
-        gpio_set_level(g_config.relayGPIO[i], RELAY_OFF);
+    for (int i = 0; i < NUM_RELAYS && err == ESP_OK; i++) {
+        err = gpio_reset_pin(g_config.relayGPIO[i]);
+        if (err == ESP_OK) {
+            err = gpio_set_direction(g_config.relayGPIO[i], GPIO_MODE_OUTPUT);
+        }
+        if (err == ESP_OK) {
+            err = gpio_set_level(g_config.relayGPIO[i], RELAY_OFF);
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Relay %d (GPIO %d) init failed: %s",
+                     i + 1, g_config.relayGPIO[i], esp_err_to_name(err));
+        }
     }
 
-    ESP_LOGI(TAG, "Fan control initialized");
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Fan control initialized");
+    }
+    return err;
 }
 
 // Internal function to apply speed to relays
 static void apply_speed(uint8_t fanSpeed)
 {
+    TRACEPOINT_BEGIN(tp_start);
+
     for (int i = 0; i < NUM_RELAYS; i++) {
         gpio_set_level(g_config.relayGPIO[i],
                       (i == fanSpeed - 1) ? RELAY_ON : RELAY_OFF);
+        if ((i == fanSpeed - 1) != (i == g_prev_speed - 1)) {
+            metrics_inc(METRIC_RELAY1_SWITCHES + i);
+            TRACEPOINT(i == fanSpeed - 1 ? TP_RELAY_ON : TP_RELAY_OFF, i + 1);
+        }
     }
+    metrics_relay_applied();
     g_prev_speed = fanSpeed;
-    ESP_LOGI(TAG, "Fan speed set to %d", fanSpeed);
+    BINLOGI(TAG, "Fan speed set to %" PRIu32, (uint32_t)fanSpeed);
+    telemetry_publish(TELEMETRY_SPEED, fanSpeed);
+    session_log_speed(fanSpeed, g_matter_override);
 
     // Update Matter state
     matter_device_update_fan_state(fanSpeed);
@@ -39,6 +76,29 @@ static void apply_speed(uint8_t fanSpeed)
     if (g_ble_connected) {
         led_control_set_mode(fanSpeed);
     }
+
+    TRACEPOINT_END(tp_start, TP_APPLY_SPEED, fanSpeed);
+}
+
+// Convert Gale speed (0-3) to Matter percent (0-100)
+uint8_t fan_speed_to_percent(uint8_t speed)
+{
+    switch (speed) {
+        case 0: return 0;
+        case 1: return 33;
+        case 2: return 66;
+        case 3: return 100;
+        default: return 0;
+    }
+}
+
+// Convert Matter percent (0-100) to Gale speed (0-3)
+uint8_t fan_percent_to_speed(uint8_t percent)
+{
+    if (percent == 0) return 0;
+    if (percent <= 33) return 1;
+    if (percent <= 66) return 2;
+    return 3;
 }
 
 void fan_control_set_speed(uint8_t fanSpeed)
@@ -66,24 +126,32 @@ void fan_control_set_speed_immediate(uint8_t fanSpeed)
     apply_speed(fanSpeed);
 }
 
+void fan_control_tick(void)
+{
+    // The fan is on, but we're no longer connected to HRM
+    // Only auto-turn-off if Matter is not overriding
+    if (!g_ble_connected && g_current_speed > 0 && !g_matter_override) {
+        uint32_t currentTime = xTaskGetTickCount() * portTICK_PERIOD_MS;
+        if ((currentTime - g_disconnected_time) > g_config.fanDelay) {
+            // It's been long enough, giving up on HRM reconnecting and turning off the fan
+            ESP_LOGI(TAG, "HRM disconnected timeout, setting speed to %d", g_config.alwaysOn);
+            g_current_speed = g_config.alwaysOn;
+        }
+    }
+
+    fan_control_set_speed(g_current_speed);
+}
+
 void fan_control_task(void *pvParameters)
 {
     ESP_LOGI(TAG, "Fan control task started");
 
+    // Fixed-rate loop: a late tick doesn't push the following ones back
+    TickType_t last_wake = xTaskGetTickCount();
     while (1) {
-        // The fan is on, but we're no longer connected to HRM
-        // Only auto-turn-off if Matter is not overriding
-        if (!g_ble_connected && g_current_speed > 0 && !g_matter_override) {
-            uint32_t currentTime = xTaskGetTickCount() * portTICK_PERIOD_MS;
-            if ((currentTime - g_disconnected_time) > g_config.fanDelay) {
-                // It's been long enough, giving up on HRM reconnecting and turning off the fan
-                ESP_LOGI(TAG, "HRM disconnected timeout, setting speed to %d", g_config.alwaysOn);
-                g_current_speed = g_config.alwaysOn;
-            }
-        }
-
-        fan_control_set_speed(g_current_speed);
-
-        vTaskDelay(pdMS_TO_TICKS(100)); // Check every 100ms
+        int64_t wake_us = esp_timer_get_time();
+        fan_control_tick();
+        control_jitter_record(wake_us, (uint32_t)(esp_timer_get_time() - wake_us));
+        xTaskDelayUntil(&last_wake, pdMS_TO_TICKS(FAN_CONTROL_PERIOD_MS));
     }
 }
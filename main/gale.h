@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "esp_err.h"
 
 // Relay configuration
 #define RELAY_NO
@@ -17,7 +18,8 @@
 #endif
 
 // Configuration structure
-// These settings can be modified via NVS or later through Matter
+// Stored in NVS; editable from the web UI (/api/config) and over Matter
+// (config cluster 0xFFF1FC02, see matter_device.cpp)
 typedef struct {
     // Heart rate settings
     uint8_t hrMax;
@@ -38,6 +40,28 @@ typedef struct {
     uint8_t ledGPIO;              // LED indicator for BLE connection
 } config_t;
 
+// Fan control loop period
+#define FAN_CONTROL_PERIOD_MS   100
+
+// Core for the control pipeline (fan loop and LED). By default the
+// APP core, leaving the PRO core to WiFi, NimBLE and lwIP, which
+// sdkconfig.defaults pins there; see "Task placement" in README_IDF.md.
+#if CONFIG_GALE_CONTROL_CORE_APP
+#define GALE_CONTROL_CORE       1
+#elif CONFIG_GALE_CONTROL_CORE_PRO
+#define GALE_CONTROL_CORE       0
+#else
+#define GALE_CONTROL_CORE       tskNO_AFFINITY
+#endif
+
+// Configuration limits (shared by the web UI, config API and validation)
+#define HR_MAX_MIN          100
+#define HR_MAX_MAX          250
+#define HR_RESTING_MIN      30
+#define HR_RESTING_MAX      100
+#define FAN_DELAY_MAX       600000  // 10 minutes
+#define HR_HYSTERESIS_MAX   30
+
 // Global configuration
 extern config_t g_config;
 
@@ -56,24 +80,57 @@ extern bool g_matter_override;
 extern bool g_ble_connected;
 extern uint32_t g_disconnected_time;
 
+// Latest heart rate handled by hr_control (0 = none yet)
+extern uint8_t g_heart_rate;
+
 // Function declarations
 void nvs_config_init(void);
 void nvs_config_load(void);
-void nvs_config_save(void);
+esp_err_t nvs_config_save(void);
 void calculate_zones(void);
+bool config_validate(const config_t *config, const char **reason);
+
+// HR control (hr_control.c): HRM measurements and connection changes in,
+// target speed out
+#define HRM_MAX_RR  9     // Most RR intervals that fit in a default-MTU notification
+
+typedef struct {
+    uint8_t hr;
+    uint8_t num_rr;
+    uint16_t rr[HRM_MAX_RR];    // RR intervals in 1/1024 s
+} hrm_measurement_t;
+
+bool hrm_parse_measurement(const uint8_t *data, uint16_t len, hrm_measurement_t *m);
+void hr_control_measurement(const uint8_t *data, uint16_t len);  // Raw 0x2A37 value
+void calculate_fan_speed(uint8_t heart_rate);
+void hr_control_connected(void);
+void hr_control_disconnected(void);
+// Synthetic input (hr_synth.c): keep it out of the session log and the
+// notification timing and reconnect metrics
+void hr_control_set_synthetic(bool synthetic);
+// Feed 'count' synthetic samples of 'heart_rate', 'interval_ms' apart, as a
+// source that connects for the run (console "hr"). Blocks the caller.
+esp_err_t hr_control_inject(uint8_t heart_rate, uint32_t count, uint32_t interval_ms);
 
 void ble_hrm_init(void);
-void ble_hrm_start_scan(void);
+bool ble_hrm_start_scan(void);  // true once scanning (or connected)
 
-void fan_control_init(void);
+esp_err_t fan_control_init(void);
 void fan_control_set_speed(uint8_t speed);
+uint8_t fan_speed_to_percent(uint8_t speed);     // Matter FanControl mapping
+uint8_t fan_percent_to_speed(uint8_t percent);
 void fan_control_set_speed_immediate(uint8_t speed);
+void fan_control_tick(void);  // One pass of fan_control_task
 void fan_control_task(void *pvParameters);
 
 void led_control_init(void);
 void led_control_off(void);
 void led_control_on(void);
 void led_control_set_mode(uint8_t mode);  // 0=off, 1/2/3=pulse speeds
+uint8_t led_control_get_mode(void);
 void led_control_task(void *pvParameters);
 
+void web_server_init(void);
+void web_server_start(void);
+
 #endif // GALE_H
@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "gale.h"
+#include "metrics.h"
+#include "tracepoint.h"
+#include "hr_synth.h"
+#include "mem_budget.h"
+#include "perf_bench.h"
+#include "gale_shell.h"
+
+static const char *TAG = "SHELL";
+
+// Console output goes straight to stdout (the UART the shell reads from);
+// actions that change state are also logged so they show up next to the
+// firmware's own messages.
+
+// "hr" blocks the console while it runs, so it is kept short; longer runs
+// belong to "synth", which has its own task and can be stopped
+#define INJECT_MAX_COUNT        600
+#define INJECT_MAX_INTERVAL_MS  10000
+#define INJECT_MAX_TOTAL_MS     60000
+
+typedef struct {
+    const char *name;
+    const char *usage;
+    esp_err_t (*handler)(int argc, char **argv);
+} shell_cmd_t;
+
+static bool parse_uint(const char *s, uint32_t min, uint32_t max, uint32_t *out)
+{
+    char *end;
+    unsigned long v = strtoul(s, &end, 10);
+    if (end == s || *end != '\0' || v < min || v > max) {
+        return false;
+    }
+    *out = v;
+    return true;
+}
+
+static esp_err_t cmd_stats(int argc, char **argv)
+{
+    printf("hr %u BPM, speed %u (target %u, %s), hrm %s\n", g_heart_rate, g_prev_speed,
+           g_current_speed, g_matter_override ? "override" : "auto",
+           g_ble_connected ? "connected" : "disconnected");
+    printf("zones %.1f / %.1f / %.1f BPM, hysteresis %u BPM, fan delay %" PRIu32 " ms, always on %u\n",
+           g_zone1, g_zone2, g_zone3, g_config.hrHysteresis, g_config.fanDelay, g_config.alwaysOn);
+    printf("notifications: %" PRIu32 " received, %" PRIu32 " dropped, %" PRIu32 " lost in gaps\n",
+           metrics_total(METRIC_NOTIFY_RX), metrics_total(METRIC_NOTIFY_DROPPED),
+           metrics_total(METRIC_NOTIFY_LOST));
+    metrics_print_hist(HIST_NOTIFY_TO_RELAY);
+    fflush(stdout);
+
+    // Heap state and every task's stack high-water mark
+    mem_budget_report();
+    return ESP_OK;
+}
+
+static esp_err_t cmd_hr(int argc, char **argv)
+{
+    uint32_t hr, count = 1, interval_ms = 1000;
+
+    if (argc < 2 || !parse_uint(argv[1], 1, UINT8_MAX, &hr) ||
+        (argc > 2 && !parse_uint(argv[2], 1, INJECT_MAX_COUNT, &count)) ||
+        (argc > 3 && !parse_uint(argv[3], 1, INJECT_MAX_INTERVAL_MS, &interval_ms))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if ((count - 1) * interval_ms > INJECT_MAX_TOTAL_MS) {
+        printf("at most %u s of samples; use synth for longer runs\n", INJECT_MAX_TOTAL_MS / 1000);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Kept out of the session log and notification metrics like a synth run
+    if (hr_control_inject(hr, count, interval_ms) != ESP_OK) {
+        printf("an HRM, trace replay or synth run is active\n");
+        return ESP_ERR_INVALID_STATE;
+    }
+    printf("target speed %u\n", g_current_speed);
+    return ESP_OK;
+}
+
+static esp_err_t cmd_speed(int argc, char **argv)
+{
+    uint32_t speed;
+
+    if (argc == 2 && strcmp(argv[1], "auto") == 0) {
+        g_matter_override = false;
+        ESP_LOGI(TAG, "Returning to HRM auto mode");
+        return ESP_OK;
+    }
+    if (argc != 2 || !parse_uint(argv[1], 0, 3, &speed)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Same as a Matter speed write, except that 0 holds the fan off
+    ESP_LOGI(TAG, "Forcing speed %" PRIu32, speed);
+    g_matter_override = true;
+    g_current_speed = speed;
+    fan_control_set_speed_immediate(speed);
+    return ESP_OK;
+}
+
+static esp_err_t cmd_synth(int argc, char **argv)
+{
+    static char state[512];     // Only the console task runs commands
+
+    if (argc >= 2 && strcmp(argv[1], "stop") == 0) {
+        hr_synth_stop();
+    } else if (argc >= 3 && strcmp(argv[1], "start") == 0) {
+        hr_synth_params_t params = { 0 };
+        uint32_t rate = 1, seconds = 0;
+        if (!hr_profile_from_name(argv[2], &params.profile) ||
+            (argc > 3 && !parse_uint(argv[3], 1, 100, &rate)) ||
+            (argc > 4 && !parse_uint(argv[4], 0, UINT32_MAX, &seconds))) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        params.rate_hz = rate;
+        params.seconds = seconds;
+        esp_err_t err = hr_synth_start(&params);
+        if (err != ESP_OK) {
+            printf("cannot start: %s\n", err == ESP_ERR_INVALID_STATE ?
+                   "already running, or an HRM or trace replay is active" : esp_err_to_name(err));
+            return err;
+        }
+    } else if (argc != 1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    hr_synth_format_state(state, sizeof(state));
+    printf("%s\n", state);
+    return ESP_OK;
+}
+
+static esp_err_t cmd_bench(int argc, char **argv)
+{
+    perf_bench_run(argc > 1 ? argv[1] : NULL);
+    return ESP_OK;
+}
+
+#ifdef CONFIG_GALE_TRACE
+static void trace_emit(const char *data, size_t len, void *ctx)
+{
+    fwrite(data, 1, len, stdout);
+}
+#endif
+
+static esp_err_t cmd_trace(int argc, char **argv)
+{
+#ifdef CONFIG_GALE_TRACE
+    if (argc != 2) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (strcmp(argv[1], "start") == 0) {
+        esp_err_t err = tracepoint_start();
+        printf("%s\n", err == ESP_OK ? "recording" : "out of memory");
+        return err;
+    } else if (strcmp(argv[1], "stop") == 0) {
+        tracepoint_stop();
+        printf("stopped\n");
+        return ESP_OK;
+    } else if (strcmp(argv[1], "dump") == 0) {
+        tracepoint_export(trace_emit, NULL);
+        fflush(stdout);
+        return ESP_OK;
+    }
+    return ESP_ERR_INVALID_ARG;
+#else
+    printf("tracepoints are compiled out (CONFIG_GALE_TRACE)\n");
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+static esp_err_t cmd_memory(int argc, char **argv)
+{
+    mem_budget_report();
+    return ESP_OK;
+}
+
+static esp_err_t cmd_help(int argc, char **argv);
+
+static const shell_cmd_t s_commands[] = {
+    { "stats",  "stats",                                        cmd_stats },
+    { "hr",     "hr <bpm> [count] [interval_ms]",               cmd_hr },
+    { "speed",  "speed <0-3|auto>",                             cmd_speed },
+    { "synth",  "synth [start <profile> [hz] [seconds] | stop]", cmd_synth },
+    { "bench",  "bench [filter]",                               cmd_bench },
+    { "trace",  "trace <start|stop|dump>",                      cmd_trace },
+    { "memory", "memory",                                       cmd_memory },
+    { "help",   "help",                                         cmd_help },
+};
+#define NUM_COMMANDS (sizeof(s_commands) / sizeof(s_commands[0]))
+
+static esp_err_t cmd_help(int argc, char **argv)
+{
+    printf("usage: matter esp gale <command>\n");
+    for (size_t i = 0; i < NUM_COMMANDS; i++) {
+        printf("  %s\n", s_commands[i].usage);
+    }
+    printf("synth profiles:");
+    for (int k = 0; k < HR_PROFILE_COUNT; k++) {
+        printf(" %s", hr_profile_name(k));
+    }
+    printf("\n");
+    return ESP_OK;
+}
+
+esp_err_t gale_shell_command(int argc, char **argv)
+{
+    if (argc < 1) {
+        return cmd_help(0, NULL);
+    }
+    for (size_t i = 0; i < NUM_COMMANDS; i++) {
+        const shell_cmd_t *cmd = &s_commands[i];
+        if (strcmp(argv[0], cmd->name) == 0) {
+            esp_err_t err = cmd->handler(argc, argv);
+            if (err == ESP_ERR_INVALID_ARG) {
+                printf("usage: matter esp gale %s\n", cmd->usage);
+            }
+            return err;
+        }
+    }
+    printf("unknown command '%s'\n", argv[0]);
+    cmd_help(0, NULL);
+    return ESP_ERR_INVALID_ARG;
+}
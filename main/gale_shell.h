@@ -0,0 +1,38 @@
+#ifndef GALE_SHELL_H
+#define GALE_SHELL_H
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Gale commands on the serial console (the CHIP shell, enabled by
+// CONFIG_ENABLE_CHIP_SHELL), reached as "matter esp gale <command>":
+//
+//   stats                           HR, speed, zones, notification counts,
+//                                   notify-to-relay histogram, heap and
+//                                   stack marks
+//   hr <bpm> [count] [interval_ms]  inject HR samples as notifications
+//                                   (up to 60 s; not while an HR source
+//                                   is active)
+//   speed <0-3|auto>                force a speed (held like a Matter
+//                                   override) or return to HR control
+//   synth [start <profile> [hz] [seconds] | stop]
+//                                   synthetic HR source (hr_synth.h)
+//   bench [filter]                  on-device microbenchmarks
+//   trace <start|stop|dump>         tracepoint recording; dump prints
+//                                   Chrome trace JSON
+//   memory                          RAM budget table
+//
+// Everything talks to the modules directly, so it works without WiFi and
+// in a release build.
+
+// Handler for the "gale" console command; argv[0] is the subcommand
+esp_err_t gale_shell_command(int argc, char **argv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GALE_SHELL_H
@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "history.h"
+#include "session_log.h"
+
+static const char *TAG = "HISTORY";
+
+// History queries stream straight from the memory-mapped log partition: the
+// reader seeks with the per-sector time index, records are folded into
+// buckets on the fly and finished buckets are formatted into a small buffer
+// that goes out as HTTP chunks. Nothing proportional to the session length
+// is held in RAM.
+
+#define DEFAULT_RANGE_MS    (2 * 60 * 60 * 1000)    // Last two hours
+#define DEFAULT_POINTS      300
+#define MAX_POINTS          1000
+#define CHUNK_SIZE          512
+#define MAX_ROW_SIZE        64
+
+typedef struct {
+    httpd_req_t *req;
+    bool csv;
+    bool first_row;
+    size_t len;
+    char buf[CHUNK_SIZE];
+} out_t;
+
+typedef struct {
+    uint64_t start_ms;
+    uint8_t min;
+    uint8_t max;
+    uint8_t speed;          // Highest fan speed seen in the bucket
+    uint32_t sum;
+    uint32_t count;
+} bucket_t;
+
+static esp_err_t out_flush(out_t *out)
+{
+    esp_err_t err = ESP_OK;
+    if (out->len > 0) {
+        err = httpd_resp_send_chunk(out->req, out->buf, out->len);
+        out->len = 0;
+    }
+    return err;
+}
+
+static esp_err_t out_row(out_t *out, const bucket_t *b)
+{
+    if (out->len + MAX_ROW_SIZE > sizeof(out->buf)) {
+        esp_err_t err = out_flush(out);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    unsigned avg = (b->sum + b->count / 2) / b->count;
+    char *p = out->buf + out->len;
+    size_t size = sizeof(out->buf) - out->len;
+    if (out->csv) {
+        out->len += snprintf(p, size, "%" PRIu64 ",%u,%u,%u,%u\n",
+                             b->start_ms, b->min, b->max, avg, b->speed);
+    } else {
+        out->len += snprintf(p, size, "%s[%" PRIu64 ",%u,%u,%u,%u]",
+                             out->first_row ? "" : ",", b->start_ms, b->min, b->max, avg, b->speed);
+    }
+    out->first_row = false;
+    return ESP_OK;
+}
+
+static bool query_u64(const char *query, const char *key, uint64_t *value)
+{
+    char str[24];
+    char *end;
+
+    if (httpd_query_key_value(query, key, str, sizeof(str)) != ESP_OK) {
+        return false;
+    }
+    uint64_t v = strtoull(str, &end, 10);
+    if (end == str || *end != '\0') {
+        return false;
+    }
+    *value = v;
+    return true;
+}
+
+// HTTP GET handler for /api/history
+static esp_err_t history_get_handler(httpd_req_t *req)
+{
+    uint64_t now = session_log_now_ms();
+    uint64_t to = now;
+    uint64_t from;
+    uint64_t points = DEFAULT_POINTS;
+    bool csv = false;
+
+    char query[128] = "";
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    query_u64(query, "to", &to);
+    if (!query_u64(query, "from", &from)) {
+        from = (to > DEFAULT_RANGE_MS) ? to - DEFAULT_RANGE_MS : 0;
+    }
+    query_u64(query, "points", &points);
+
+    char format[8];
+    if (httpd_query_key_value(query, "format", format, sizeof(format)) == ESP_OK) {
+        csv = (strcmp(format, "csv") == 0);
+    }
+
+    if (from >= to || points == 0 || points > MAX_POINTS) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Need from < to and 0 < points <= 1000");
+        return ESP_OK;
+    }
+
+    session_log_reader_t reader;
+    esp_err_t err = session_log_reader_open(&reader, from);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Cannot open session log: %s", esp_err_to_name(err));
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Session log unavailable");
+        return ESP_OK;
+    }
+
+    uint64_t bucket_ms = (to - from + points - 1) / points;
+
+    static out_t out;
+    out.req = req;
+    out.csv = csv;
+    out.first_row = true;
+    out.len = 0;
+
+    if (csv) {
+        httpd_resp_set_type(req, "text/csv");
+        out.len = snprintf(out.buf, sizeof(out.buf), "t_ms,hr_min,hr_max,hr_avg,speed\n");
+    } else {
+        httpd_resp_set_type(req, "application/json");
+        out.len = snprintf(out.buf, sizeof(out.buf),
+                           "{\"now\":%" PRIu64 ",\"from\":%" PRIu64 ",\"to\":%" PRIu64
+                           ",\"bucket_ms\":%" PRIu64 ",\"columns\":[\"t_ms\",\"hr_min\",\"hr_max\","
+                           "\"hr_avg\",\"speed\"],\"points\":[",
+                           now, from, to, bucket_ms);
+    }
+
+    bucket_t b = { 0 };
+    uint64_t b_index = UINT64_MAX;
+    uint8_t speed = 0;
+    session_log_record_t rec;
+
+    while (err == ESP_OK && session_log_reader_next(&reader, &rec)) {
+        if (rec.type == SESSION_LOG_SPEED) {
+            speed = rec.value;
+            if (b.count > 0 && speed > b.speed) {
+                b.speed = speed;
+            }
+            continue;
+        }
+        if (rec.type != SESSION_LOG_HR || rec.t_ms < from) {
+            continue;
+        }
+        if (rec.t_ms > to) {
+            break;
+        }
+
+        uint64_t index = (rec.t_ms - from) / bucket_ms;
+        if (index != b_index) {
+            if (b.count > 0) {
+                err = out_row(&out, &b);
+            }
+            b_index = index;
+            b.start_ms = from + index * bucket_ms;
+            b.min = b.max = rec.value;
+            b.speed = speed;
+            b.sum = 0;
+            b.count = 0;
+        }
+        if (rec.value < b.min) b.min = rec.value;
+        if (rec.value > b.max) b.max = rec.value;
+        b.sum += rec.value;
+        b.count++;
+    }
+    session_log_reader_close(&reader);
+
+    if (err == ESP_OK && b.count > 0) {
+        err = out_row(&out, &b);
+    }
+    if (err == ESP_OK && !csv) {
+        if (out.len + 2 > sizeof(out.buf)) {
+            err = out_flush(&out);
+        }
+        memcpy(out.buf + out.len, "]}", 2);
+        out.len += 2;
+    }
+    if (err == ESP_OK) {
+        err = out_flush(&out);
+    }
+    if (err != ESP_OK) {
+        // Client went away mid-response; nothing more can be sent
+        ESP_LOGW(TAG, "History response aborted: %s", esp_err_to_name(err));
+        return ESP_FAIL;
+    }
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+
+static const httpd_uri_t history_uri = {
+    .uri       = "/api/history",
+    .method    = HTTP_GET,
+    .handler   = history_get_handler,
+    .user_ctx  = NULL
+};
+
+esp_err_t history_register(httpd_handle_t server)
+{
+    esp_err_t err = httpd_register_uri_handler(server, &history_uri);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register /api/history: %s", esp_err_to_name(err));
+    }
+    return err;
+}
@@ -0,0 +1,25 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Register GET /api/history on the server. Serves the session log as
+// downsampled HR buckets:
+//
+//   /api/history?from=<ms>&to=<ms>&points=<n>&format=json|csv
+//
+// Times are on the session log clock (see session_log.h); the JSON response
+// includes "now" so clients can ask for e.g. the last two hours. Each bucket
+// reports its start time, HR min/max/average and the highest fan speed.
+esp_err_t history_register(httpd_handle_t server);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HISTORY_H
@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "gale.h"
+#include "telemetry.h"
+#include "metrics.h"
+#include "session_log.h"
+#include "matter_device.h"
+#include "wifi_manager.h"
+#include "esp_timer.h"
+#include "tracepoint.h"
+#include "binlog.h"
+
+static const char *TAG = "HR_CONTROL";
+
+// Heart rate to fan speed decisions. The BLE client (or a trace replay,
+// see hr_recorder.c) feeds raw measurements and connection changes in here;
+// the relays follow in fan_control_tick(). This file has no hardware
+// dependencies so the host simulator (host/) builds it unchanged.
+
+// Heart Rate Measurement flags
+#define HRM_FLAG_HR_16BIT       0x01
+#define HRM_FLAG_ENERGY         0x08
+#define HRM_FLAG_RR             0x10
+#define HRM_NOMINAL_INTERVAL_US 1000000 // HRMs notify about once a second
+
+// BLE connection state
+bool g_ble_connected = false;
+uint32_t g_disconnected_time = 0;
+uint8_t g_heart_rate = 0;
+
+static bool hrm_was_connected = false;
+static volatile bool s_synthetic = false;
+static int64_t last_notify_us = 0;
+static uint32_t notify_interval_avg_us = HRM_NOMINAL_INTERVAL_US;
+
+// Parse a Heart Rate Measurement value: flags, 8 or 16-bit heart rate,
+// optional energy expended, optional RR intervals
+bool hrm_parse_measurement(const uint8_t *data, uint16_t len, hrm_measurement_t *m)
+{
+    if (len < 2) {
+        return false;
+    }
+
+    uint8_t flags = data[0];
+    uint16_t pos;
+    uint16_t hr;
+
+    if (flags & HRM_FLAG_HR_16BIT) {
+        if (len < 3) {
+            return false;
+        }
+        hr = data[1] | (data[2] << 8);
+        pos = 3;
+    } else {
+        hr = data[1];
+        pos = 2;
+    }
+    m->hr = (hr > UINT8_MAX) ? UINT8_MAX : hr;
+
+    if (flags & HRM_FLAG_ENERGY) {
+        pos += 2;
+    }
+
+    m->num_rr = 0;
+    if (flags & HRM_FLAG_RR) {
+        for (; pos + 1 < len && m->num_rr < HRM_MAX_RR; pos += 2) {
+            m->rr[m->num_rr++] = data[pos] | (data[pos + 1] << 8);
+        }
+    }
+    return true;
+}
+
+// Notification timing. Jitter is each inter-arrival time's deviation from the
+// running average interval; a gap of more than 1.5 intervals counts the
+// notifications that should have arrived in it as lost.
+static void hrm_track_arrival(void)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t last = last_notify_us;
+    last_notify_us = now;
+    if (last == 0) {
+        return;
+    }
+
+    uint32_t avg = notify_interval_avg_us;
+    uint32_t interval = (now - last > UINT32_MAX) ? UINT32_MAX : (uint32_t)(now - last);
+    if (interval > avg + avg / 2) {
+        metrics_add(METRIC_NOTIFY_LOST, (interval + avg / 2) / avg - 1);
+        return;
+    }
+
+    metrics_observe(HIST_NOTIFY_JITTER, interval > avg ? interval - avg : avg - interval);
+    notify_interval_avg_us = avg + ((int32_t)interval - (int32_t)avg) / 8;
+}
+
+// Handle one HRM notification payload
+void hr_control_measurement(const uint8_t *data, uint16_t len)
+{
+    hrm_measurement_t m;
+    TRACEPOINT_BEGIN(tp_start);
+
+    if (!s_synthetic) {
+        hrm_track_arrival();
+    }
+
+    if (!hrm_parse_measurement(data, len, &m)) {
+        metrics_inc(METRIC_NOTIFY_DROPPED);
+        return;
+    }
+
+    calculate_fan_speed(m.hr);
+
+    // Logged after the HR sample they belong to
+    for (int i = 0; i < m.num_rr && !s_synthetic; i++) {
+        session_log_rr(m.rr[i]);
+    }
+
+    TRACEPOINT_END(tp_start, TP_HR_MEASUREMENT, m.hr);
+}
+
+// Calculate fan speed from heart rate data
+void calculate_fan_speed(uint8_t heart_rate)
+{
+    if (heart_rate == 0) {
+        metrics_inc(METRIC_NOTIFY_DROPPED);
+        return;
+    }
+    g_heart_rate = heart_rate;
+
+    telemetry_publish(TELEMETRY_HR, heart_rate);
+    matter_device_update_hr(heart_rate);
+    if (!s_synthetic) {
+        session_log_hr(heart_rate);
+    }
+
+    // Skip if Matter is overriding HRM control
+    if (g_matter_override) {
+        BINLOGD(TAG, "Heart Rate: %" PRIu32 " BPM (Matter override active, ignoring)", (uint32_t)heart_rate);
+        return;
+    }
+
+    uint8_t current_speed = g_current_speed;
+
+    // ZONE 0 -> FAN OFF (or minimum speed if alwaysOn)
+    if (current_speed > 0 && heart_rate < g_zone1) {
+        g_current_speed = g_config.alwaysOn;
+        g_speed_changed_time = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    }
+    // ZONE 1
+    else if ((current_speed < 1 && heart_rate >= g_zone1 && heart_rate < g_zone2) ||
+             (current_speed > 1 && heart_rate < g_zone2 - g_config.hrHysteresis)) {
+        g_current_speed = 1;
+        g_speed_changed_time = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    }
+    // ZONE 2
+    else if ((current_speed < 2 && heart_rate >= g_zone2 && heart_rate < g_zone3) ||
+             (current_speed > 2 && heart_rate < g_zone3 - g_config.hrHysteresis)) {
+        g_current_speed = 2;
+        g_speed_changed_time = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    }
+    // ZONE 3
+    else if (current_speed < 3 && heart_rate >= g_zone3) {
+        g_current_speed = 3;
+        g_speed_changed_time = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    }
+
+    if (g_current_speed != current_speed) {
+        TRACEPOINT(TP_DECISION, g_current_speed);
+    }
+    if (g_current_speed > current_speed) {
+        // Speed ups are applied right away; measure how long that takes
+        metrics_decision_stamp();
+    }
+
+    BINLOGI(TAG, "Heart Rate: %" PRIu32 " BPM, Current Speed: %" PRIu32,
+            (uint32_t)heart_rate, (uint32_t)g_current_speed);
+}
+
+void hr_control_connected(void)
+{
+    g_ble_connected = true;
+    telemetry_publish(TELEMETRY_HRM, 1);
+    if (!s_synthetic) {
+        if (hrm_was_connected) {
+            metrics_inc(METRIC_HRM_RECONNECTS);
+        }
+        hrm_was_connected = true;
+        session_log_event(SESSION_LOG_EV_HRM_CONNECTED);
+    }
+    wifi_manager_set_workout_mode(true);
+    matter_device_set_workout_active(true);
+    last_notify_us = 0;
+    notify_interval_avg_us = HRM_NOMINAL_INTERVAL_US;
+
+    // Turn on fan to low speed when HRM connects (unless Matter is overriding)
+    if (g_current_speed == 0 && !g_matter_override) {
+        g_current_speed = 1;
+        g_speed_changed_time = xTaskGetTickCount() * portTICK_PERIOD_MS;
+        ESP_LOGI(TAG, "HRM connected - fan set to low speed");
+    }
+
+    // Start LED pulsing at current speed
+    led_control_set_mode(g_current_speed);
+}
+
+void hr_control_disconnected(void)
+{
+    g_ble_connected = false;
+    g_disconnected_time = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    telemetry_publish(TELEMETRY_HRM, 0);
+    if (!s_synthetic) {
+        session_log_event(SESSION_LOG_EV_HRM_DISCONNECTED);
+    }
+    wifi_manager_set_workout_mode(false);
+    matter_device_set_workout_active(false);
+
+    led_control_off();  // Turn off LED immediately
+    // Fan will turn off after fanDelay timeout in fan_control_tick
+}
+
+void hr_control_set_synthetic(bool synthetic)
+{
+    s_synthetic = synthetic;
+}
+
+esp_err_t hr_control_inject(uint8_t heart_rate, uint32_t count, uint32_t interval_ms)
+{
+    // Samples would interleave with the strap's, replay's or synth run's
+    if (g_ble_connected) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ESP_LOGI(TAG, "Injecting %" PRIu32 " x %" PRIu32 " BPM", count, (uint32_t)heart_rate);
+
+    // Connected for the run like a synth run, so the fan task doesn't time
+    // the fan out and a synth run or replay can't start under it. A strap
+    // connecting clears s_synthetic (hr_synth_hrm_connected()) and takes over.
+    uint8_t payload[2] = { 0, heart_rate };
+    hr_control_set_synthetic(true);
+    hr_control_connected();
+    for (uint32_t i = 0; i < count && s_synthetic; i++) {
+        if (i > 0) {
+            vTaskDelay(pdMS_TO_TICKS(interval_ms));
+        }
+        TRACEPOINT(TP_NOTIFY_RX, sizeof(payload));
+        hr_control_measurement(payload, sizeof(payload));
+    }
+    if (s_synthetic) {
+        hr_control_disconnected();
+        hr_control_set_synthetic(false);
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,136 @@
+#include <string.h>
+#include "hr_profile.h"
+
+// Synthetic heart rate profiles (see hr_profile.h). Pure code: used by the
+// synthetic HR source on the device and by the host simulator.
+
+#define LAG_MS                  20000
+#define INTERVAL_CYCLE_MS       240000
+#define INTERVAL_WORK_MS        60000
+#define RAMP_HALF_MS            600000
+#define NOISE_BPM               8
+#define ARTIFACT_BPM            25
+#define ARTIFACT_PERCENT        2
+#define GAP_EVERY_MIN_MS        45000
+#define GAP_EVERY_MAX_MS        90000
+#define GAP_MIN_MS              3000
+#define GAP_MAX_MS              20000
+#define DEFAULT_LOW_MARGIN      10      // BPM below zone 1
+#define DEFAULT_HIGH_MARGIN     5       // BPM above zone 3
+
+static const char *const s_names[HR_PROFILE_COUNT] = {
+    [HR_PROFILE_STEADY]    = "steady",
+    [HR_PROFILE_INTERVALS] = "intervals",
+    [HR_PROFILE_RAMP]      = "ramp",
+    [HR_PROFILE_NOISY]     = "noisy",
+    [HR_PROFILE_DROPOUT]   = "dropout",
+};
+
+// xorshift32: fast, deterministic and good enough for noise
+static uint32_t next_random(hr_profile_t *p)
+{
+    uint32_t x = p->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return p->rng = x;
+}
+
+static uint32_t random_between(hr_profile_t *p, uint32_t min, uint32_t max)
+{
+    return min + next_random(p) % (max - min + 1);
+}
+
+static void schedule_gap(hr_profile_t *p, uint32_t after_ms)
+{
+    p->gap_start_ms = after_ms + random_between(p, GAP_EVERY_MIN_MS, GAP_EVERY_MAX_MS);
+    p->gap_end_ms = p->gap_start_ms + random_between(p, GAP_MIN_MS, GAP_MAX_MS);
+}
+
+static float target(const hr_profile_t *p, uint32_t t_ms)
+{
+    float mid = (p->low + p->high) / 2.0f;
+
+    switch (p->kind) {
+    case HR_PROFILE_INTERVALS:
+    case HR_PROFILE_DROPOUT:
+        return t_ms % INTERVAL_CYCLE_MS < INTERVAL_WORK_MS ? p->high : p->low;
+    case HR_PROFILE_RAMP: {
+        uint32_t phase = t_ms % (2 * RAMP_HALF_MS);
+        float up = (phase < RAMP_HALF_MS ? phase : 2 * RAMP_HALF_MS - phase) / (float)RAMP_HALF_MS;
+        return p->low + (p->high - p->low) * up;
+    }
+    default:
+        return mid;
+    }
+}
+
+void hr_profile_init(hr_profile_t *p, hr_profile_kind_t kind, uint8_t low, uint8_t high,
+                     uint32_t seed)
+{
+    memset(p, 0, sizeof(*p));
+    p->kind = kind < HR_PROFILE_COUNT ? kind : HR_PROFILE_STEADY;
+    p->low = low < high ? low : high;
+    p->high = low < high ? high : low;
+    p->rng = seed ? seed : 1;
+
+    // Ramps and intervals start at rest, the others at their target
+    bool from_rest = p->kind == HR_PROFILE_RAMP || p->kind == HR_PROFILE_INTERVALS ||
+                     p->kind == HR_PROFILE_DROPOUT;
+    p->hr = from_rest ? p->low : target(p, 0);
+    schedule_gap(p, 0);
+}
+
+bool hr_profile_sample(hr_profile_t *p, uint32_t t_ms, uint8_t *hr)
+{
+    uint32_t dt = t_ms - p->last_ms;
+    p->last_ms = t_ms;
+
+    // First order lag towards the target; steps longer than the lag land on it
+    float goal = target(p, t_ms);
+    p->hr += (goal - p->hr) * (dt < LAG_MS ? dt / (float)LAG_MS : 1.0f);
+
+    if (p->kind == HR_PROFILE_DROPOUT && t_ms >= p->gap_start_ms) {
+        if (t_ms < p->gap_end_ms) {
+            return false;
+        }
+        schedule_gap(p, t_ms);
+    }
+
+    float value = p->hr;
+    if (p->kind == HR_PROFILE_NOISY) {
+        value += (int32_t)random_between(p, 0, 2 * NOISE_BPM) - NOISE_BPM;
+        if (random_between(p, 1, 100) <= ARTIFACT_PERCENT) {
+            value += (next_random(p) & 1) ? ARTIFACT_BPM : -ARTIFACT_BPM;
+        }
+    }
+
+    // Notifications never carry 0 (that means "no reading")
+    *hr = value < 1.0f ? 1 : value > 255.0f ? 255 : (uint8_t)(value + 0.5f);
+    return true;
+}
+
+void hr_profile_default_range(float zone1, float zone3, uint8_t hr_resting, uint8_t hr_max,
+                              uint8_t *low, uint8_t *high)
+{
+    float lo = zone1 - DEFAULT_LOW_MARGIN;
+    float hi = zone3 + DEFAULT_HIGH_MARGIN;
+    *low = (uint8_t)(lo > hr_resting ? lo : hr_resting);
+    *high = (uint8_t)(hi < hr_max ? hi : hr_max);
+}
+
+const char *hr_profile_name(hr_profile_kind_t kind)
+{
+    return kind < HR_PROFILE_COUNT ? s_names[kind] : "unknown";
+}
+
+bool hr_profile_from_name(const char *name, hr_profile_kind_t *kind)
+{
+    for (int k = 0; k < HR_PROFILE_COUNT; k++) {
+        if (strcmp(name, s_names[k]) == 0) {
+            *kind = k;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,69 @@
+#ifndef HR_PROFILE_H
+#define HR_PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Synthetic heart rate profiles for demos and soak tests without a strap.
+// Pure math on a caller-supplied clock: hr_synth.c drives them in real time
+// on the device and the host simulator drives them on its virtual clock.
+//
+//   steady      the midpoint of low..high
+//   intervals   4 minute cycles: 1 minute towards high, 3 towards low
+//   ramp        low to high over 10 minutes and back down over the next 10
+//   noisy       the midpoint with +-8 BPM of noise per sample and occasional
+//               +-25 BPM artifacts
+//   dropout     intervals, with the sensor going silent for 3-20 s every
+//               45-90 s
+//
+// The heart rate follows its target with a 20 s lag, like a real one, so
+// the curve looks the same whether it is sampled at 1 Hz or 100 Hz.
+
+typedef enum {
+    HR_PROFILE_STEADY = 0,
+    HR_PROFILE_INTERVALS,
+    HR_PROFILE_RAMP,
+    HR_PROFILE_NOISY,
+    HR_PROFILE_DROPOUT,
+    HR_PROFILE_COUNT
+} hr_profile_kind_t;
+
+typedef struct {
+    hr_profile_kind_t kind;
+    uint8_t low;
+    uint8_t high;
+    uint32_t rng;
+    float hr;                   // Lagged heart rate
+    uint32_t last_ms;
+    uint32_t gap_start_ms;      // Dropout: next silent period
+    uint32_t gap_end_ms;
+} hr_profile_t;
+
+// Start a profile between 'low' and 'high' BPM at t = 0. 'seed' picks the
+// noise and dropout pattern; the same seed gives the same samples.
+void hr_profile_init(hr_profile_t *p, hr_profile_kind_t kind, uint8_t low, uint8_t high,
+                     uint32_t seed);
+
+// Heart rate at 't_ms' since the start. Calls must not go back in time.
+// Returns false while the sensor is silent (no notification is due).
+bool hr_profile_sample(hr_profile_t *p, uint32_t t_ms, uint8_t *hr);
+
+// The range the device uses when none is given: from 10 BPM below zone 1 to
+// 5 BPM above zone 3, within hrResting..hrMax, so every zone gets visited
+void hr_profile_default_range(float zone1, float zone3, uint8_t hr_resting, uint8_t hr_max,
+                              uint8_t *low, uint8_t *high);
+
+const char *hr_profile_name(hr_profile_kind_t kind);
+
+// Look up a profile by name; false if there is none
+bool hr_profile_from_name(const char *name, hr_profile_kind_t *kind);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HR_PROFILE_H
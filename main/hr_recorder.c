@@ -0,0 +1,391 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "gale.h"
+#include "metrics.h"
+#include "hr_trace.h"
+#include "hr_recorder.h"
+#include "mem_budget.h"
+
+static const char *TAG = "HR_RECORDER";
+
+// Capture writes raw notification payloads into one RAM buffer from the
+// NimBLE host task, under a spinlock held only for the memcpy. The buffer is
+// append-only while capturing, so a download can stream everything below
+// the length it saw without holding the lock. Capture stops when the buffer
+// is full rather than wrapping, so a trace always starts at a known state.
+//
+// Replay runs in its own task and calls the same hr_control entry points as
+// the BLE client, honouring the recorded timing (optionally sped up). A real
+// HRM connecting ends the replay.
+
+#define TRACE_BUFFER_SIZE   CONFIG_GALE_HR_TRACE_BUFFER_SIZE
+#define SEND_CHUNK          1024
+#define RECV_RETRIES        5
+#define REPLAY_STACK_SIZE   4096
+#define REPLAY_PRIORITY     5       // Below the fan loop
+#define REPLAY_MAX_WAIT_MS  100     // Longest sleep between stop checks
+#define REPLAY_SPEED_MAX    1000
+
+typedef enum {
+    REC_IDLE = 0,
+    REC_CAPTURING,
+    REC_REPLAYING,
+} rec_state_t;
+
+static const char *const s_state_names[] = { "idle", "capturing", "replaying" };
+
+static uint8_t *s_buf = NULL;
+static hr_trace_writer_t s_writer;      // s_writer.len = trace bytes, 0 = none
+static uint32_t s_records = 0;
+static bool s_full = false;
+static volatile rec_state_t s_state = REC_IDLE;
+static volatile bool s_stop_replay = false;
+static volatile bool s_taken_over = false;     // A real HRM ended the replay
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void record(uint8_t type, const uint8_t *payload, uint8_t len)
+{
+    uint64_t now = esp_timer_get_time();
+    bool full = false;
+
+    portENTER_CRITICAL(&s_lock);
+    if (s_state == REC_CAPTURING) {
+        if (hr_trace_append(&s_writer, type, now, payload, len)) {
+            s_records++;
+        } else {
+            s_state = REC_IDLE;
+            s_full = full = true;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (full) {
+        ESP_LOGW(TAG, "Trace buffer full, capture stopped after %" PRIu32 " records", s_records);
+    }
+}
+
+void hr_recorder_notify(const uint8_t *data, uint16_t len)
+{
+    if (s_state == REC_CAPTURING) {
+        record(HR_TRACE_NOTIFY, data, len > UINT8_MAX ? UINT8_MAX : len);
+    }
+}
+
+void hr_recorder_connection(bool connected)
+{
+    if (s_state == REC_CAPTURING) {
+        record(connected ? HR_TRACE_CONNECT : HR_TRACE_DISCONNECT, NULL, 0);
+    } else if (s_state == REC_REPLAYING && connected) {
+        ESP_LOGI(TAG, "HRM connected, ending replay");
+        s_taken_over = true;
+        s_stop_replay = true;
+    }
+}
+
+static void replay_task(void *pvParameters)
+{
+    uint32_t speed = (uint32_t)(uintptr_t)pvParameters;
+    hr_trace_reader_t reader;
+    hr_trace_record_t rec;
+    bool connected = false;
+    uint32_t count = 0;
+
+    hr_trace_reader_init(&reader, s_buf, s_writer.len);     // Checked before start
+    int64_t start_us = esp_timer_get_time();
+
+    while (!s_stop_replay && hr_trace_next(&reader, &rec)) {
+        int64_t due_us = start_us + (int64_t)(rec.t_us / speed);
+        int64_t wait_us;
+        while (!s_stop_replay && (wait_us = due_us - esp_timer_get_time()) > 0) {
+            uint32_t wait_ms = MIN(wait_us / 1000, REPLAY_MAX_WAIT_MS);
+            vTaskDelay(MAX(pdMS_TO_TICKS(wait_ms), 1));
+        }
+        if (s_stop_replay) {
+            break;
+        }
+
+        switch (rec.type) {
+        case HR_TRACE_NOTIFY:
+            if (!connected) {
+                hr_control_connected();
+                connected = true;
+            }
+            metrics_inc(METRIC_NOTIFY_RX);
+            hr_control_measurement(rec.payload, rec.len);
+            break;
+        case HR_TRACE_CONNECT:
+            if (!connected) {
+                hr_control_connected();
+                connected = true;
+            }
+            break;
+        case HR_TRACE_DISCONNECT:
+            if (connected) {
+                hr_control_disconnected();
+                connected = false;
+            }
+            break;
+        default:
+            break;
+        }
+        count++;
+    }
+
+    // Leave the control core as a dropped strap would, unless a real one
+    // has just taken over
+    if (connected && !s_taken_over) {
+        hr_control_disconnected();
+    }
+    ESP_LOGI(TAG, "Replay %s after %" PRIu32 " records",
+             s_stop_replay ? "stopped" : "finished", count);
+
+    s_state = REC_IDLE;
+    vTaskDelete(NULL);
+}
+
+static bool ensure_buffer(void)
+{
+    if (!s_buf) {
+        // Heap, not static: most devices never capture a trace
+        s_buf = malloc(TRACE_BUFFER_SIZE);
+        if (s_buf) {
+            mem_budget_add("hr_trace", TRACE_BUFFER_SIZE, 0, false, NULL);
+        }
+    }
+    return s_buf != NULL;
+}
+
+static esp_err_t send_state(httpd_req_t *req)
+{
+    char body[128];
+
+    portENTER_CRITICAL(&s_lock);
+    rec_state_t state = s_state;
+    size_t bytes = s_writer.len;
+    uint32_t records = s_records;
+    bool full = s_full;
+    portEXIT_CRITICAL(&s_lock);
+
+    snprintf(body, sizeof(body),
+             "{\"state\":\"%s\",\"bytes\":%u,\"records\":%" PRIu32 ",\"full\":%s}",
+             s_state_names[state], (unsigned)bytes, records, full ? "true" : "false");
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_sendstr(req, body);
+}
+
+static esp_err_t send_conflict(httpd_req_t *req, const char *message)
+{
+    httpd_resp_set_status(req, "409 Conflict");
+    httpd_resp_sendstr(req, message);
+    return ESP_OK;
+}
+
+static esp_err_t start_capture(httpd_req_t *req)
+{
+    if (s_state != REC_IDLE) {
+        return send_conflict(req, "Recorder busy");
+    }
+    if (!ensure_buffer()) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    hr_trace_writer_init(&s_writer, s_buf, TRACE_BUFFER_SIZE, esp_timer_get_time());
+    s_records = 0;
+    s_full = false;
+    s_state = REC_CAPTURING;
+    portEXIT_CRITICAL(&s_lock);
+
+    // A capture started mid-workout begins connected
+    if (g_ble_connected) {
+        record(HR_TRACE_CONNECT, NULL, 0);
+    }
+    ESP_LOGI(TAG, "Capture started (%u byte buffer)", (unsigned)TRACE_BUFFER_SIZE);
+    return send_state(req);
+}
+
+static esp_err_t start_replay(httpd_req_t *req, uint32_t speed)
+{
+    hr_trace_reader_t reader;
+
+    if (s_state != REC_IDLE) {
+        return send_conflict(req, "Recorder busy");
+    }
+    if (g_ble_connected) {
+        return send_conflict(req, "An HRM is connected");
+    }
+    if (!s_buf || hr_trace_reader_init(&reader, s_buf, s_writer.len) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No trace to replay");
+        return ESP_FAIL;
+    }
+
+    s_stop_replay = false;
+    s_taken_over = false;
+    s_state = REC_REPLAYING;
+    if (xTaskCreate(replay_task, "hr_replay", REPLAY_STACK_SIZE, (void *)(uintptr_t)speed,
+                    REPLAY_PRIORITY, NULL) != pdPASS) {
+        s_state = REC_IDLE;
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Cannot start replay");
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Replaying %" PRIu32 " records at %" PRIu32 "x", s_records, speed);
+    return send_state(req);
+}
+
+// HTTP POST handler for /api/trace?action=...
+static esp_err_t trace_post_handler(httpd_req_t *req)
+{
+    char query[64] = "";
+    char action[16] = "";
+    char value[12];
+    uint32_t speed = 1;
+
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    httpd_query_key_value(query, "action", action, sizeof(action));
+    if (httpd_query_key_value(query, "speed", value, sizeof(value)) == ESP_OK) {
+        speed = strtoul(value, NULL, 10);
+        if (speed < 1 || speed > REPLAY_SPEED_MAX) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "speed must be 1-1000");
+            return ESP_FAIL;
+        }
+    }
+
+    if (strcmp(action, "start") == 0) {
+        return start_capture(req);
+    } else if (strcmp(action, "replay") == 0) {
+        return start_replay(req, speed);
+    } else if (strcmp(action, "stop") == 0) {
+        portENTER_CRITICAL(&s_lock);
+        if (s_state == REC_CAPTURING) {
+            s_state = REC_IDLE;
+        } else if (s_state == REC_REPLAYING) {
+            s_stop_replay = true;
+        }
+        portEXIT_CRITICAL(&s_lock);
+        return send_state(req);
+    } else if (action[0] == '\0') {
+        return send_state(req);
+    }
+
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "action must be start, stop or replay");
+    return ESP_FAIL;
+}
+
+// HTTP GET handler for /api/trace (download)
+static esp_err_t trace_get_handler(httpd_req_t *req)
+{
+    portENTER_CRITICAL(&s_lock);
+    size_t len = s_buf ? s_writer.len : 0;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (len == 0) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No trace captured");
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"gale.ghrt\"");
+    for (size_t pos = 0; pos < len; pos += SEND_CHUNK) {
+        if (httpd_resp_send_chunk(req, (const char *)s_buf + pos, MIN(len - pos, SEND_CHUNK)) != ESP_OK) {
+            return ESP_FAIL;
+        }
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+// HTTP PUT handler for /api/trace (upload for replay)
+static esp_err_t trace_put_handler(httpd_req_t *req)
+{
+    if (s_state != REC_IDLE) {
+        return send_conflict(req, "Recorder busy");
+    }
+    if (req->content_len < HR_TRACE_HEADER_SIZE || req->content_len > TRACE_BUFFER_SIZE) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Trace size does not fit the buffer");
+        return ESP_FAIL;
+    }
+    if (!ensure_buffer()) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+
+    // The old trace is gone as soon as the upload starts
+    s_writer.len = 0;
+    s_records = 0;
+    s_full = false;
+
+    size_t received = 0;
+    int timeouts = 0;
+    while (received < req->content_len) {
+        int ret = httpd_req_recv(req, (char *)s_buf + received, req->content_len - received);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts <= RECV_RETRIES) {
+            continue;
+        }
+        if (ret <= 0) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Upload interrupted");
+            return ESP_FAIL;
+        }
+        timeouts = 0;
+        received += ret;
+    }
+
+    hr_trace_reader_t reader;
+    hr_trace_record_t rec;
+    if (hr_trace_reader_init(&reader, s_buf, received) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Not a GHRT trace");
+        return ESP_FAIL;
+    }
+    uint32_t records = 0;
+    while (hr_trace_next(&reader, &rec)) {
+        records++;
+    }
+
+    s_writer.len = received;
+    s_records = records;
+    ESP_LOGI(TAG, "Trace uploaded: %u bytes, %" PRIu32 " records", (unsigned)received, records);
+    return send_state(req);
+}
+
+static const httpd_uri_t trace_post_uri = {
+    .uri       = "/api/trace",
+    .method    = HTTP_POST,
+    .handler   = trace_post_handler,
+    .user_ctx  = NULL
+};
+
+static const httpd_uri_t trace_get_uri = {
+    .uri       = "/api/trace",
+    .method    = HTTP_GET,
+    .handler   = trace_get_handler,
+    .user_ctx  = NULL
+};
+
+static const httpd_uri_t trace_put_uri = {
+    .uri       = "/api/trace",
+    .method    = HTTP_PUT,
+    .handler   = trace_put_handler,
+    .user_ctx  = NULL
+};
+
+esp_err_t hr_recorder_register(httpd_handle_t server)
+{
+    esp_err_t err = httpd_register_uri_handler(server, &trace_post_uri);
+    if (err == ESP_OK) {
+        err = httpd_register_uri_handler(server, &trace_get_uri);
+    }
+    if (err == ESP_OK) {
+        err = httpd_register_uri_handler(server, &trace_put_uri);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register /api/trace: %s", esp_err_to_name(err));
+    }
+    return err;
+}
@@ -0,0 +1,36 @@
+#ifndef HR_RECORDER_H
+#define HR_RECORDER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// HR trace capture and replay on the device (format in hr_trace.h).
+//
+//   POST /api/trace?action=start    start capturing (discards the old trace)
+//   POST /api/trace?action=stop     stop capturing or replaying
+//   POST /api/trace?action=replay[&speed=N]
+//                                   feed the trace through hr_control at
+//                                   N times real time (default 1)
+//   GET  /api/trace                 download the trace
+//   PUT  /api/trace                 upload a trace to replay
+//
+// Every POST answers with the recorder state as JSON.
+
+// Capture hooks for the BLE client. Cheap no-ops unless capturing.
+void hr_recorder_notify(const uint8_t *data, uint16_t len);
+void hr_recorder_connection(bool connected);
+
+// Register the /api/trace endpoints on the server
+esp_err_t hr_recorder_register(httpd_handle_t server);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HR_RECORDER_H
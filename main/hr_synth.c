@@ -0,0 +1,332 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "sdkconfig.h"
+#include "gale.h"
+#include "metrics.h"
+#include "tracepoint.h"
+#include "hr_synth.h"
+
+static const char *TAG = "HR_SYNTH";
+
+// The source runs in its own task, created for each run like the trace
+// replay, and calls hr_control_measurement() with a two-byte notification
+// (flags 0, 8-bit HR) on a fixed period from xTaskDelayUntil. It sits on the
+// NimBLE host core at the replay's priority, so the control path sees its
+// samples arrive the way BLE notifications do.
+//
+// Consumer counters (relay switches, Matter updates, drops) are read from
+// /metrics at the start of a run and reported as the difference, so a run
+// measures only itself. Synthetic samples stay out of the session log (and
+// so /api/history) and the notification counters, jitter and loss, which
+// describe the strap.
+
+#define SYNTH_STACK_SIZE    3072
+#define SYNTH_PRIORITY      5       // Below the fan loop, like the replay
+#define SYNTH_RATE_MAX      100
+
+#ifdef CONFIG_BT_NIMBLE_PINNED_TO_CORE
+#define SYNTH_CORE          CONFIG_BT_NIMBLE_PINNED_TO_CORE
+#else
+#define SYNTH_CORE          tskNO_AFFINITY
+#endif
+
+typedef enum {
+    BASE_RELAYS = 0,
+    BASE_MATTER,
+    BASE_LIVE_DROPPED,
+    BASE_LOG_DROPPED,
+    BASE_BINLOG_DROPPED,
+    BASE_COUNT
+} base_counter_t;
+
+typedef struct {
+    uint32_t samples;           // Notifications delivered
+    uint32_t silent;            // Periods without one (dropout profile)
+    uint32_t late;              // Periods that started after their slot
+    uint32_t decisions;         // Samples that changed g_current_speed
+    uint32_t proc_max_us;       // hr_control_measurement() time
+    uint64_t proc_sum_us;
+    uint8_t last_hr;
+} synth_stats_t;
+
+static hr_synth_params_t s_params;
+static synth_stats_t s_stats;
+static uint32_t s_base[BASE_COUNT];
+static int64_t s_start_us = 0;
+static int64_t s_end_us = 0;            // 0 while running
+static volatile bool s_running = false;
+static volatile bool s_stop = false;
+static volatile bool s_taken_over = false;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void read_counters(uint32_t *c)
+{
+    c[BASE_RELAYS] = metrics_total(METRIC_RELAY1_SWITCHES) + metrics_total(METRIC_RELAY2_SWITCHES) +
+                     metrics_total(METRIC_RELAY3_SWITCHES);
+    c[BASE_MATTER] = metrics_total(METRIC_MATTER_UPDATES);
+    c[BASE_LIVE_DROPPED] = metrics_total(METRIC_LIVE_DROPPED);
+    c[BASE_LOG_DROPPED] = metrics_total(METRIC_LOG_DROPPED);
+    c[BASE_BINLOG_DROPPED] = metrics_total(METRIC_BINLOG_DROPPED);
+}
+
+static void synth_task(void *pvParameters)
+{
+    hr_profile_t profile;
+    TickType_t period = MAX(configTICK_RATE_HZ / s_params.rate_hz, 1);
+    int64_t duration_us = (int64_t)s_params.seconds * 1000000;
+
+    hr_profile_init(&profile, s_params.profile, s_params.low, s_params.high, esp_random());
+    hr_control_set_synthetic(true);
+    hr_control_connected();
+
+    TickType_t wake = xTaskGetTickCount();
+    while (!s_stop) {
+        int64_t elapsed_us = esp_timer_get_time() - s_start_us;
+        if (duration_us && elapsed_us >= duration_us) {
+            break;
+        }
+
+        uint8_t hr;
+        if (hr_profile_sample(&profile, (uint32_t)(elapsed_us / 1000), &hr)) {
+            uint8_t payload[2] = { 0, hr };
+            uint8_t speed = g_current_speed;
+
+            int64_t t0 = esp_timer_get_time();
+            TRACEPOINT(TP_NOTIFY_RX, sizeof(payload));
+            hr_control_measurement(payload, sizeof(payload));
+            uint32_t proc_us = (uint32_t)(esp_timer_get_time() - t0);
+
+            portENTER_CRITICAL(&s_lock);
+            s_stats.samples++;
+            s_stats.decisions += g_current_speed != speed;
+            s_stats.proc_sum_us += proc_us;
+            s_stats.proc_max_us = MAX(s_stats.proc_max_us, proc_us);
+            s_stats.last_hr = hr;
+            portEXIT_CRITICAL(&s_lock);
+        } else {
+            portENTER_CRITICAL(&s_lock);
+            s_stats.silent++;
+            portEXIT_CRITICAL(&s_lock);
+        }
+
+        // pdFALSE: the slot had already passed, so the source is saturated
+        if (xTaskDelayUntil(&wake, period) == pdFALSE) {
+            portENTER_CRITICAL(&s_lock);
+            s_stats.late++;
+            portEXIT_CRITICAL(&s_lock);
+        }
+    }
+
+    // Leave the control core as a dropped strap would, unless a real one
+    // has just taken over
+    if (!s_taken_over) {
+        hr_control_disconnected();
+        hr_control_set_synthetic(false);
+    }
+    ESP_LOGI(TAG, "Run %s after %" PRIu32 " samples (%" PRIu32 " late)",
+             s_stop ? "stopped" : "finished", s_stats.samples, s_stats.late);
+
+    s_end_us = esp_timer_get_time();
+    s_running = false;
+    vTaskDelete(NULL);
+}
+
+esp_err_t hr_synth_start(const hr_synth_params_t *params)
+{
+    if (params->profile >= HR_PROFILE_COUNT || params->rate_hz < 1 ||
+        params->rate_hz > SYNTH_RATE_MAX || (params->low || params->high) != (params->low && params->high)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_running || g_ble_connected) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    hr_synth_params_t p = *params;
+    if (p.low == 0) {
+        hr_profile_default_range(g_zone1, g_zone3, g_config.hrResting, g_config.hrMax, &p.low, &p.high);
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    s_params = p;
+    memset(&s_stats, 0, sizeof(s_stats));
+    portEXIT_CRITICAL(&s_lock);
+    read_counters(s_base);
+    s_stop = false;
+    s_taken_over = false;
+    s_start_us = esp_timer_get_time();
+    s_end_us = 0;
+    s_running = true;
+
+    if (xTaskCreatePinnedToCore(synth_task, "hr_synth", SYNTH_STACK_SIZE, NULL,
+                                SYNTH_PRIORITY, NULL, SYNTH_CORE) != pdPASS) {
+        s_running = false;
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Playing '%s' at %u Hz, %u-%u BPM", hr_profile_name(p.profile),
+             p.rate_hz, p.low, p.high);
+    return ESP_OK;
+}
+
+void hr_synth_stop(void)
+{
+    if (s_running) {
+        s_stop = true;
+    }
+}
+
+void hr_synth_hrm_connected(void)
+{
+    if (s_running) {
+        ESP_LOGI(TAG, "HRM connected, ending run");
+        s_taken_over = true;
+        s_stop = true;
+    }
+    // Before the strap's connect reaches hr_control; also ends a console
+    // injection (hr_control_inject())
+    hr_control_set_synthetic(false);
+}
+
+int hr_synth_format_state(char *buf, size_t size)
+{
+    uint32_t now[BASE_COUNT];
+
+    portENTER_CRITICAL(&s_lock);
+    synth_stats_t st = s_stats;
+    hr_synth_params_t p = s_params;
+    portEXIT_CRITICAL(&s_lock);
+    read_counters(now);
+
+    bool running = s_running;
+    int64_t end_us = running || s_end_us == 0 ? esp_timer_get_time() : s_end_us;
+    uint32_t elapsed_ms = s_start_us ? (uint32_t)((end_us - s_start_us) / 1000) : 0;
+
+    return snprintf(buf, size,
+                    "{\"state\":\"%s\",\"profile\":\"%s\",\"rate_hz\":%u,\"seconds\":%" PRIu32 ","
+                    "\"low\":%u,\"high\":%u,\"elapsed_ms\":%" PRIu32 ",\"samples\":%" PRIu32 ","
+                    "\"silent\":%" PRIu32 ",\"late\":%" PRIu32 ",\"achieved_hz\":%.1f,\"last_hr\":%u,"
+                    "\"hr_control_us\":{\"avg\":%" PRIu32 ",\"max\":%" PRIu32 "},"
+                    "\"decisions\":%" PRIu32 ",\"relay_switches\":%" PRIu32 ",\"matter_updates\":%" PRIu32 ","
+                    "\"live_dropped\":%" PRIu32 ",\"log_dropped\":%" PRIu32 ","
+                    "\"binlog_dropped\":%" PRIu32 "}",
+                    running ? "running" : "idle", hr_profile_name(p.profile), p.rate_hz, p.seconds,
+                    p.low, p.high, elapsed_ms, st.samples, st.silent, st.late,
+                    elapsed_ms ? st.samples * 1000.0 / elapsed_ms : 0.0, st.last_hr,
+                    st.samples ? (uint32_t)(st.proc_sum_us / st.samples) : 0, st.proc_max_us,
+                    st.decisions, now[BASE_RELAYS] - s_base[BASE_RELAYS],
+                    now[BASE_MATTER] - s_base[BASE_MATTER],
+                    now[BASE_LIVE_DROPPED] - s_base[BASE_LIVE_DROPPED],
+                    now[BASE_LOG_DROPPED] - s_base[BASE_LOG_DROPPED],
+                    now[BASE_BINLOG_DROPPED] - s_base[BASE_BINLOG_DROPPED]);
+}
+
+static esp_err_t send_state(httpd_req_t *req)
+{
+    static char body[512];
+
+    hr_synth_format_state(body, sizeof(body));
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_sendstr(req, body);
+}
+
+static uint32_t query_uint(const char *query, const char *key, uint32_t fallback)
+{
+    char value[12];
+
+    if (httpd_query_key_value(query, key, value, sizeof(value)) != ESP_OK) {
+        return fallback;
+    }
+    return strtoul(value, NULL, 10);
+}
+
+static esp_err_t start_run(httpd_req_t *req, const char *query)
+{
+    char name[16] = "";
+    hr_synth_params_t params = { 0 };
+
+    httpd_query_key_value(query, "profile", name, sizeof(name));
+    if (!hr_profile_from_name(name, &params.profile)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST,
+                            "profile must be steady, intervals, ramp, noisy or dropout");
+        return ESP_FAIL;
+    }
+    uint32_t rate = query_uint(query, "rate", 1);
+    uint32_t low = query_uint(query, "low", 0);
+    uint32_t high = query_uint(query, "high", 0);
+    params.seconds = query_uint(query, "seconds", 0);
+    params.rate_hz = rate <= SYNTH_RATE_MAX ? rate : 0;
+    params.low = low <= UINT8_MAX ? low : 0;
+    params.high = high <= UINT8_MAX ? high : 0;
+
+    esp_err_t err = hr_synth_start(&params);
+    if (err == ESP_ERR_INVALID_ARG) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "rate must be 1-100; give both low and high");
+        return ESP_FAIL;
+    } else if (err == ESP_ERR_INVALID_STATE) {
+        httpd_resp_set_status(req, "409 Conflict");
+        return httpd_resp_sendstr(req, s_running ? "Already running" : "An HRM or a trace replay is active");
+    } else if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Cannot start the source");
+        return ESP_FAIL;
+    }
+    return send_state(req);
+}
+
+// HTTP POST handler for /api/synth?action=...
+static esp_err_t synth_post_handler(httpd_req_t *req)
+{
+    char query[128] = "";
+    char action[8] = "";
+
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    httpd_query_key_value(query, "action", action, sizeof(action));
+
+    if (strcmp(action, "start") == 0) {
+        return start_run(req, query);
+    } else if (strcmp(action, "stop") == 0) {
+        hr_synth_stop();
+        return send_state(req);
+    }
+
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "action must be start or stop");
+    return ESP_FAIL;
+}
+
+// HTTP GET handler for /api/synth
+static esp_err_t synth_get_handler(httpd_req_t *req)
+{
+    return send_state(req);
+}
+
+static const httpd_uri_t synth_post_uri = {
+    .uri       = "/api/synth",
+    .method    = HTTP_POST,
+    .handler   = synth_post_handler,
+    .user_ctx  = NULL
+};
+
+static const httpd_uri_t synth_get_uri = {
+    .uri       = "/api/synth",
+    .method    = HTTP_GET,
+    .handler   = synth_get_handler,
+    .user_ctx  = NULL
+};
+
+esp_err_t hr_synth_register(httpd_handle_t server)
+{
+    esp_err_t err = httpd_register_uri_handler(server, &synth_post_uri);
+    if (err == ESP_OK) {
+        err = httpd_register_uri_handler(server, &synth_get_uri);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register /api/synth: %s", esp_err_to_name(err));
+    }
+    return err;
+}
@@ -0,0 +1,68 @@
+#ifndef HR_SYNTH_H
+#define HR_SYNTH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "hr_profile.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Synthetic HR source: plays a profile from hr_profile.h through hr_control
+// as Heart Rate Measurement notifications, so the fan, Matter, LED and live
+// telemetry see what a strap would give them. The session log and the
+// notification metrics don't record it (hr_control_set_synthetic()).
+//
+//   POST /api/synth?action=start&profile=NAME[&rate=HZ][&seconds=N]
+//                   [&low=BPM&high=BPM]
+//                                   start (rate 1-100 Hz, default 1;
+//                                   seconds 0 = until stopped; low/high
+//                                   default to just below zone 1 and just
+//                                   above zone 3)
+//   POST /api/synth?action=stop     stop
+//   GET  /api/synth                 state and counters as JSON
+//
+// The serial console drives it too ("matter esp gale synth", gale_shell.h).
+//
+// A real strap runs at about 1 Hz. Rates of 50-100 Hz are a load test: the
+// state shows how many samples missed their slot (late), how long
+// hr_control took per sample, and how many fan decisions, relay switches
+// and Matter attribute updates the samples turned into. The fan loop and
+// Matter coalesce, so those should stay at the 1 Hz level however fast the
+// samples come. A real HRM connecting ends the run.
+
+typedef struct {
+    hr_profile_kind_t profile;
+    uint16_t rate_hz;           // 1-100
+    uint32_t seconds;           // 0 = until stopped
+    uint8_t low;                // BPM; 0 with high = 0 picks them from the zones
+    uint8_t high;
+} hr_synth_params_t;
+
+// Start a run. ESP_ERR_INVALID_ARG for bad parameters, ESP_ERR_INVALID_STATE
+// if a run is going or an HRM (or a trace replay) is connected.
+esp_err_t hr_synth_start(const hr_synth_params_t *params);
+
+// Ask a run to stop; it ends within one sample period
+void hr_synth_stop(void);
+
+// Hook for the BLE client: a real HRM connected, so the run ends without
+// disconnecting it
+void hr_synth_hrm_connected(void);
+
+// The state and counters of the current or last run as JSON; returns the
+// length written, like snprintf
+int hr_synth_format_state(char *buf, size_t size);
+
+// Register the /api/synth endpoints on the server
+esp_err_t hr_synth_register(httpd_handle_t server);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HR_SYNTH_H
@@ -0,0 +1,102 @@
+#include <string.h>
+#include "hr_trace.h"
+
+// Encoder and decoder for the .ghrt trace format (see hr_trace.h). Pure
+// buffer code: used by the recorder on the device and by the host simulator.
+
+static void put_u64(uint8_t *p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++) {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+void hr_trace_writer_init(hr_trace_writer_t *w, uint8_t *buf, size_t size, uint64_t start_us)
+{
+    memcpy(buf, HR_TRACE_MAGIC, 4);
+    buf[4] = HR_TRACE_VERSION;
+    buf[5] = buf[6] = buf[7] = 0;
+    put_u64(buf + 8, start_us);
+
+    w->buf = buf;
+    w->size = size;
+    w->len = HR_TRACE_HEADER_SIZE;
+    w->start_us = start_us;
+    w->last_us = start_us;
+}
+
+bool hr_trace_append(hr_trace_writer_t *w, uint8_t type, uint64_t now_us,
+                     const uint8_t *payload, uint8_t len)
+{
+    uint8_t head[12];
+    size_t n = 0;
+    uint64_t delta = now_us > w->last_us ? now_us - w->last_us : 0;
+
+    head[n++] = type;
+    head[n++] = len;
+    do {
+        uint8_t b = delta & 0x7F;
+        delta >>= 7;
+        head[n++] = b | (delta ? 0x80 : 0);
+    } while (delta);
+
+    if (w->len + n + len > w->size) {
+        return false;
+    }
+    memcpy(w->buf + w->len, head, n);
+    if (len) {
+        memcpy(w->buf + w->len + n, payload, len);
+    }
+    w->len += n + len;
+    if (now_us > w->last_us) {
+        w->last_us = now_us;
+    }
+    return true;
+}
+
+esp_err_t hr_trace_reader_init(hr_trace_reader_t *r, const uint8_t *data, size_t len)
+{
+    if (len < HR_TRACE_HEADER_SIZE || memcmp(data, HR_TRACE_MAGIC, 4) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (data[4] != HR_TRACE_VERSION) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    r->p = data + HR_TRACE_HEADER_SIZE;
+    r->end = data + len;
+    r->t_us = 0;
+    return ESP_OK;
+}
+
+bool hr_trace_next(hr_trace_reader_t *r, hr_trace_record_t *rec)
+{
+    const uint8_t *p = r->p;
+    if (r->end - p < 3) {
+        return false;
+    }
+
+    uint8_t type = *p++;
+    uint8_t len = *p++;
+    uint64_t delta = 0;
+    for (int shift = 0; ; shift += 7) {
+        if (p == r->end || shift > 63) {
+            return false;
+        }
+        uint8_t b = *p++;
+        delta |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            break;
+        }
+    }
+    if (r->end - p < len) {
+        return false;
+    }
+
+    r->t_us += delta;
+    rec->type = type;
+    rec->len = len;
+    rec->t_us = r->t_us;
+    rec->payload = p;
+    r->p = p + len;
+    return true;
+}
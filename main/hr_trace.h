@@ -0,0 +1,73 @@
+#ifndef HR_TRACE_H
+#define HR_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// HR trace format (.ghrt): raw Heart Rate Measurement payloads and HRM
+// connection events with microsecond timestamps, so a session can be fed
+// back through hr_control exactly as it arrived.
+//
+// A 16-byte header (magic "GHRT", version, reserved, u64 device time of the
+// capture start in us) is followed by records back to back:
+//   type (u8) | payload length (u8) | time since previous record in us
+//   (unsigned LEB128) | payload
+// A 1 Hz notification with HR only takes 7 bytes. All integers are little
+// endian. Readers stop at the first truncated record.
+
+#define HR_TRACE_MAGIC          "GHRT"
+#define HR_TRACE_VERSION        1
+#define HR_TRACE_HEADER_SIZE    16
+#define HR_TRACE_RECORD_MAX     (2 + 10 + 255)  // Largest possible record
+
+// Record types
+#define HR_TRACE_NOTIFY         0   // payload = Heart Rate Measurement value
+#define HR_TRACE_CONNECT        1
+#define HR_TRACE_DISCONNECT     2
+
+typedef struct {
+    uint8_t type;
+    uint8_t len;
+    uint64_t t_us;              // Since capture start
+    const uint8_t *payload;     // Points into the trace buffer
+} hr_trace_record_t;
+
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+    uint64_t start_us;
+    uint64_t last_us;
+} hr_trace_writer_t;
+
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+    uint64_t t_us;
+} hr_trace_reader_t;
+
+// Start a trace in 'buf' (at least HR_TRACE_HEADER_SIZE bytes)
+void hr_trace_writer_init(hr_trace_writer_t *w, uint8_t *buf, size_t size, uint64_t start_us);
+
+// Append a record stamped with device time 'now_us'. Returns false (and
+// writes nothing) if it doesn't fit.
+bool hr_trace_append(hr_trace_writer_t *w, uint8_t type, uint64_t now_us,
+                     const uint8_t *payload, uint8_t len);
+
+// Check the header and position the reader at the first record
+esp_err_t hr_trace_reader_init(hr_trace_reader_t *r, const uint8_t *data, size_t len);
+
+// Decode the next record; false at the end of the trace
+bool hr_trace_next(hr_trace_reader_t *r, hr_trace_record_t *rec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HR_TRACE_H
@@ -4,6 +4,7 @@
 #include "driver/ledc.h"
 #include "esp_log.h"
 #include "gale.h"
+#include "tracepoint.h"
 
 static const char *TAG = "LED_CONTROL";
 
@@ -75,6 +76,11 @@ void led_control_set_mode(uint8_t mode)
     current_led_mode = mode;
 }
 
+uint8_t led_control_get_mode(void)
+{
+    return current_led_mode;
+}
+
 void led_control_task(void *pvParameters)
 {
     ESP_LOGI(TAG, "LED control task started");
@@ -106,6 +112,7 @@ void led_control_task(void *pvParameters)
         }
 
         uint32_t fade_time = pulse_period / 2;  // Half period for fade in, half for fade out
+        TRACEPOINT_BEGIN(tp_start);
 
         if (fading_up) {
             // Fade from 0 to max
@@ -118,6 +125,7 @@ void led_control_task(void *pvParameters)
             ledc_fade_start(LEDC_MODE, LEDC_CHANNEL, LEDC_FADE_WAIT_DONE);
             fading_up = true;
         }
+        TRACEPOINT_END(tp_start, TP_LED_FADE, fading_up ? 0 : LEDC_MAX_DUTY);
 
         last_mode = mode;
     }
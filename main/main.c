@@ -8,58 +8,25 @@
 #include "nvs_flash.h"
 #include "gale.h"
 #include "matter_device.h"
+#include "metrics.h"
+#include "session_log.h"
+#include "wifi_manager.h"
+#include "ota_update.h"
+#include "binlog.h"
+#include "mem_budget.h"
 
 static const char *TAG = "GALE";
 
-// Global configuration with defaults
-// These can be modified via NVS or later through Matter
-config_t g_config = {
-    // Heart rate defaults
-    .hrMax = 180,
-    .hrResting = 60,
-
-    // HR Zone defaults
-    // Turn-on threshold: 30-35% HRR marks transition from rest to light exercise where 
-    // metabolic heat production becomes noticeable. Below this, the body handles heat through 
-    // passive dissipation; above it, active cooling begins to help.
-    //
-    // Low speed: Remains in HRR calculation (personalized) for light to early-moderate intensity.
-    // Medium/High: Switch to %Max HR using ACSM guidelines - 64-76% Max HR is moderate intensity 
-    // (active sweating), 76%+ is vigorous (heavy heat production). These standardized zones align 
-    // fan speed with thermoregulatory demand as exercise intensity increases.
-    .zone1Percent = 0.33f, // %% of HR Reserve (light intensity, minimal heat production)
-    .zone2Percent = 0.64f, // %% of Max HR (moderate intensity, active sweating)
-    .zone3Percent = 0.76f, // %% of Max HR (vigorous intensity, heavy heat production)
-
-    // Fan behavior defaults
-    .alwaysOn = 0,  // Fan off by default, turns on when HRM connects
-#ifdef CONFIG_DEBUG_MODE
-    .fanDelay = 10000,     // 10 seconds in debug
-    .hrHysteresis = 0,     // none in debug
-#else
-    .fanDelay = 60000,     // 1 minute
-    .hrHysteresis = 15,
-#endif
-
-    // GPIO defaults
-    .relayGPIO = {27, 26, 25},
-    .ledGPIO = 2
-};
-
-// Calculated zone thresholds
-float g_zone1, g_zone2, g_zone3;
-
-// Fan speed state
-uint8_t g_current_speed = 1;  // Will be set from config.alwaysOn in setup
-uint8_t g_prev_speed = 0;
-uint32_t g_speed_changed_time = 0;
+// Control task stacks, at the sizes they had on the heap until stack_free on
+// /api/memory has been measured on a device; check it after changing what
+// runs in these tasks.
+#define FAN_TASK_STACK_SIZE     4096
+#define LED_TASK_STACK_SIZE     2048
 
-// BLE connection state
-bool g_ble_connected = false;
-uint32_t g_disconnected_time = 0;
-
-// Matter override mode (true = Matter controls fan, false = HRM auto mode)
-bool g_matter_override = false;
+static StackType_t s_fan_stack[FAN_TASK_STACK_SIZE];
+static StaticTask_t s_fan_tcb;
+static StackType_t s_led_stack[LED_TASK_STACK_SIZE];
+static StaticTask_t s_led_tcb;
 
 void app_main(void)
 {
@@ -76,8 +43,16 @@ void app_main(void)
     // Load configuration from NVS
     nvs_config_load();
 
+    // Open the workout session log (before anything starts producing records)
+    session_log_init();
+
+#ifdef CONFIG_GALE_BINLOG
+    // Printer for deferred log records from the notification path
+    binlog_init();
+#endif
+
     // Initialize fan control (GPIO setup)
-    fan_control_init();
+    bool relays_ok = (fan_control_init() == ESP_OK);
 
     // Initialize LED control (PWM for pulsing)
     led_control_init();
@@ -85,13 +60,20 @@ void app_main(void)
     // Set initial fan speed
     g_current_speed = g_config.alwaysOn;
 
+    // Hook WiFi events before Matter starts the station (fast connect)
+    wifi_manager_init();
+
     // Initialize Matter device (creates fan endpoint and starts Matter stack)
     err = matter_device_init();
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to initialize Matter device");
+        ota_update_confirm_boot(false);
         return;
     }
 
+    // Start the configuration web server (network is brought up by Matter)
+    web_server_start();
+
     // Wait for Matter BLE stack to stabilize before initializing HRM
     vTaskDelay(pdMS_TO_TICKS(2000));
 
@@ -99,26 +81,48 @@ void app_main(void)
     ble_hrm_init();
 
     // If already commissioned, start HRM scanning after a brief delay
+    bool scan_ok = true;
     if (matter_device_is_commissioned()) {
         ESP_LOGI(TAG, "Already commissioned, starting HRM scan");
         vTaskDelay(pdMS_TO_TICKS(1000));
-        ble_hrm_start_scan();
+        scan_ok = false;
+        for (int attempt = 0; attempt < 3 && !scan_ok; attempt++) {
+            if (attempt > 0) {
+                vTaskDelay(pdMS_TO_TICKS(1000));
+            }
+            scan_ok = ble_hrm_start_scan();
+        }
     } else {
         ESP_LOGI(TAG, "Not commissioned, waiting for Matter commissioning...");
         ESP_LOGI(TAG, "HRM scanning will start after commissioning completes");
     }
 
+    // Post-update self-test: a new OTA image is kept only if the relays came
+    // up and the HRM scan started; otherwise the bootloader rolls back
+    ota_update_confirm_boot(relays_ok && scan_ok);
+
     // Create fan control task
-    xTaskCreate(fan_control_task, "fan_control", 4096, NULL, 5, NULL);
+    TaskHandle_t fan_task = xTaskCreateStaticPinnedToCore(
+        fan_control_task, "fan_control", FAN_TASK_STACK_SIZE, NULL,
+        CONFIG_GALE_FAN_TASK_PRIORITY, s_fan_stack, &s_fan_tcb, GALE_CONTROL_CORE);
+    metrics_register_task(fan_task);
+    mem_budget_add("fan_control", sizeof(s_fan_stack) + sizeof(s_fan_tcb),
+                   4096 + sizeof(StaticTask_t), true, fan_task);
 
     // Create LED control task
-    xTaskCreate(led_control_task, "led_control", 2048, NULL, 5, NULL);
+    TaskHandle_t led_task = xTaskCreateStaticPinnedToCore(
+        led_control_task, "led_control", LED_TASK_STACK_SIZE, NULL,
+        CONFIG_GALE_LED_TASK_PRIORITY, s_led_stack, &s_led_tcb, GALE_CONTROL_CORE);
+    metrics_register_task(led_task);
+    mem_budget_add("led_control", sizeof(s_led_stack) + sizeof(s_led_tcb),
+                   2048 + sizeof(StaticTask_t), true, led_task);
 
     ESP_LOGI(TAG, "Gale initialized successfully with Matter support");
     ESP_LOGI(TAG, "HR Max: %d, Resting: %d", g_config.hrMax, g_config.hrResting);
     ESP_LOGI(TAG, "Zone 1: %.1f, Zone 2: %.1f, Zone 3: %.1f", g_zone1, g_zone2, g_zone3);
     ESP_LOGI(TAG, "Fan delay: %" PRIu32 " ms, Hysteresis: %d BPM, Always on: %d",
              g_config.fanDelay, g_config.hrHysteresis, g_config.alwaysOn);
+    mem_budget_report();
 
     // Main loop - check for commissioning completion and start HRM scan
     bool hrm_scan_started = matter_device_is_commissioned();
@@ -131,6 +135,7 @@ void app_main(void)
             ble_hrm_start_scan();
             hrm_scan_started = true;
         }
-        vTaskDelay(pdMS_TO_TICKS(5000));
+        mem_budget_sample();
+        vTaskDelay(pdMS_TO_TICKS(1000));
     }
 }
@@ -1,12 +1,29 @@
 #include <esp_matter.h>
 #include <esp_matter_core.h>
+#include <esp_matter_client.h>
 #include <app/server/Server.h>
+#include <platform/CHIPDeviceLayer.h>
+#if CONFIG_ENABLE_OTA_REQUESTOR
+#include <app/clusters/ota-requestor/OTARequestorInterface.h>
+#include <app-common/zap-generated/attributes/Accessors.h>
+#endif
 #include <app/clusters/fan-control-server/fan-control-server.h>
+#include <controller/WriteInteraction.h>
+#include <transport/GroupSession.h>
+#include <inttypes.h>
 #include "esp_log.h"
+#include "esp_timer.h"
+#if CONFIG_ENABLE_CHIP_SHELL
+#include <esp_matter_console.h>
+#endif
 
 extern "C" {
 #include "gale.h"
 #include "matter_device.h"
+#include "metrics.h"
+#include "telemetry.h"
+#include "tracepoint.h"
+#include "gale_shell.h"
 }
 
 using namespace esp_matter;
@@ -15,27 +32,35 @@ using namespace chip::app::Clusters;
 static const char *TAG = "MATTER_DEVICE";
 
 static uint16_t fan_endpoint_id = 0;
+static bool self_update = false;    // Matter thread is writing our own state
 
-// Convert Gale speed (0-3) to Matter percent (0-100)
-static uint8_t speed_to_percent(uint8_t speed)
-{
-    switch (speed) {
-        case 0: return 0;
-        case 1: return 33;
-        case 2: return 66;
-        case 3: return 100;
-        default: return 0;
-    }
-}
+// Workout cluster (manufacturer specific, test vendor prefix 0xFFF1)
+#define WORKOUT_CLUSTER_ID              0xFFF1FC01
+#define WORKOUT_ATTR_HEART_RATE         0x0000  // uint8, BPM (0 = no reading)
+#define WORKOUT_ATTR_ZONE               0x0001  // uint8, HR zone 0-3
+#define WORKOUT_ATTR_HRM_CONNECTED      0x0002  // bool
+#define WORKOUT_ATTR_SESSION_SECONDS    0x0003  // uint32, current/last session length
 
-// Convert Matter percent (0-100) to Gale speed (0-3)
-static uint8_t percent_to_speed(uint8_t percent)
-{
-    if (percent == 0) return 0;
-    if (percent <= 33) return 1;
-    if (percent <= 66) return 2;
-    return 3;
-}
+#define HR_REPORT_MIN_INTERVAL_MS       5000
+#define SESSION_REPORT_INTERVAL_MS      60000
+
+// Configuration cluster (manufacturer specific): the config_t settings as
+// writable attributes
+#define CONFIG_CLUSTER_ID               0xFFF1FC02
+#define CONFIG_ATTR_HR_MAX              0x0000  // uint8, BPM
+#define CONFIG_ATTR_HR_RESTING          0x0001  // uint8, BPM
+#define CONFIG_ATTR_ZONE1_PERCENT       0x0002  // single, fraction of HR reserve
+#define CONFIG_ATTR_ZONE2_PERCENT       0x0003  // single, fraction of max HR
+#define CONFIG_ATTR_ZONE3_PERCENT       0x0004  // single, fraction of max HR
+#define CONFIG_ATTR_FAN_DELAY           0x0005  // uint32, ms
+#define CONFIG_ATTR_HR_HYSTERESIS       0x0006  // uint8, BPM
+#define CONFIG_ATTR_ALWAYS_ON           0x0007  // bool
+
+#define CONFIG_COMMIT_DELAY_MS          3000
+
+// Bound fans get at most one PercentSetting write per interval; changes in
+// between collapse into the latest value
+#define FANOUT_MIN_INTERVAL_MS          1000
 
 // Helper to apply Matter speed change immediately and set override mode
 static void apply_matter_speed(uint8_t new_speed, bool enable_override)
@@ -49,6 +74,105 @@ static void apply_matter_speed(uint8_t new_speed, bool enable_override)
     }
 }
 
+// Config writes from controllers. Each write is range-checked on its own and
+// collected into a pending batch; once writes have been quiet for
+// CONFIG_COMMIT_DELAY_MS the written fields are applied over the current
+// configuration and the result is validated as a whole. Settings that
+// constrain each other (hrMax and hrResting, the zone percents) can then be
+// written in any order, and a batch of writes causes a single flash commit.
+// Only the fields the batch wrote are applied, so a change made through the
+// web UI while the batch is open is kept. Writes and the commit timer both
+// run on the Matter thread.
+#define CONFIG_BIT(attr)    (1u << (attr))
+
+static config_t config_pending;
+static uint32_t config_pending_mask = 0;    // CONFIG_BIT() of each attribute written
+
+static void sync_config_work(intptr_t arg);
+
+static void config_commit_timer(chip::System::Layer *layer, void *context)
+{
+    uint32_t mask = config_pending_mask;
+    config_pending_mask = 0;
+
+    config_t next = g_config;
+    if (mask & CONFIG_BIT(CONFIG_ATTR_HR_MAX))         next.hrMax = config_pending.hrMax;
+    if (mask & CONFIG_BIT(CONFIG_ATTR_HR_RESTING))     next.hrResting = config_pending.hrResting;
+    if (mask & CONFIG_BIT(CONFIG_ATTR_ZONE1_PERCENT))  next.zone1Percent = config_pending.zone1Percent;
+    if (mask & CONFIG_BIT(CONFIG_ATTR_ZONE2_PERCENT))  next.zone2Percent = config_pending.zone2Percent;
+    if (mask & CONFIG_BIT(CONFIG_ATTR_ZONE3_PERCENT))  next.zone3Percent = config_pending.zone3Percent;
+    if (mask & CONFIG_BIT(CONFIG_ATTR_FAN_DELAY))      next.fanDelay = config_pending.fanDelay;
+    if (mask & CONFIG_BIT(CONFIG_ATTR_HR_HYSTERESIS))  next.hrHysteresis = config_pending.hrHysteresis;
+    if (mask & CONFIG_BIT(CONFIG_ATTR_ALWAYS_ON))      next.alwaysOn = config_pending.alwaysOn;
+
+    const char *reason;
+    if (!config_validate(&next, &reason)) {
+        ESP_LOGW(TAG, "Matter: config writes discarded: %s", reason);
+        // Show controllers the configuration that is actually in use
+        sync_config_work(0);
+        return;
+    }
+
+    g_config = next;
+    calculate_zones();
+    ESP_LOGI(TAG, "Matter: config updated");
+
+    esp_err_t err = nvs_config_save();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save config: %s", esp_err_to_name(err));
+    }
+}
+
+static bool percent_valid(float percent)
+{
+    return percent > 0.0f && percent <= 1.0f;
+}
+
+static esp_err_t config_attribute_write(uint32_t attribute_id, const esp_matter_attr_val_t *val)
+{
+    bool valid;
+
+    switch (attribute_id) {
+    case CONFIG_ATTR_HR_MAX:
+        valid = val->val.u8 >= HR_MAX_MIN && val->val.u8 <= HR_MAX_MAX;
+        break;
+    case CONFIG_ATTR_HR_RESTING:
+        valid = val->val.u8 >= HR_RESTING_MIN && val->val.u8 <= HR_RESTING_MAX;
+        break;
+    case CONFIG_ATTR_ZONE1_PERCENT:
+    case CONFIG_ATTR_ZONE2_PERCENT:
+    case CONFIG_ATTR_ZONE3_PERCENT:
+        valid = percent_valid(val->val.f);
+        break;
+    case CONFIG_ATTR_FAN_DELAY:     valid = val->val.u32 <= FAN_DELAY_MAX; break;
+    case CONFIG_ATTR_HR_HYSTERESIS: valid = val->val.u8 <= HR_HYSTERESIS_MAX; break;
+    case CONFIG_ATTR_ALWAYS_ON:     valid = true; break;
+    default:
+        return ESP_OK;
+    }
+    if (!valid) {
+        ESP_LOGW(TAG, "Matter: rejected config write 0x%04" PRIx32 ": out of range", attribute_id);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    switch (attribute_id) {
+    case CONFIG_ATTR_HR_MAX:        config_pending.hrMax = val->val.u8; break;
+    case CONFIG_ATTR_HR_RESTING:    config_pending.hrResting = val->val.u8; break;
+    case CONFIG_ATTR_ZONE1_PERCENT: config_pending.zone1Percent = val->val.f; break;
+    case CONFIG_ATTR_ZONE2_PERCENT: config_pending.zone2Percent = val->val.f; break;
+    case CONFIG_ATTR_ZONE3_PERCENT: config_pending.zone3Percent = val->val.f; break;
+    case CONFIG_ATTR_FAN_DELAY:     config_pending.fanDelay = val->val.u32; break;
+    case CONFIG_ATTR_HR_HYSTERESIS: config_pending.hrHysteresis = val->val.u8; break;
+    case CONFIG_ATTR_ALWAYS_ON:     config_pending.alwaysOn = val->val.b ? 1 : 0; break;
+    }
+    config_pending_mask |= CONFIG_BIT(attribute_id);
+    ESP_LOGI(TAG, "Matter: config attribute 0x%04" PRIx32 " staged", attribute_id);
+
+    chip::DeviceLayer::SystemLayer().StartTimer(
+        chip::System::Clock::Milliseconds32(CONFIG_COMMIT_DELAY_MS), config_commit_timer, nullptr);
+    return ESP_OK;
+}
+
 // Attribute update callback - called when Matter client changes attributes
 static esp_err_t app_attribute_update_cb(
     attribute::callback_type_t type,
@@ -58,14 +182,15 @@ static esp_err_t app_attribute_update_cb(
     esp_matter_attr_val_t *val,
     void *priv_data)
 {
-    if (type != attribute::PRE_UPDATE || endpoint_id != fan_endpoint_id) {
+    // Ignore our own state reports (update_fan_state_work)
+    if (type != attribute::PRE_UPDATE || endpoint_id != fan_endpoint_id || self_update) {
         return ESP_OK;
     }
 
     if (cluster_id == FanControl::Id) {
         if (attribute_id == FanControl::Attributes::PercentSetting::Id) {
             uint8_t new_percent = val->val.u8;
-            uint8_t new_speed = percent_to_speed(new_percent);
+            uint8_t new_speed = fan_percent_to_speed(new_percent);
             ESP_LOGI(TAG, "Matter: Fan percent set to %d (speed %d)", new_percent, new_speed);
             // Off (0%) returns to auto mode, otherwise override HRM
             apply_matter_speed(new_speed, new_speed > 0);
@@ -107,10 +232,101 @@ static esp_err_t app_attribute_update_cb(
             }
         }
     }
+    else if (cluster_id == CONFIG_CLUSTER_ID) {
+        // An error here rejects the write
+        return config_attribute_write(attribute_id, val);
+    }
 
     return ESP_OK;
 }
 
+#if CONFIG_ENABLE_OTA_REQUESTOR
+// Matter OTA. Downloads run on the Matter thread and write the inactive
+// OTA slot through the platform image processor. A transfer competes with
+// HR notifications for the radio and for flash/cache time, so updates are
+// held off while a workout is in progress: a download that starts with an
+// HRM connected is cancelled and the provider is queried again once the
+// HRM disconnects.
+#define OTA_PROGRESS_POLL_MS    2000
+
+static bool ota_downloading = false;
+static bool ota_deferred = false;
+static bool workout_active = false;
+
+static void ota_progress_poll(chip::System::Layer *layer, void *context)
+{
+    if (!ota_downloading) {
+        return;
+    }
+
+    chip::app::DataModel::Nullable<uint8_t> progress;
+    if (OtaSoftwareUpdateRequestor::Attributes::UpdateStateProgress::Get(0, progress) ==
+            chip::Protocols::InteractionModel::Status::Success &&
+        !progress.IsNull()) {
+        ESP_LOGI(TAG, "OTA download %d%%", progress.Value());
+        telemetry_publish(TELEMETRY_OTA, progress.Value());
+    }
+    chip::DeviceLayer::SystemLayer().StartTimer(
+        chip::System::Clock::Milliseconds32(OTA_PROGRESS_POLL_MS), ota_progress_poll, nullptr);
+}
+
+static void ota_defer(void)
+{
+    ESP_LOGI(TAG, "Workout in progress, deferring OTA update");
+    ota_deferred = true;
+    ota_downloading = false;
+    if (chip::GetRequestorInstance()) {
+        chip::GetRequestorInstance()->CancelImageUpdate();
+    }
+}
+
+static void ota_state_changed(chip::DeviceLayer::OtaState state)
+{
+    switch (state) {
+    case chip::DeviceLayer::kOtaDownloadInProgress:
+        if (workout_active) {
+            ota_defer();
+            break;
+        }
+        ESP_LOGI(TAG, "OTA download started");
+        ota_downloading = true;
+        chip::DeviceLayer::SystemLayer().StartTimer(
+            chip::System::Clock::Milliseconds32(OTA_PROGRESS_POLL_MS), ota_progress_poll, nullptr);
+        break;
+    case chip::DeviceLayer::kOtaDownloadComplete:
+        ESP_LOGI(TAG, "OTA download complete");
+        ota_downloading = false;
+        telemetry_publish(TELEMETRY_OTA, 100);
+        break;
+    case chip::DeviceLayer::kOtaDownloadFailed:
+    case chip::DeviceLayer::kOtaDownloadAborted:
+        ESP_LOGW(TAG, "OTA download %s", state == chip::DeviceLayer::kOtaDownloadFailed ? "failed" : "aborted");
+        ota_downloading = false;
+        break;
+    case chip::DeviceLayer::kOtaApplyInProgress:
+        ESP_LOGI(TAG, "Applying OTA image, restarting");
+        break;
+    case chip::DeviceLayer::kOtaApplyFailed:
+        ESP_LOGE(TAG, "OTA apply failed");
+        break;
+    default:
+        break;
+    }
+}
+
+static void ota_workout_changed(bool active)
+{
+    workout_active = active;
+    if (workout_active && ota_downloading) {
+        ota_defer();
+    } else if (!workout_active && ota_deferred && chip::GetRequestorInstance()) {
+        ESP_LOGI(TAG, "Workout over, resuming deferred OTA update");
+        ota_deferred = false;
+        chip::GetRequestorInstance()->TriggerImmediateQuery();
+    }
+}
+#endif // CONFIG_ENABLE_OTA_REQUESTOR
+
 // Matter event callback
 static void app_event_cb(const ChipDeviceEvent *event, intptr_t arg)
 {
@@ -127,11 +343,127 @@ static void app_event_cb(const ChipDeviceEvent *event, intptr_t arg)
         }
         break;
 
+#if CONFIG_ENABLE_OTA_REQUESTOR
+    case chip::DeviceLayer::DeviceEventType::kOtaStateChanged:
+        ota_state_changed(event->OtaStateChanged.newState);
+        break;
+#endif
+
     default:
         break;
     }
 }
 
+// Binding fan-out. Whenever our speed changes, bound fans get a
+// PercentSetting write with our current percentage. The binding manager
+// sets up CASE sessions as needed and calls back per binding on the Matter
+// thread; sends are rate limited in fanout_update().
+#define PERCENT_UNKNOWN 0xFF
+
+static uint8_t fanout_target = PERCENT_UNKNOWN;    // Owned by the Matter thread
+static uint8_t fanout_sent = PERCENT_UNKNOWN;
+static int64_t fanout_last_us = 0;
+static bool fanout_timer_armed = false;
+
+static void fanout_write(const chip::SessionHandle &session, chip::EndpointId endpoint)
+{
+    using PercentSetting = FanControl::Attributes::PercentSetting::TypeInfo;
+
+    auto on_success = [](const chip::app::ConcreteAttributePath &path) {
+        metrics_inc(METRIC_FANOUT_WRITES);
+    };
+    auto on_error = [](const chip::app::ConcreteAttributePath *path, CHIP_ERROR err) {
+        metrics_inc(METRIC_FANOUT_ERRORS);
+        ESP_LOGW(TAG, "Fan-out write failed: %" CHIP_ERROR_FORMAT, err.Format());
+    };
+
+    CHIP_ERROR err = chip::Controller::WriteAttribute<PercentSetting>(
+        session, endpoint, chip::app::DataModel::Nullable<chip::Percent>(fanout_target),
+        on_success, on_error);
+    if (err != CHIP_NO_ERROR) {
+        metrics_inc(METRIC_FANOUT_ERRORS);
+        ESP_LOGW(TAG, "Fan-out write not sent: %" CHIP_ERROR_FORMAT, err.Format());
+    }
+}
+
+static void fanout_request_cb(client::peer_device_t *peer_device, client::request_handle_t *req_handle,
+                              void *priv_data)
+{
+    if (req_handle->type != client::WRITE_ATTR || !peer_device->GetSecureSession().HasValue()) {
+        return;
+    }
+    fanout_write(peer_device->GetSecureSession().Value(), req_handle->attribute_path.mEndpointId);
+}
+
+static void fanout_group_request_cb(uint8_t fabric_index, client::request_handle_t *req_handle,
+                                    void *priv_data)
+{
+    if (req_handle->type != client::WRITE_ATTR) {
+        return;
+    }
+    // Group writes go to every member endpoint and are never acknowledged
+    chip::Transport::OutgoingGroupSession session(req_handle->command_path.mGroupId, fabric_index);
+    fanout_write(chip::SessionHandle(session), chip::kInvalidEndpointId);
+}
+
+static void fanout_send(void)
+{
+    client::request_handle_t req;
+    req.type = client::WRITE_ATTR;
+    req.attribute_path = chip::app::AttributePathParams(FanControl::Id, FanControl::Attributes::PercentSetting::Id);
+    // The callbacks run once each binding's session is up and write
+    // fanout_target as it is then, so a late session still sends the
+    // newest value
+    client::cluster_update(fan_endpoint_id, &req);
+    TRACEPOINT(TP_FANOUT, fanout_target);
+
+    fanout_sent = fanout_target;
+    fanout_last_us = esp_timer_get_time();
+}
+
+static void fanout_timer(chip::System::Layer *layer, void *context)
+{
+    fanout_timer_armed = false;
+    if (fanout_target != fanout_sent) {
+        fanout_send();
+    }
+}
+
+static void fanout_update(uint8_t percent)
+{
+    fanout_target = percent;
+    if (percent == fanout_sent || fanout_timer_armed) {
+        return;
+    }
+
+    int64_t wait_ms = FANOUT_MIN_INTERVAL_MS - (esp_timer_get_time() - fanout_last_us) / 1000;
+    if (fanout_last_us != 0 && wait_ms > 0) {
+        fanout_timer_armed = true;
+        chip::DeviceLayer::SystemLayer().StartTimer(
+            chip::System::Clock::Milliseconds32((uint32_t)wait_ms), fanout_timer, nullptr);
+        return;
+    }
+    fanout_send();
+}
+
+#if CONFIG_ENABLE_CHIP_SHELL
+// Serial console: the esp-matter diagnostics and WiFi commands plus Gale's
+// own under "matter esp gale"
+static void console_init(void)
+{
+    static const esp_matter::console::command_t gale_command = {
+        .name = "gale",
+        .description = "Gale stats, HR injection, speed, synthetic HR, benchmarks and traces. "
+                       "Usage: matter esp gale help",
+        .handler = gale_shell_command,
+    };
+    esp_matter::console::diagnostics_register_commands();
+    esp_matter::console::wifi_register_commands();
+    esp_matter::console::add_commands(&gale_command, 1);
+    esp_matter::console::init();
+}
+#endif
+
 esp_err_t matter_device_init(void)
 {
     ESP_LOGI(TAG, "Initializing Matter device");
@@ -170,6 +502,64 @@ esp_err_t matter_device_init(void)
         cluster::fan_control::feature::multi_speed::add(fan_cluster, &multi_speed_config);
     }
 
+    // Workout state for controllers (see WORKOUT_CLUSTER_ID)
+    cluster_t *workout_cluster = cluster::create(fan_endpoint, WORKOUT_CLUSTER_ID, CLUSTER_FLAG_SERVER);
+    if (workout_cluster) {
+        cluster::global::attribute::create_cluster_revision(workout_cluster, 1);
+        cluster::global::attribute::create_feature_map(workout_cluster, 0);
+        attribute::create(workout_cluster, WORKOUT_ATTR_HEART_RATE, ATTRIBUTE_FLAG_NONE, esp_matter_uint8(0));
+        attribute::create(workout_cluster, WORKOUT_ATTR_ZONE, ATTRIBUTE_FLAG_NONE, esp_matter_uint8(0));
+        attribute::create(workout_cluster, WORKOUT_ATTR_HRM_CONNECTED, ATTRIBUTE_FLAG_NONE, esp_matter_bool(false));
+        attribute::create(workout_cluster, WORKOUT_ATTR_SESSION_SECONDS, ATTRIBUTE_FLAG_NONE, esp_matter_uint32(0));
+    } else {
+        ESP_LOGW(TAG, "Failed to create workout cluster");
+    }
+
+    // Writable configuration (see CONFIG_CLUSTER_ID). NVS via config_t is the
+    // store of record, so the attributes themselves are not persisted.
+    cluster_t *config_cluster = cluster::create(fan_endpoint, CONFIG_CLUSTER_ID, CLUSTER_FLAG_SERVER);
+    if (config_cluster) {
+        const uint8_t flags = ATTRIBUTE_FLAG_WRITABLE;
+        cluster::global::attribute::create_cluster_revision(config_cluster, 1);
+        cluster::global::attribute::create_feature_map(config_cluster, 0);
+        attribute::create(config_cluster, CONFIG_ATTR_HR_MAX, flags, esp_matter_uint8(g_config.hrMax));
+        attribute::create(config_cluster, CONFIG_ATTR_HR_RESTING, flags, esp_matter_uint8(g_config.hrResting));
+        attribute::create(config_cluster, CONFIG_ATTR_ZONE1_PERCENT, flags, esp_matter_float(g_config.zone1Percent));
+        attribute::create(config_cluster, CONFIG_ATTR_ZONE2_PERCENT, flags, esp_matter_float(g_config.zone2Percent));
+        attribute::create(config_cluster, CONFIG_ATTR_ZONE3_PERCENT, flags, esp_matter_float(g_config.zone3Percent));
+        attribute::create(config_cluster, CONFIG_ATTR_FAN_DELAY, flags, esp_matter_uint32(g_config.fanDelay));
+        attribute::create(config_cluster, CONFIG_ATTR_HR_HYSTERESIS, flags, esp_matter_uint8(g_config.hrHysteresis));
+        attribute::create(config_cluster, CONFIG_ATTR_ALWAYS_ON, flags, esp_matter_bool(g_config.alwaysOn != 0));
+    } else {
+        ESP_LOGW(TAG, "Failed to create config cluster");
+    }
+
+    // Fan Control client plus Binding, so a controller can bind other fans
+    // (unicast or group) to follow this one's speed
+    cluster::create(fan_endpoint, FanControl::Id, CLUSTER_FLAG_CLIENT);
+    cluster::binding::config_t binding_config;
+    if (!cluster::binding::create(fan_endpoint, &binding_config, CLUSTER_FLAG_SERVER)) {
+        ESP_LOGW(TAG, "Failed to create binding cluster");
+    }
+    client::set_request_callback(fanout_request_cb, fanout_group_request_cb, NULL);
+
+    // FanMode follows the HR zone in auto mode and the settings follow every
+    // controller write; persist them lazily so speed changes don't each cost
+    // an NVS write (PercentCurrent and SpeedCurrent are not persisted at all)
+    if (fan_cluster) {
+        const uint32_t persisted[] = {
+            FanControl::Attributes::FanMode::Id,
+            FanControl::Attributes::PercentSetting::Id,
+            FanControl::Attributes::SpeedSetting::Id,
+        };
+        for (uint32_t id : persisted) {
+            attribute_t *attr = attribute::get(fan_cluster, id);
+            if (attr) {
+                attribute::set_deferred_persistence(attr);
+            }
+        }
+    }
+
     // Start Matter
     esp_err_t err = esp_matter::start(app_event_cb);
     if (err != ESP_OK) {
@@ -177,6 +567,10 @@ esp_err_t matter_device_init(void)
         return err;
     }
 
+#if CONFIG_ENABLE_CHIP_SHELL
+    console_init();
+#endif
+
     ESP_LOGI(TAG, "Matter device initialized successfully");
     ESP_LOGI(TAG, "==================================");
     ESP_LOGI(TAG, "Matter Commissioning Information:");
@@ -187,41 +581,278 @@ esp_err_t matter_device_init(void)
     return ESP_OK;
 }
 
+// Fan state reporting. Speed changes come from the fan task; the attribute
+// writes happen on the Matter thread. Callers only record the latest state
+// and schedule a single work item, so a burst of changes collapses into one
+// pass that writes whichever attributes differ from what was last reported.
+#define ATTR_UNKNOWN 0xFF
+
+static uint8_t pending_speed = 0;
+static bool pending_override = false;
+static bool update_scheduled = false;
+
+// Owned by the Matter thread
+static uint8_t reported_percent = ATTR_UNKNOWN;
+static uint8_t reported_speed = ATTR_UNKNOWN;
+static uint8_t reported_mode = ATTR_UNKNOWN;
+
+static void update_attribute(uint32_t cluster_id, uint32_t attribute_id, esp_matter_attr_val_t val)
+{
+    TRACEPOINT_BEGIN(tp_start);
+    self_update = true;
+    attribute::update(fan_endpoint_id, cluster_id, attribute_id, &val);
+    self_update = false;
+    metrics_inc(METRIC_MATTER_UPDATES);
+    TRACEPOINT_END(tp_start, TP_MATTER_UPDATE, attribute_id);
+}
+
+static void update_fan_state_work(intptr_t arg)
+{
+    __atomic_store_n(&update_scheduled, false, __ATOMIC_SEQ_CST);
+    uint8_t speed = __atomic_load_n(&pending_speed, __ATOMIC_RELAXED);
+    bool override = __atomic_load_n(&pending_override, __ATOMIC_RELAXED);
+
+    uint8_t percent = fan_speed_to_percent(speed);
+
+    // FanMode reflects the current state: the manual mode (0=Off, 1=Low,
+    // 2=Medium, 3=High) when Matter is overriding, otherwise Auto (5) when
+    // on and Off (0) when off
+    uint8_t fan_mode;
+    if (override) {
+        fan_mode = speed;
+    } else {
+        fan_mode = (speed > 0) ? 5 : 0;
+    }
+
+    if (percent != reported_percent) {
+        update_attribute(FanControl::Id, FanControl::Attributes::PercentCurrent::Id, esp_matter_uint8(percent));
+        reported_percent = percent;
+    }
+    if (speed != reported_speed) {
+        update_attribute(FanControl::Id, FanControl::Attributes::SpeedCurrent::Id, esp_matter_uint8(speed));
+        reported_speed = speed;
+    }
+    if (fan_mode != reported_mode) {
+        update_attribute(FanControl::Id, FanControl::Attributes::FanMode::Id, esp_matter_enum8(fan_mode));
+        reported_mode = fan_mode;
+    }
+
+    fanout_update(percent);
+
+    ESP_LOGD(TAG, "Matter state updated: speed=%d, percent=%d, mode=%d", speed, percent, fan_mode);
+}
+
 void matter_device_update_fan_state(uint8_t speed)
 {
     if (fan_endpoint_id == 0) {
         return;
     }
 
-    uint8_t percent = speed_to_percent(speed);
+    __atomic_store_n(&pending_speed, speed, __ATOMIC_RELAXED);
+    __atomic_store_n(&pending_override, g_matter_override, __ATOMIC_RELAXED);
+    if (!__atomic_exchange_n(&update_scheduled, true, __ATOMIC_SEQ_CST)) {
+        CHIP_ERROR err = chip::DeviceLayer::PlatformMgr().ScheduleWork(update_fan_state_work, 0);
+        if (err != CHIP_NO_ERROR) {
+            // Nothing will run to clear the flag; let the next change retry
+            __atomic_store_n(&update_scheduled, false, __ATOMIC_SEQ_CST);
+            ESP_LOGW(TAG, "Fan state update not scheduled: %" CHIP_ERROR_FORMAT, err.Format());
+        }
+    }
+}
+
+// Workout cluster: a manufacturer-specific cluster on the fan endpoint that
+// tells controllers why the fan is doing what it does. Values are
+// deduplicated, and heart rate is reported at most every
+// HR_REPORT_MIN_INTERVAL_MS (zone changes go out immediately), so a 1 Hz
+// HRM doesn't turn into a 1 Hz stream of reports to every subscriber.
+// Session duration is refreshed every SESSION_REPORT_INTERVAL_MS.
+static uint8_t pending_hr = 0;
+static bool hr_scheduled = false;
 
-    // Update PercentCurrent attribute (non-nullable)
-    esp_matter_attr_val_t val = esp_matter_uint8(percent);
-    attribute::update(fan_endpoint_id, FanControl::Id,
-                     FanControl::Attributes::PercentCurrent::Id, &val);
+// Owned by the Matter thread
+static uint8_t reported_hr = 0;
+static uint8_t reported_zone = 0;
+static int64_t hr_reported_ms = 0;
+static bool hr_flush_armed = false;
+static int64_t session_start_ms = 0;    // 0 = no HRM connected
 
-    // Update SpeedCurrent attribute (non-nullable)
-    val = esp_matter_uint8(speed);
-    attribute::update(fan_endpoint_id, FanControl::Id,
-                     FanControl::Attributes::SpeedCurrent::Id, &val);
+static int64_t now_ms(void)
+{
+    return esp_timer_get_time() / 1000;
+}
 
-    // Update FanMode to reflect current state
-    // If Matter is overriding, show the manual mode (0=Off, 1=Low, 2=Medium, 3=High)
-    // If HRM is controlling (auto mode), show Auto (5) when on, Off (0) when off
-    uint8_t fan_mode;
-    if (g_matter_override) {
-        fan_mode = speed;  // 0=Off, 1=Low, 2=Med, 3=High
-    } else {
-        fan_mode = (speed > 0) ? 5 : 0;  // Auto or Off
+static uint8_t hr_zone(uint8_t hr)
+{
+    if (hr == 0 || hr < g_zone1) return 0;
+    if (hr < g_zone2) return 1;
+    if (hr < g_zone3) return 2;
+    return 3;
+}
+
+static void report_hr(bool force);
+
+static void hr_flush_timer(chip::System::Layer *layer, void *context)
+{
+    hr_flush_armed = false;
+    report_hr(false);
+}
+
+static void report_hr(bool force)
+{
+    uint8_t hr = __atomic_load_n(&pending_hr, __ATOMIC_RELAXED);
+    uint8_t zone = hr_zone(hr);
+
+    if (zone != reported_zone) {
+        update_attribute(WORKOUT_CLUSTER_ID, WORKOUT_ATTR_ZONE, esp_matter_uint8(zone));
+        reported_zone = zone;
+        force = true;
+    }
+    if (hr == reported_hr) {
+        return;
     }
-    val = esp_matter_enum8(fan_mode);
-    attribute::update(fan_endpoint_id, FanControl::Id,
-                     FanControl::Attributes::FanMode::Id, &val);
 
-    ESP_LOGD(TAG, "Matter state updated: speed=%d, percent=%d, mode=%d", speed, percent, fan_mode);
+    int64_t elapsed = now_ms() - hr_reported_ms;
+    if (!force && elapsed < HR_REPORT_MIN_INTERVAL_MS) {
+        // Report whatever the latest value is once the interval has passed
+        if (!hr_flush_armed) {
+            hr_flush_armed = true;
+            chip::DeviceLayer::SystemLayer().StartTimer(
+                chip::System::Clock::Milliseconds32(HR_REPORT_MIN_INTERVAL_MS - elapsed),
+                hr_flush_timer, nullptr);
+        }
+        return;
+    }
+
+    update_attribute(WORKOUT_CLUSTER_ID, WORKOUT_ATTR_HEART_RATE, esp_matter_uint8(hr));
+    reported_hr = hr;
+    hr_reported_ms = now_ms();
+}
+
+static void update_hr_work(intptr_t arg)
+{
+    __atomic_store_n(&hr_scheduled, false, __ATOMIC_SEQ_CST);
+    report_hr(false);
+}
+
+void matter_device_update_hr(uint8_t heart_rate)
+{
+    if (fan_endpoint_id == 0) {
+        return;
+    }
+
+    __atomic_store_n(&pending_hr, heart_rate, __ATOMIC_RELAXED);
+    if (!__atomic_exchange_n(&hr_scheduled, true, __ATOMIC_SEQ_CST)) {
+        CHIP_ERROR err = chip::DeviceLayer::PlatformMgr().ScheduleWork(update_hr_work, 0);
+        if (err != CHIP_NO_ERROR) {
+            __atomic_store_n(&hr_scheduled, false, __ATOMIC_SEQ_CST);
+            ESP_LOGW(TAG, "HR update not scheduled: %" CHIP_ERROR_FORMAT, err.Format());
+        }
+    }
+}
+
+static void report_session_duration(void)
+{
+    uint32_t seconds = (uint32_t)((now_ms() - session_start_ms) / 1000);
+    update_attribute(WORKOUT_CLUSTER_ID, WORKOUT_ATTR_SESSION_SECONDS, esp_matter_uint32(seconds));
+}
+
+static void session_timer(chip::System::Layer *layer, void *context)
+{
+    if (session_start_ms == 0) {
+        return;
+    }
+    report_session_duration();
+    chip::DeviceLayer::SystemLayer().StartTimer(
+        chip::System::Clock::Milliseconds32(SESSION_REPORT_INTERVAL_MS), session_timer, nullptr);
+}
+
+static void set_workout_active_work(intptr_t arg)
+{
+    bool active = (arg != 0);
+
+    if (active && session_start_ms == 0) {
+        session_start_ms = now_ms();
+        update_attribute(WORKOUT_CLUSTER_ID, WORKOUT_ATTR_HRM_CONNECTED, esp_matter_bool(true));
+        report_session_duration();
+        chip::DeviceLayer::SystemLayer().StartTimer(
+            chip::System::Clock::Milliseconds32(SESSION_REPORT_INTERVAL_MS), session_timer, nullptr);
+    } else if (!active && session_start_ms != 0) {
+        // The final duration stays readable until the next session starts
+        report_session_duration();
+        session_start_ms = 0;
+        chip::DeviceLayer::SystemLayer().CancelTimer(session_timer, nullptr);
+        update_attribute(WORKOUT_CLUSTER_ID, WORKOUT_ATTR_HRM_CONNECTED, esp_matter_bool(false));
+        __atomic_store_n(&pending_hr, 0, __ATOMIC_RELAXED);
+        report_hr(true);
+    }
+
+#if CONFIG_ENABLE_OTA_REQUESTOR
+    ota_workout_changed(active);
+#endif
+}
+
+void matter_device_set_workout_active(bool active)
+{
+    if (fan_endpoint_id == 0) {
+        return;
+    }
+    chip::DeviceLayer::PlatformMgr().ScheduleWork(set_workout_active_work, active ? 1 : 0);
+}
+
+// The configuration changed elsewhere (web UI); mirror it into the config
+// cluster so controllers see the new values
+static void sync_config_work(intptr_t arg)
+{
+    update_attribute(CONFIG_CLUSTER_ID, CONFIG_ATTR_HR_MAX, esp_matter_uint8(g_config.hrMax));
+    update_attribute(CONFIG_CLUSTER_ID, CONFIG_ATTR_HR_RESTING, esp_matter_uint8(g_config.hrResting));
+    update_attribute(CONFIG_CLUSTER_ID, CONFIG_ATTR_ZONE1_PERCENT, esp_matter_float(g_config.zone1Percent));
+    update_attribute(CONFIG_CLUSTER_ID, CONFIG_ATTR_ZONE2_PERCENT, esp_matter_float(g_config.zone2Percent));
+    update_attribute(CONFIG_CLUSTER_ID, CONFIG_ATTR_ZONE3_PERCENT, esp_matter_float(g_config.zone3Percent));
+    update_attribute(CONFIG_CLUSTER_ID, CONFIG_ATTR_FAN_DELAY, esp_matter_uint32(g_config.fanDelay));
+    update_attribute(CONFIG_CLUSTER_ID, CONFIG_ATTR_HR_HYSTERESIS, esp_matter_uint8(g_config.hrHysteresis));
+    update_attribute(CONFIG_CLUSTER_ID, CONFIG_ATTR_ALWAYS_ON, esp_matter_bool(g_config.alwaysOn != 0));
+}
+
+void matter_device_config_changed(void)
+{
+    if (fan_endpoint_id == 0) {
+        return;
+    }
+    chip::DeviceLayer::PlatformMgr().ScheduleWork(sync_config_work, 0);
 }
 
 bool matter_device_is_commissioned(void)
 {
     return chip::Server::GetInstance().GetFabricTable().FabricCount() > 0;
 }
+
+// WiFi hooks for wifi_manager.c. They are called from the system event loop,
+// so the work is handed to the Matter thread rather than touching the
+// connectivity manager directly.
+static void set_wifi_retry_interval_work(intptr_t arg)
+{
+    chip::DeviceLayer::ConnectivityMgr().SetWiFiStationReconnectInterval(
+        chip::System::Clock::Milliseconds32(static_cast<uint32_t>(arg)));
+}
+
+void matter_device_set_wifi_retry_interval(uint32_t interval_ms)
+{
+    chip::DeviceLayer::PlatformMgr().ScheduleWork(set_wifi_retry_interval_work,
+                                                  static_cast<intptr_t>(interval_ms));
+}
+
+static void set_fallback_ap_work(intptr_t arg)
+{
+#if CHIP_DEVICE_CONFIG_ENABLE_WIFI_AP
+    using chip::DeviceLayer::ConnectivityManager;
+    chip::DeviceLayer::ConnectivityMgr().SetWiFiAPMode(
+        arg ? ConnectivityManager::kWiFiAPMode_Enabled : ConnectivityManager::kWiFiAPMode_Disabled);
+#else
+    ESP_LOGW(TAG, "WiFi AP support is disabled (CONFIG_ENABLE_WIFI_AP)");
+#endif
+}
+
+void matter_device_set_fallback_ap(bool enable)
+{
+    chip::DeviceLayer::PlatformMgr().ScheduleWork(set_fallback_ap_work, enable ? 1 : 0);
+}
@@ -3,6 +3,7 @@
 
 #include "esp_err.h"
 #include <stdint.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -14,9 +15,27 @@ esp_err_t matter_device_init(void);
 // Update Matter attributes when fan state changes
 void matter_device_update_fan_state(uint8_t speed);
 
+// Report the latest heart rate on the workout cluster (rate limited)
+void matter_device_update_hr(uint8_t heart_rate);
+
+// Mirror a configuration change made outside Matter (web UI) into the
+// config cluster
+void matter_device_config_changed(void);
+
 // Check if device is commissioned
 bool matter_device_is_commissioned(void);
 
+// Start or end a workout (HRM connected). Updates the workout cluster's
+// connection state and session duration; Matter OTA downloads are held off
+// while a workout is in progress.
+void matter_device_set_workout_active(bool active);
+
+// Set how long Matter waits before retrying the WiFi station connection
+void matter_device_set_wifi_retry_interval(uint32_t interval_ms);
+
+// Bring the fallback access point up or down (station mode stays active)
+void matter_device_set_fallback_ap(bool enable);
+
 #ifdef __cplusplus
 }
 #endif
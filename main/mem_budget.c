@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+#include "gale.h"
+#include "matter_device.h"
+#include "mem_budget.h"
+
+static const char *TAG = "MEM_BUDGET";
+
+#define MAX_ENTRIES     16
+
+typedef struct {
+    const char *name;
+    uint32_t bytes;
+    uint32_t was_bytes;
+    bool is_static;
+    TaskHandle_t task;
+} budget_entry_t;
+
+static budget_entry_t s_entries[MAX_ENTRIES];
+static int s_num_entries = 0;
+
+// Workout heap tracking (main task only)
+static bool s_in_workout = false;
+static bool s_workout_commissioned = false;
+static uint32_t s_workout_min_free = 0;     // Lowest in the current or last workout; 0 = none yet
+
+void mem_budget_add(const char *name, size_t bytes, size_t was_bytes, bool is_static, TaskHandle_t task)
+{
+    if (s_num_entries >= MAX_ENTRIES) {
+        ESP_LOGW(TAG, "Budget table full, '%s' not tracked", name);
+        return;
+    }
+    s_entries[s_num_entries++] = (budget_entry_t){
+        .name = name,
+        .bytes = bytes,
+        .was_bytes = was_bytes,
+        .is_static = is_static,
+        .task = task,
+    };
+}
+
+static void totals(uint32_t *static_bytes, uint32_t *heap_bytes, int32_t *reclaimed)
+{
+    *static_bytes = *heap_bytes = 0;
+    *reclaimed = 0;
+    for (int i = 0; i < s_num_entries; i++) {
+        const budget_entry_t *e = &s_entries[i];
+        if (e->is_static) {
+            *static_bytes += e->bytes;
+            *reclaimed += e->was_bytes;
+        } else {
+            *heap_bytes += e->bytes;
+            *reclaimed += (int32_t)e->was_bytes - (int32_t)e->bytes;
+        }
+    }
+}
+
+static int stack_free(const budget_entry_t *e)
+{
+    return e->task ? (int)uxTaskGetStackHighWaterMark(e->task) : -1;
+}
+
+void mem_budget_report(void)
+{
+    uint32_t static_bytes, heap_bytes;
+    int32_t reclaimed;
+
+    ESP_LOGI(TAG, "%-14s %-6s %7s %7s %10s", "allocation", "where", "bytes", "was", "stack free");
+    for (int i = 0; i < s_num_entries; i++) {
+        const budget_entry_t *e = &s_entries[i];
+        char free_str[12] = "-";
+        if (e->task) {
+            snprintf(free_str, sizeof(free_str), "%d", stack_free(e));
+        }
+        ESP_LOGI(TAG, "%-14s %-6s %7" PRIu32 " %7" PRIu32 " %10s", e->name,
+                 e->is_static ? "static" : "heap", e->bytes, e->was_bytes, free_str);
+    }
+
+    totals(&static_bytes, &heap_bytes, &reclaimed);
+    ESP_LOGI(TAG, "Static %" PRIu32 " B, heap %" PRIu32 " B, heap reclaimed %" PRId32 " B",
+             static_bytes, heap_bytes, reclaimed);
+    ESP_LOGI(TAG, "Free heap %" PRIu32 " B (internal %u B, largest block %u B), minimum since boot %" PRIu32 " B",
+             esp_get_free_heap_size(), (unsigned)heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+             (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL),
+             esp_get_minimum_free_heap_size());
+}
+
+void mem_budget_sample(void)
+{
+    if (!g_ble_connected) {
+        if (s_in_workout) {
+            s_in_workout = false;
+            ESP_LOGI(TAG, "Workout minimum free heap %" PRIu32 " B%s", s_workout_min_free,
+                     s_workout_commissioned ? " (commissioned)" : "");
+        }
+        return;
+    }
+
+    uint32_t free_bytes = esp_get_free_heap_size();
+    if (!s_in_workout) {
+        s_in_workout = true;
+        s_workout_commissioned = false;
+        s_workout_min_free = free_bytes;
+    }
+    if (free_bytes < s_workout_min_free) {
+        s_workout_min_free = free_bytes;
+    }
+    s_workout_commissioned |= matter_device_is_commissioned();
+}
+
+// HTTP GET handler for /api/memory
+static esp_err_t memory_get_handler(httpd_req_t *req)
+{
+    static char line[160];
+    uint32_t static_bytes, heap_bytes;
+    int32_t reclaimed;
+
+    totals(&static_bytes, &heap_bytes, &reclaimed);
+    httpd_resp_set_type(req, "application/json");
+    snprintf(line, sizeof(line),
+             "{\"heap_free\":%" PRIu32 ",\"heap_min_free\":%" PRIu32 ",\"largest_free_block\":%u,"
+             "\"workout_min_free\":%" PRIu32 ",\"workout_commissioned\":%s,",
+             esp_get_free_heap_size(), esp_get_minimum_free_heap_size(),
+             (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL),
+             s_workout_min_free, s_workout_commissioned ? "true" : "false");
+    httpd_resp_sendstr_chunk(req, line);
+    snprintf(line, sizeof(line),
+             "\"static_bytes\":%" PRIu32 ",\"heap_bytes\":%" PRIu32 ",\"reclaimed_bytes\":%" PRId32 ",\"allocations\":[",
+             static_bytes, heap_bytes, reclaimed);
+    httpd_resp_sendstr_chunk(req, line);
+
+    for (int i = 0; i < s_num_entries; i++) {
+        const budget_entry_t *e = &s_entries[i];
+        snprintf(line, sizeof(line),
+                 "%s{\"name\":\"%s\",\"static\":%s,\"bytes\":%" PRIu32 ",\"was\":%" PRIu32 ",\"stack_free\":%d}",
+                 i ? "," : "", e->name, e->is_static ? "true" : "false", e->bytes, e->was_bytes,
+                 stack_free(e));
+        httpd_resp_sendstr_chunk(req, line);
+    }
+    httpd_resp_sendstr_chunk(req, "]}");
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+
+static const httpd_uri_t memory_uri = {
+    .uri       = "/api/memory",
+    .method    = HTTP_GET,
+    .handler   = memory_get_handler,
+    .user_ctx  = NULL
+};
+
+esp_err_t mem_budget_register(httpd_handle_t server)
+{
+    esp_err_t err = httpd_register_uri_handler(server, &memory_uri);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register /api/memory: %s", esp_err_to_name(err));
+    }
+    return err;
+}
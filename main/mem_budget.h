@@ -0,0 +1,41 @@
+#ifndef MEM_BUDGET_H
+#define MEM_BUDGET_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// RAM budget of Gale's own tasks, queues and buffers.
+//
+// Modules declare their allocations as they start them. mem_budget_report()
+// logs the table once everything is up: each entry's size, what it used to
+// take from the heap, whether it is static, and for tasks the stack
+// high-water mark. GET /api/memory returns the same data along with the heap
+// state and the lowest free heap seen while an HRM was connected.
+
+// Record an allocation. was_bytes is what the same thing took from the heap
+// before it was made static or resized (0 if new). task, if given, is
+// reported with its stack high-water mark.
+void mem_budget_add(const char *name, size_t bytes, size_t was_bytes, bool is_static, TaskHandle_t task);
+
+// Log the budget table (called at the end of boot)
+void mem_budget_report(void);
+
+// Track the free heap during workouts (called about once a second)
+void mem_budget_sample(void);
+
+// Register the /api/memory endpoint on the server
+esp_err_t mem_budget_register(httpd_handle_t server);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MEM_BUDGET_H
@@ -0,0 +1,333 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "gale.h"
+#include "metrics.h"
+#include "tracepoint.h"
+
+static const char *TAG = "METRICS";
+
+// Prometheus-style /metrics endpoint.
+//
+// Counters and histogram buckets live in per-core arrays and are updated with
+// relaxed atomic adds, so instrumenting the control path costs a handful of
+// instructions and never takes a lock. Scrapes sum the per-core copies; a
+// scrape racing an update may be one observation behind, which is fine for
+// monotonic counters.
+//
+// Histogram sums are kept in microseconds. A 64-bit atomic add isn't
+// lock-free on the 32-bit Xtensa cores, so each sum is a 32-bit low word
+// plus a count of its wraps (about every 71 minutes of observed time),
+// combined when read.
+
+#define HIST_MAX_BUCKETS    12
+#define MAX_TASKS           4
+
+typedef struct {
+    const char *name;
+    const char *help;
+    uint8_t num_bounds;
+    uint32_t bounds_us[HIST_MAX_BUCKETS];   // Upper bounds; +Inf is implicit
+} hist_desc_t;
+
+typedef struct {
+    uint32_t buckets[HIST_MAX_BUCKETS + 1]; // Non-cumulative; last is +Inf
+    uint32_t count;
+    uint32_t sum_us;        // Low 32 bits of the sum
+    uint32_t sum_wraps;     // Times sum_us wrapped
+} hist_data_t;
+
+static const char *const s_counter_names[METRIC_COUNT][2] = {
+    [METRIC_NOTIFY_RX]       = { "gale_hrm_notifications_total", "HRM notifications received" },
+    [METRIC_NOTIFY_DROPPED]  = { "gale_hrm_notifications_dropped_total", "HRM notifications ignored" },
+    [METRIC_NOTIFY_LOST]     = { "gale_hrm_notifications_lost_total", "HRM notifications missing from arrival gaps" },
+    [METRIC_RELAY1_SWITCHES] = { "gale_relay_switches_total{relay=\"1\"}", NULL },
+    [METRIC_RELAY2_SWITCHES] = { "gale_relay_switches_total{relay=\"2\"}", NULL },
+    [METRIC_RELAY3_SWITCHES] = { "gale_relay_switches_total{relay=\"3\"}", NULL },
+    [METRIC_HRM_RECONNECTS]  = { "gale_hrm_reconnects_total", "HRM connections re-established" },
+    [METRIC_MATTER_UPDATES]  = { "gale_matter_attribute_updates_total", "Matter attribute updates issued" },
+    [METRIC_FANOUT_WRITES]   = { "gale_fanout_writes_total", "Speed writes acknowledged by bound fans" },
+    [METRIC_FANOUT_ERRORS]   = { "gale_fanout_errors_total", "Speed writes to bound fans that failed" },
+    [METRIC_LIVE_DROPPED]    = { "gale_live_frames_dropped_total", "Live telemetry frames skipped for slow clients" },
+    [METRIC_LOG_DROPPED]     = { "gale_session_log_dropped_total", "Session log records dropped" },
+    [METRIC_BINLOG_DROPPED]  = { "gale_binlog_dropped_total", "Deferred log records dropped" },
+};
+
+static const hist_desc_t s_hists[HIST_COUNT] = {
+    [HIST_NOTIFY_TO_RELAY] = {
+        .name = "gale_notify_to_relay_seconds",
+        .help = "Time from the HR notification raising the speed to the relay switch",
+        .num_bounds = 10,
+        .bounds_us = { 1000, 5000, 10000, 25000, 50000, 75000, 100000, 150000, 250000, 1000000 },
+    },
+    [HIST_SCAN_DURATION] = {
+        .name = "gale_hrm_scan_duration_seconds",
+        .help = "Time from scan start to finding an HRM",
+        .num_bounds = 8,
+        .bounds_us = { 500000, 1000000, 2000000, 5000000, 10000000, 30000000, 60000000, 300000000 },
+    },
+    [HIST_WIFI_CONNECT] = {
+        .name = "gale_wifi_time_to_ip_seconds",
+        .help = "Time from WiFi station start or link loss to getting an IP",
+        .num_bounds = 10,
+        .bounds_us = { 100000, 250000, 500000, 750000, 1000000, 2000000, 5000000, 10000000, 30000000, 60000000 },
+    },
+    [HIST_NOTIFY_JITTER] = {
+        .name = "gale_hrm_notify_jitter_seconds",
+        .help = "Deviation of HRM notification inter-arrival time from its running average",
+        .num_bounds = 9,
+        .bounds_us = { 5000, 10000, 20000, 50000, 100000, 200000, 300000, 500000, 1000000 },
+    },
+};
+
+uint32_t g_metrics_counters[portNUM_PROCESSORS][METRIC_COUNT];
+static hist_data_t s_hist_data[portNUM_PROCESSORS][HIST_COUNT];
+
+static volatile uint32_t s_decision_us = 0;     // 0 = no measurement pending
+
+static TaskHandle_t s_tasks[MAX_TASKS];
+static int s_num_tasks = 0;
+
+void metrics_observe(metric_hist_t h, uint32_t value_us)
+{
+    const hist_desc_t *desc = &s_hists[h];
+    hist_data_t *data = &s_hist_data[esp_cpu_get_core_id()][h];
+
+    uint8_t b = 0;
+    while (b < desc->num_bounds && value_us > desc->bounds_us[b]) {
+        b++;
+    }
+    __atomic_fetch_add(&data->buckets[b], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&data->count, 1, __ATOMIC_RELAXED);
+    uint32_t old = __atomic_fetch_add(&data->sum_us, value_us, __ATOMIC_RELAXED);
+    if (old + value_us < old) {
+        __atomic_fetch_add(&data->sum_wraps, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void metrics_decision_stamp(void)
+{
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    s_decision_us = now ? now : 1;
+}
+
+void metrics_relay_applied(void)
+{
+    uint32_t stamp = s_decision_us;
+    if (stamp == 0) {
+        return;
+    }
+    s_decision_us = 0;
+    metrics_observe(HIST_NOTIFY_TO_RELAY, (uint32_t)esp_timer_get_time() - stamp);
+}
+
+void metrics_register_task(TaskHandle_t task)
+{
+    if (task && s_num_tasks < MAX_TASKS) {
+        s_tasks[s_num_tasks++] = task;
+    }
+}
+
+uint32_t metrics_total(metric_t m)
+{
+    uint32_t total = 0;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        total += g_metrics_counters[core][m];
+    }
+    return total;
+}
+
+// Sum the per-core copies into 'total'; returns the sum in microseconds
+static uint64_t hist_total(metric_hist_t h, hist_data_t *total)
+{
+    const hist_desc_t *desc = &s_hists[h];
+    uint64_t sum_us = 0;
+
+    memset(total, 0, sizeof(*total));
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        const hist_data_t *d = &s_hist_data[core][h];
+        for (int b = 0; b <= desc->num_bounds; b++) {
+            total->buckets[b] += d->buckets[b];
+        }
+        total->count += d->count;
+
+        // Retry if the wrap count moved while the low word was read. A read
+        // landing between an add that wraps and its wrap count update is
+        // still one wrap short, like any scrape racing an update.
+        uint32_t wraps, low;
+        do {
+            wraps = __atomic_load_n(&d->sum_wraps, __ATOMIC_ACQUIRE);
+            low = __atomic_load_n(&d->sum_us, __ATOMIC_ACQUIRE);
+        } while (wraps != __atomic_load_n(&d->sum_wraps, __ATOMIC_ACQUIRE));
+        sum_us += ((uint64_t)wraps << 32) + low;
+    }
+    return sum_us;
+}
+
+void metrics_print_hist(metric_hist_t h)
+{
+    const hist_desc_t *desc = &s_hists[h];
+    hist_data_t total;
+
+    uint64_t sum_us = hist_total(h, &total);
+    printf("%s: %" PRIu32 " observations, mean %.1f ms\n", desc->name, total.count,
+           total.count ? sum_us / 1e3 / total.count : 0.0);
+    for (int b = 0; b <= desc->num_bounds; b++) {
+        if (b < desc->num_bounds) {
+            printf("  <= %8.3f s %8" PRIu32 "\n", desc->bounds_us[b] / 1e6, total.buckets[b]);
+        } else {
+            printf("  >  %8.3f s %8" PRIu32 "\n", desc->bounds_us[b - 1] / 1e6, total.buckets[b]);
+        }
+    }
+}
+
+static void send_hist(httpd_req_t *req, char *line, size_t size, metric_hist_t h)
+{
+    const hist_desc_t *desc = &s_hists[h];
+    hist_data_t total;
+
+    uint64_t sum_us = hist_total(h, &total);
+
+    snprintf(line, size, "# HELP %s %s\n# TYPE %s histogram\n", desc->name, desc->help, desc->name);
+    httpd_resp_send_chunk(req, line, HTTPD_RESP_USE_STRLEN);
+
+    uint32_t cumulative = 0;
+    for (int b = 0; b < desc->num_bounds; b++) {
+        cumulative += total.buckets[b];
+        snprintf(line, size, "%s_bucket{le=\"%g\"} %" PRIu32 "\n",
+                 desc->name, desc->bounds_us[b] / 1e6, cumulative);
+        httpd_resp_send_chunk(req, line, HTTPD_RESP_USE_STRLEN);
+    }
+    cumulative += total.buckets[desc->num_bounds];
+    snprintf(line, size,
+             "%s_bucket{le=\"+Inf\"} %" PRIu32 "\n%s_sum %.6f\n%s_count %" PRIu32 "\n",
+             desc->name, cumulative, desc->name, sum_us / 1e6, desc->name, total.count);
+    httpd_resp_send_chunk(req, line, HTTPD_RESP_USE_STRLEN);
+}
+
+// HTTP GET handler for /metrics (Prometheus text exposition format)
+static esp_err_t metrics_get_handler(httpd_req_t *req)
+{
+    char line[192];
+
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+
+    for (int m = 0; m < METRIC_COUNT; m++) {
+        if (m == METRIC_RELAY1_SWITCHES) {
+            httpd_resp_sendstr_chunk(req,
+                "# HELP gale_relay_switches_total Relay level changes\n"
+                "# TYPE gale_relay_switches_total counter\n");
+        } else if (s_counter_names[m][1]) {
+            snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s counter\n",
+                     s_counter_names[m][0], s_counter_names[m][1], s_counter_names[m][0]);
+            httpd_resp_send_chunk(req, line, HTTPD_RESP_USE_STRLEN);
+        }
+        snprintf(line, sizeof(line), "%s %" PRIu32 "\n", s_counter_names[m][0], metrics_total(m));
+        httpd_resp_send_chunk(req, line, HTTPD_RESP_USE_STRLEN);
+    }
+
+    for (int h = 0; h < HIST_COUNT; h++) {
+        send_hist(req, line, sizeof(line), h);
+    }
+
+    snprintf(line, sizeof(line),
+             "# TYPE gale_heap_free_bytes gauge\ngale_heap_free_bytes %" PRIu32 "\n"
+             "# TYPE gale_heap_min_free_bytes gauge\ngale_heap_min_free_bytes %" PRIu32 "\n",
+             esp_get_free_heap_size(), esp_get_minimum_free_heap_size());
+    httpd_resp_send_chunk(req, line, HTTPD_RESP_USE_STRLEN);
+
+    httpd_resp_sendstr_chunk(req, "# TYPE gale_task_stack_free_min_bytes gauge\n");
+    for (int i = 0; i < s_num_tasks; i++) {
+        snprintf(line, sizeof(line), "gale_task_stack_free_min_bytes{task=\"%s\"} %u\n",
+                 pcTaskGetName(s_tasks[i]), (unsigned)uxTaskGetStackHighWaterMark(s_tasks[i]));
+        httpd_resp_send_chunk(req, line, HTTPD_RESP_USE_STRLEN);
+    }
+
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+
+static const httpd_uri_t metrics_uri = {
+    .uri       = "/metrics",
+    .method    = HTTP_GET,
+    .handler   = metrics_get_handler,
+    .user_ctx  = NULL
+};
+
+#ifdef CONFIG_GALE_TRACE
+static void trace_emit(const char *data, size_t len, void *ctx)
+{
+    httpd_resp_send_chunk((httpd_req_t *)ctx, data, len);
+}
+
+// HTTP GET handler for /metrics/trace (Chrome trace JSON of the tracepoints)
+static esp_err_t trace_get_handler(httpd_req_t *req)
+{
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"gale-trace.json\"");
+    tracepoint_export(trace_emit, req);
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+
+// HTTP POST handler for /metrics/trace?action=start|stop
+static esp_err_t trace_post_handler(httpd_req_t *req)
+{
+    char query[32] = "";
+    char action[8] = "";
+
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    httpd_query_key_value(query, "action", action, sizeof(action));
+    if (strcmp(action, "start") == 0) {
+        if (tracepoint_start() != ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+            return ESP_FAIL;
+        }
+    } else if (strcmp(action, "stop") == 0) {
+        tracepoint_stop();
+    } else {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "action must be start or stop");
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_sendstr(req, g_tracepoint_on ? "{\"recording\":true}" : "{\"recording\":false}");
+}
+
+static const httpd_uri_t trace_uri = {
+    .uri       = "/metrics/trace",
+    .method    = HTTP_GET,
+    .handler   = trace_get_handler,
+    .user_ctx  = NULL
+};
+
+static const httpd_uri_t trace_post_uri = {
+    .uri       = "/metrics/trace",
+    .method    = HTTP_POST,
+    .handler   = trace_post_handler,
+    .user_ctx  = NULL
+};
+#endif
+
+esp_err_t metrics_register(httpd_handle_t server)
+{
+    esp_err_t err = httpd_register_uri_handler(server, &metrics_uri);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register /metrics: %s", esp_err_to_name(err));
+        return err;
+    }
+#ifdef CONFIG_GALE_TRACE
+    err = httpd_register_uri_handler(server, &trace_uri);
+    if (err == ESP_OK) {
+        err = httpd_register_uri_handler(server, &trace_post_uri);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register /metrics/trace: %s", esp_err_to_name(err));
+    }
+#endif
+    return err;
+}
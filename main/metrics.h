@@ -0,0 +1,78 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_cpu.h"
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Counters exported on /metrics. Each core has its own copy, so the hot path
+// does a single uncontended atomic add; /metrics sums them.
+typedef enum {
+    METRIC_NOTIFY_RX = 0,       // HRM notifications received
+    METRIC_NOTIFY_DROPPED,      // Notifications ignored (bad payload, zero HR)
+    METRIC_NOTIFY_LOST,         // Notifications missing from gaps in arrival
+    METRIC_RELAY1_SWITCHES,     // Relay level changes, one counter per relay
+    METRIC_RELAY2_SWITCHES,
+    METRIC_RELAY3_SWITCHES,
+    METRIC_HRM_RECONNECTS,      // HRM connections re-established after a drop
+    METRIC_MATTER_UPDATES,      // Matter attribute updates issued
+    METRIC_FANOUT_WRITES,       // Speed writes acknowledged by bound fans
+    METRIC_FANOUT_ERRORS,       // Speed writes to bound fans that failed
+    METRIC_LIVE_DROPPED,        // /api/live frames skipped for slow clients
+    METRIC_LOG_DROPPED,         // Session log records lost because the writer lagged
+    METRIC_BINLOG_DROPPED,      // Deferred console log records lost to a full ring
+    METRIC_COUNT
+} metric_t;
+
+typedef enum {
+    HIST_NOTIFY_TO_RELAY = 0,   // HR notification to relay switch (speed ups only)
+    HIST_SCAN_DURATION,         // Scan start to HRM found
+    HIST_WIFI_CONNECT,          // WiFi station start (or link loss) to IP
+    HIST_NOTIFY_JITTER,         // HRM notification inter-arrival deviation
+    HIST_COUNT
+} metric_hist_t;
+
+extern uint32_t g_metrics_counters[portNUM_PROCESSORS][METRIC_COUNT];
+
+static inline void metrics_add(metric_t m, uint32_t n)
+{
+    __atomic_fetch_add(&g_metrics_counters[esp_cpu_get_core_id()][m], n, __ATOMIC_RELAXED);
+}
+
+static inline void metrics_inc(metric_t m)
+{
+    metrics_add(m, 1);
+}
+
+// Sum of a counter over all cores
+uint32_t metrics_total(metric_t m);
+
+// Record an observation (in microseconds) into a histogram
+void metrics_observe(metric_hist_t h, uint32_t value_us);
+
+// Print a histogram's buckets to stdout (serial console)
+void metrics_print_hist(metric_hist_t h);
+
+// Remember when the HR notification that raised the fan speed arrived, and
+// close the measurement once the relays have switched
+void metrics_decision_stamp(void);
+void metrics_relay_applied(void);
+
+// Track a task's stack high-water mark on /metrics
+void metrics_register_task(TaskHandle_t task);
+
+// Register the /metrics endpoint on the server
+esp_err_t metrics_register(httpd_handle_t server);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // METRICS_H
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <string.h>
+#include "sdkconfig.h"
 #include "nvs_flash.h"
 #include "nvs.h"
 #include "esp_log.h"
@@ -8,6 +9,44 @@
 static const char *TAG = "NVS_CONFIG";
 static const char *NAMESPACE = "gale";
 
+// Global configuration with defaults
+// These can be changed from the web UI or over Matter and are kept in NVS
+config_t g_config = {
+    // Heart rate defaults
+    .hrMax = 180,
+    .hrResting = 60,
+
+    // HR Zone defaults
+    // Turn-on threshold: 30-35% HRR marks transition from rest to light exercise where 
+    // metabolic heat production becomes noticeable. Below this, the body handles heat through 
+    // passive dissipation; above it, active cooling begins to help.
+    //
+    // Low speed: Remains in HRR calculation (personalized) for light to early-moderate intensity.
+    // Medium/High: Switch to %Max HR using ACSM guidelines - 64-76% Max HR is moderate intensity 
+    // (active sweating), 76%+ is vigorous (heavy heat production). These standardized zones align 
+    // fan speed with thermoregulatory demand as exercise intensity increases.
+    .zone1Percent = 0.33f, // %% of HR Reserve (light intensity, minimal heat production)
+    .zone2Percent = 0.64f, // %% of Max HR (moderate intensity, active sweating)
+    .zone3Percent = 0.76f, // %% of Max HR (vigorous intensity, heavy heat production)
+
+    // Fan behavior defaults
+    .alwaysOn = 0,  // Fan off by default, turns on when HRM connects
+#ifdef CONFIG_DEBUG_MODE
+    .fanDelay = 10000,     // 10 seconds in debug
+    .hrHysteresis = 0,     // none in debug
+#else
+    .fanDelay = 60000,     // 1 minute
+    .hrHysteresis = 15,
+#endif
+
+    // GPIO defaults
+    .relayGPIO = {27, 26, 25},
+    .ledGPIO = 2
+};
+
+// Calculated zone thresholds
+float g_zone1, g_zone2, g_zone3;
+
 void nvs_config_init(void)
 {
     esp_err_t ret = nvs_flash_init();
@@ -30,6 +69,41 @@ void calculate_zones(void)
              g_zone1, g_zone2, g_zone3);
 }
 
+// Check a complete configuration for consistency before it is applied.
+// On failure, 'reason' (if not NULL) points at a static description.
+bool config_validate(const config_t *config, const char **reason)
+{
+    const char *why = NULL;
+
+    if (config->hrMax < HR_MAX_MIN || config->hrMax > HR_MAX_MAX) {
+        why = "hrMax out of range";
+    } else if (config->hrResting < HR_RESTING_MIN || config->hrResting > HR_RESTING_MAX) {
+        why = "hrResting out of range";
+    } else if (config->hrMax <= config->hrResting) {
+        why = "hrMax must be greater than hrResting";
+    } else if (!(config->zone1Percent > 0.0f && config->zone1Percent <= 1.0f) ||
+               !(config->zone2Percent > 0.0f && config->zone2Percent <= 1.0f) ||
+               !(config->zone3Percent > 0.0f && config->zone3Percent <= 1.0f)) {
+        why = "zone percents must be in (0, 1]";
+    } else if (config->zone2Percent >= config->zone3Percent) {
+        why = "zone2Percent must be less than zone3Percent";
+    } else if (config->hrResting + config->zone1Percent * (config->hrMax - config->hrResting) >=
+               config->zone2Percent * config->hrMax) {
+        why = "zone 1 threshold must be below zone 2";
+    } else if (config->alwaysOn > 1) {
+        why = "alwaysOn must be 0 or 1";
+    } else if (config->fanDelay > FAN_DELAY_MAX) {
+        why = "fanDelay out of range";
+    } else if (config->hrHysteresis > HR_HYSTERESIS_MAX) {
+        why = "hrHysteresis out of range";
+    }
+
+    if (reason) {
+        *reason = why;
+    }
+    return why == NULL;
+}
+
 void nvs_config_load(void)
 {
     nvs_handle_t nvs_handle;
@@ -76,7 +150,7 @@ void nvs_config_load(void)
     ESP_LOGI(TAG, "Zone 1: %.1f, Zone 2: %.1f, Zone 3: %.1f", g_zone1, g_zone2, g_zone3);
 }
 
-void nvs_config_save(void)
+esp_err_t nvs_config_save(void)
 {
     nvs_handle_t nvs_handle;
     esp_err_t err;
@@ -84,7 +158,7 @@ void nvs_config_save(void)
     err = nvs_open(NAMESPACE, NVS_READWRITE, &nvs_handle);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Error opening NVS handle: %s", esp_err_to_name(err));
-        return;
+        return err;
     }
 
     // Heart rate settings
@@ -118,5 +192,8 @@ void nvs_config_save(void)
 
     calculate_zones();
 
-    ESP_LOGI(TAG, "Configuration saved");
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Configuration saved");
+    }
+    return err;
 }
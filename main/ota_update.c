@@ -1,53 +1,390 @@
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <sys/param.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
 #include "esp_ota_ops.h"
-#include "esp_https_ota.h"
-#include "esp_http_client.h"
+#include "mbedtls/sha256.h"
+#include "miniz.h"
 #include "gale.h"
+#include "ota_update.h"
+#include "web_jobs.h"
 
 static const char *TAG = "OTA";
 
-// OTA update task
-// This is a simplified OTA implementation
-// For a full implementation similar to ArduinoOTA, you would need to:
-// 1. Implement an HTTP/HTTPS server endpoint to receive firmware uploads
-// 2. Add mDNS service advertisement for OTA discovery
-// 3. Add authentication (password protection)
+// Push OTA over HTTP.
+//
+// The handler only checks the headers. It answers 202 with a web_jobs job
+// and hands an async copy of the request to the job worker, which receives
+// the body, so the httpd task keeps serving other requests during the
+// upload. The job ends "done" once the image is written and verified, and
+// the device restarts a second later.
+//
+// The body is received in OTA_RECV_CHUNK pieces, hashed and passed straight
+// to esp_ota_write, so no more than one chunk of the image is ever in RAM.
+// Sequential-write mode erases the slot one sector at a time as data
+// arrives instead of erasing the whole slot up front, which keeps each
+// flash operation (and the cache-disabled window it causes) short. The job
+// worker runs below the control tasks, so fan and LED control preempt the
+// upload.
+//
+// With "Content-Encoding: deflate" the body is a zlib stream, inflated on the
+// fly with the ROM copy of tinfl into a circular window. The window only has
+// to cover the encoder's back-reference distance, so images compressed with
+// a window of at most OTA_WINDOW_SIZE (zlib wbits <= 13) need about 19 KB of
+// heap for the upload instead of the full 32 KB deflate window. tinfl rejects
+// streams whose zlib header (CINFO) announces a larger window.
 
-// For now, this provides the foundation for OTA updates
-// You can trigger OTA updates via HTTP POST to a dedicated endpoint
+#define OTA_RECV_CHUNK      1024
+#define OTA_RECV_RETRIES    5       // Socket timeouts tolerated in a row
+#define OTA_WINDOW_SIZE     8192    // Power of two
+#define SHA256_LEN          32
 
-void ota_update_init(void)
+typedef struct {
+    tinfl_decompressor inflator;
+    uint8_t window[OTA_WINDOW_SIZE];
+    size_t pos;                 // Next write position in the window
+    bool done;
+} ota_inflate_t;
+
+typedef struct {
+    esp_ota_handle_t handle;
+    mbedtls_sha256_context sha;
+    size_t image_size;          // Bytes written to the slot
+    ota_inflate_t *inflate;     // NULL for uncompressed uploads
+    const char *failure;
+    esp_err_t err;              // Job result for the failure
+} ota_upload_t;
+
+// What the handler passes to the upload job
+typedef struct {
+    httpd_req_t *req;           // Async copy
+    const esp_partition_t *update;
+    uint8_t expected[SHA256_LEN];
+    bool compressed;
+} ota_job_t;
+
+static uint8_t s_chunk[OTA_RECV_CHUNK];    // Only one upload runs at a time
+static volatile bool s_busy = false;       // An upload is queued, running or done
+static esp_timer_handle_t s_restart_timer = NULL;
+
+static bool parse_sha256_hex(const char *hex, uint8_t *out)
 {
-    ESP_LOGI(TAG, "OTA updates initialized");
-    // Additional OTA initialization can be added here
+    if (strlen(hex) != SHA256_LEN * 2) {
+        return false;
+    }
+    for (int i = 0; i < SHA256_LEN * 2; i++) {
+        char c = tolower((unsigned char)hex[i]);
+        int v;
+        if (c >= '0' && c <= '9') {
+            v = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            v = c - 'a' + 10;
+        } else {
+            return false;
+        }
+        if (i % 2 == 0) {
+            out[i / 2] = v << 4;
+        } else {
+            out[i / 2] |= v;
+        }
+    }
+    return true;
 }
 
-esp_err_t perform_ota_update(const char *url)
+// Hash and write image data to the slot
+static bool ota_sink(ota_upload_t *u, const uint8_t *data, size_t len)
 {
-    ESP_LOGI(TAG, "Starting OTA update from: %s", url);
+    mbedtls_sha256_update(&u->sha, data, len);
+    esp_err_t err = esp_ota_write(u->handle, data, len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_write failed: %s", esp_err_to_name(err));
+        u->failure = (err == ESP_ERR_OTA_VALIDATE_FAILED) ? "Not an application image" :
+                     (err == ESP_ERR_INVALID_SIZE) ? "Image larger than the OTA slot" :
+                     "Flash write failed";
+        u->err = err;
+        return false;
+    }
+    u->image_size += len;
+    return true;
+}
 
-    esp_http_client_config_t config = {
-        .url = url,
-        .timeout_ms = 30000,
-        .keep_alive_enable = true,
-    };
+// Inflate one chunk of the zlib stream into the slot
+static bool ota_inflate(ota_upload_t *u, const uint8_t *in, size_t in_len, bool more_input)
+{
+    ota_inflate_t *z = u->inflate;
+    uint32_t flags = TINFL_FLAG_PARSE_ZLIB_HEADER | (more_input ? TINFL_FLAG_HAS_MORE_INPUT : 0);
 
-    esp_https_ota_config_t ota_config = {
-        .http_config = &config,
-    };
+    while (!z->done) {
+        size_t in_bytes = in_len;
+        size_t out_bytes = OTA_WINDOW_SIZE - z->pos;
+        tinfl_status status = tinfl_decompress(&z->inflator, in, &in_bytes, z->window,
+                                               z->window + z->pos, &out_bytes, flags);
+        in += in_bytes;
+        in_len -= in_bytes;
+
+        if (out_bytes > 0) {
+            if (!ota_sink(u, z->window + z->pos, out_bytes)) {
+                return false;
+            }
+            z->pos = (z->pos + out_bytes) & (OTA_WINDOW_SIZE - 1);
+        }
+
+        if (status == TINFL_STATUS_DONE) {
+            z->done = true;
+        } else if (status < 0) {
+            ESP_LOGE(TAG, "Inflate failed: %d", status);
+            u->failure = "Corrupt or unsupported deflate stream (zlib wbits must be <= 13)";
+            u->err = ESP_ERR_INVALID_ARG;
+            return false;
+        } else if (status == TINFL_STATUS_NEEDS_MORE_INPUT && in_len == 0) {
+            if (!more_input) {
+                u->failure = "Truncated deflate stream";
+                u->err = ESP_ERR_INVALID_SIZE;
+                return false;
+            }
+            return true;
+        }
+    }
+
+    if (in_len > 0) {
+        u->failure = "Data after the end of the deflate stream";
+        u->err = ESP_ERR_INVALID_SIZE;
+        return false;
+    }
+    return true;
+}
+
+static void ota_restart(void *arg)
+{
+    esp_restart();
+}
+
+// Receive the image into the slot, verify it and switch the boot slot
+static esp_err_t ota_receive(ota_job_t *job)
+{
+    httpd_req_t *req = job->req;
+    uint8_t digest[SHA256_LEN];
+
+    ota_upload_t upload = { 0 };
+    if (job->compressed) {
+        upload.inflate = malloc(sizeof(ota_inflate_t));
+        if (!upload.inflate) {
+            ESP_LOGE(TAG, "Update rejected: out of memory");
+            return ESP_ERR_NO_MEM;
+        }
+        tinfl_init(&upload.inflate->inflator);
+        upload.inflate->pos = 0;
+        upload.inflate->done = false;
+    }
+
+    esp_err_t err = esp_ota_begin(job->update, OTA_WITH_SEQUENTIAL_WRITES, &upload.handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_begin failed: %s", esp_err_to_name(err));
+        free(upload.inflate);
+        return err;
+    }
+
+    ESP_LOGI(TAG, "Receiving %u byte %simage into %s", (unsigned)req->content_len,
+             job->compressed ? "compressed " : "", job->update->label);
+    int64_t start_us = esp_timer_get_time();
+
+    mbedtls_sha256_init(&upload.sha);
+    mbedtls_sha256_starts(&upload.sha, 0);
+
+    size_t remaining = req->content_len;
+    int timeouts = 0;
+
+    while (remaining > 0) {
+        int ret = httpd_req_recv(req, (char *)s_chunk, MIN(remaining, sizeof(s_chunk)));
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts <= OTA_RECV_RETRIES) {
+            continue;
+        }
+        if (ret <= 0) {
+            upload.failure = "Upload interrupted";
+            upload.err = ESP_ERR_TIMEOUT;
+            break;
+        }
+        timeouts = 0;
+        remaining -= ret;
+
+        bool ok = job->compressed ? ota_inflate(&upload, s_chunk, ret, remaining > 0)
+                                  : ota_sink(&upload, s_chunk, ret);
+        if (!ok) {
+            break;
+        }
+    }
+
+    mbedtls_sha256_finish(&upload.sha, digest);
+    mbedtls_sha256_free(&upload.sha);
+    free(upload.inflate);
+
+    if (!upload.failure && memcmp(digest, job->expected, SHA256_LEN) != 0) {
+        upload.failure = "SHA-256 mismatch";
+        upload.err = ESP_ERR_INVALID_CRC;
+    }
+    if (upload.failure) {
+        ESP_LOGE(TAG, "Update rejected: %s", upload.failure);
+        esp_ota_abort(upload.handle);
+        return upload.err;
+    }
+
+    ESP_LOGI(TAG, "Received %u bytes, wrote %u byte image in %lld ms",
+             (unsigned)req->content_len, (unsigned)upload.image_size,
+             (esp_timer_get_time() - start_us) / 1000);
+
+    // esp_ota_end also verifies the image's own structure and checksum
+    err = esp_ota_end(upload.handle);
+    if (err == ESP_OK) {
+        err = esp_ota_set_boot_partition(job->update);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Image validation failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    return ESP_OK;
+}
 
-    esp_err_t ret = esp_https_ota(&ota_config);
-    if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "OTA update successful, restarting...");
-        vTaskDelay(pdMS_TO_TICKS(1000));
-        esp_restart();
+// web_jobs job: the upload itself. The job is marked done when this returns,
+// so the restart is left to a timer to give clients time to see that.
+static esp_err_t ota_upload_job(void *arg)
+{
+    ota_job_t *job = arg;
+
+    esp_err_t err = ota_receive(job);
+    if (err != ESP_OK) {
+        // Part of the body may still be on the socket
+        httpd_sess_trigger_close(job->req->handle, httpd_req_to_sockfd(job->req));
+    }
+    httpd_req_async_handler_complete(job->req);
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Update written to %s, restarting", job->update->label);
+        esp_timer_start_once(s_restart_timer, 1000000);
     } else {
-        ESP_LOGE(TAG, "OTA update failed: %s", esp_err_to_name(ret));
+        s_busy = false;
+    }
+    free(job);
+    return err;
+}
+
+// HTTP POST handler for /api/ota
+static esp_err_t ota_post_handler(httpd_req_t *req)
+{
+    char hex[SHA256_LEN * 2 + 1];
+    uint8_t expected[SHA256_LEN];
+
+    if (httpd_req_get_hdr_value_str(req, "X-Image-SHA256", hex, sizeof(hex)) != ESP_OK ||
+        !parse_sha256_hex(hex, expected)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing or malformed X-Image-SHA256");
+        return ESP_FAIL;
     }
 
-    return ret;
+    const esp_partition_t *update = esp_ota_get_next_update_partition(NULL);
+    if (!update) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No OTA slot");
+        return ESP_FAIL;
+    }
+    if (req->content_len == 0 || req->content_len > update->size) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Image size does not fit the OTA slot");
+        return ESP_FAIL;
+    }
+
+    char encoding[16];
+    bool compressed = false;
+    if (httpd_req_get_hdr_value_str(req, "Content-Encoding", encoding, sizeof(encoding)) == ESP_OK) {
+        if (strcasecmp(encoding, "deflate") == 0) {
+            compressed = true;
+        } else if (strcasecmp(encoding, "identity") != 0) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unsupported Content-Encoding");
+            return ESP_FAIL;
+        }
+    }
+
+    // s_busy is only set here, on the httpd task
+    if (s_busy) {
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_sendstr(req, "An update is already in progress");
+        return ESP_FAIL;
+    }
+
+    ota_job_t *job = calloc(1, sizeof(ota_job_t));
+    if (!job) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    job->update = update;
+    job->compressed = compressed;
+    memcpy(job->expected, expected, SHA256_LEN);
+
+    if (httpd_req_async_handler_begin(req, &job->req) != ESP_OK) {
+        free(job);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+
+    s_busy = true;
+    if (web_jobs_submit(job->req, "ota_upload", ota_upload_job, job) != ESP_OK) {
+        // 503 sent; the body was never read
+        s_busy = false;
+        httpd_sess_trigger_close(job->req->handle, httpd_req_to_sockfd(job->req));
+        httpd_req_async_handler_complete(job->req);
+        free(job);
+    }
+    return ESP_OK;
+}
+
+static const httpd_uri_t ota_post_uri = {
+    .uri       = "/api/ota",
+    .method    = HTTP_POST,
+    .handler   = ota_post_handler,
+    .user_ctx  = NULL
+};
+
+esp_err_t ota_update_register(httpd_handle_t server)
+{
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    ESP_LOGI(TAG, "Running from %s", running ? running->label : "?");
+
+    const esp_timer_create_args_t restart_args = {
+        .callback = ota_restart,
+        .name = "ota_restart",
+    };
+    if (!s_restart_timer) {
+        esp_err_t err = esp_timer_create(&restart_args, &s_restart_timer);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    esp_err_t err = httpd_register_uri_handler(server, &ota_post_uri);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register /api/ota: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+void ota_update_confirm_boot(bool healthy)
+{
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    esp_ota_img_states_t state;
+
+    if (esp_ota_get_state_partition(running, &state) != ESP_OK ||
+        state != ESP_OTA_IMG_PENDING_VERIFY) {
+        return;
+    }
+
+    if (healthy) {
+        ESP_LOGI(TAG, "Self-test passed, confirming new image");
+        esp_ota_mark_app_valid_cancel_rollback();
+    } else {
+        ESP_LOGE(TAG, "Self-test failed, rolling back");
+        esp_ota_mark_app_invalid_rollback_and_reboot();
+    }
 }
@@ -0,0 +1,27 @@
+#ifndef OTA_UPDATE_H
+#define OTA_UPDATE_H
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Register POST /api/ota. The request body is the raw application image
+// (build/gale.bin); the X-Image-SHA256 header carries its SHA-256 in hex.
+// The image is streamed into the inactive OTA slot and, once verified,
+// becomes the boot partition and the device restarts.
+esp_err_t ota_update_register(httpd_handle_t server);
+
+// Report the post-boot self-test result. A freshly updated image is marked
+// valid when healthy; otherwise the bootloader rolls back to the previous
+// image. Does nothing for images that are already confirmed.
+void ota_update_confirm_boot(bool healthy);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OTA_UPDATE_H
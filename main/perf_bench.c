@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "gale.h"
+#include "metrics.h"
+#include "tracepoint.h"
+#include "bench_cases.h"
+#include "perf_bench.h"
+
+// Same method as host/bench: grow the loop until one run takes at least
+// MIN_RUN_US, then keep the fastest of RUNS runs (the one least disturbed
+// by interrupts and other tasks). The console task yields between runs so
+// a benchmark never starves the idle task long enough to trip the watchdog.
+// The cases that also run on the host come from bench_cases.c.
+
+#define MIN_RUN_US  20000
+#define RUNS        5
+
+static volatile uint32_t s_sink;
+
+// Adding 0 costs the same atomic add as metrics_inc() and leaves /metrics
+// untouched
+static void bench_metrics_add(uint32_t iters)
+{
+    for (uint32_t i = 0; i < iters; i++) {
+        metrics_add(METRIC_NOTIFY_RX, 0);
+    }
+}
+
+#ifdef CONFIG_GALE_TRACE
+// A load and a branch unless recording was started
+static void bench_tracepoint(uint32_t iters)
+{
+    for (uint32_t i = 0; i < iters; i++) {
+        TRACEPOINT(TP_DECISION, i & 3);
+    }
+}
+#endif
+
+static void bench_timer_read(uint32_t iters)
+{
+    int64_t acc = 0;
+    for (uint32_t i = 0; i < iters; i++) {
+        acc += esp_timer_get_time();
+    }
+    s_sink = (uint32_t)acc;
+}
+
+typedef struct {
+    const char *name;
+    void (*fn)(uint32_t iters);
+} bench_case_t;
+
+static const bench_case_t s_cases[] = {
+    { "hr_parse",           bench_hr_parse },
+    { "config_json_parse",  bench_config_json },
+    { "matter_mapping",     bench_matter_mapping },
+    { "metrics_add",        bench_metrics_add },
+#ifdef CONFIG_GALE_TRACE
+    { "tracepoint",         bench_tracepoint },
+#endif
+    { "timer_read",         bench_timer_read },
+};
+#define NUM_CASES (sizeof(s_cases) / sizeof(s_cases[0]))
+
+static void run_case(const bench_case_t *c)
+{
+    // Grow the loop until one run takes long enough to time reliably
+    uint32_t iters = 16;
+    for (;;) {
+        int64_t t0 = esp_timer_get_time();
+        c->fn(iters);
+        if (esp_timer_get_time() - t0 >= MIN_RUN_US || iters >= (1u << 30)) {
+            break;
+        }
+        iters *= 2;
+        vTaskDelay(1);
+    }
+
+    int64_t best_us = INT64_MAX;
+    uint32_t best_cycles = UINT32_MAX;
+    for (int run = 0; run < RUNS; run++) {
+        vTaskDelay(1);
+        uint32_t c0 = esp_cpu_get_cycle_count();
+        int64_t t0 = esp_timer_get_time();
+        c->fn(iters);
+        int64_t t1 = esp_timer_get_time();
+        uint32_t c1 = esp_cpu_get_cycle_count();
+        if (t1 - t0 < best_us) {
+            best_us = t1 - t0;
+            best_cycles = c1 - c0;
+        }
+    }
+
+    printf("%-20s %10" PRIu32 " %12.1f %12.1f\n", c->name, iters,
+           best_us * 1000.0 / iters, (double)best_cycles / iters);
+}
+
+void perf_bench_run(const char *filter)
+{
+    printf("%-20s %10s %12s %12s\n", "case", "iters", "ns/op", "cycles/op");
+    for (size_t i = 0; i < NUM_CASES; i++) {
+        if (filter && *filter && !strstr(s_cases[i].name, filter)) {
+            continue;
+        }
+        run_case(&s_cases[i]);
+    }
+}
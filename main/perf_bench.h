@@ -0,0 +1,24 @@
+#ifndef PERF_BENCH_H
+#define PERF_BENCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// On-device microbenchmarks for the serial console ("gale bench").
+//
+// Times the control path pieces that have no side effects: HR payload
+// parsing, the /api/config JSON parser, the Matter percent/speed mapping,
+// a metrics counter update, a tracepoint and an esp_timer read. Cases that
+// would switch relays or publish to Matter and the session log only run in
+// the host's gale_bench. Each case reports the fastest of several runs in
+// ns and CPU cycles per operation, printed to stdout.
+
+// Run the cases whose name contains 'filter' (NULL or "" for all)
+void perf_bench_run(const char *filter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PERF_BENCH_H
@@ -0,0 +1,553 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_partition.h"
+#include "gale.h"
+#include "metrics.h"
+#include "session_log.h"
+#include "mem_budget.h"
+
+static const char *TAG = "SESSION_LOG";
+
+// Record encoding
+//
+// Every record starts with a tag byte: the low 3 bits are the record type,
+// the high 5 bits a type-specific small field. 0xFF (erased flash) ends the
+// data in a sector. Multi-byte fields are LEB128 varints; signed deltas are
+// zigzag encoded.
+//
+//   HR     tag = 0 | zz(dHR) << 3   [HR byte if zz(dHR) >= 31]  varint zz(dt - prev_dt)
+//   RR     tag = 1                  varint zz(rr - prev_rr)     (time of previous record)
+//   SPEED  tag = 2 | speed << 3 | override << 5                 varint dt
+//   EVENT  tag = 3 | event << 3                                 varint dt
+//
+// At 1 Hz with a steady heart rate an HR sample costs 2 bytes and each RR
+// interval 2-3 bytes.
+
+#define LOG_MAGIC           0x474F4C47  // "GLOG"
+#define PARTITION_SUBTYPE   0x40
+#define PARTITION_LABEL     "histlog"
+
+#define WRITE_CHUNK         256         // One SPI flash program page
+#define MAX_RECORD_SIZE     16
+#define DEFAULT_DT_MS       1000        // Delta baseline at the start of a sector
+#define HR_ESCAPE           31
+
+#define QUEUE_LENGTH        32
+#define IDLE_FLUSH_MS       10000
+#define WRITER_STACK_SIZE   3072
+#define WRITER_PRIORITY     1           // Lowest; logging never delays control
+
+typedef struct {
+    uint8_t type;
+    uint8_t value;
+    uint8_t flags;
+    uint16_t rr;
+    int64_t uptime_ms;
+} log_item_t;
+
+static const esp_partition_t *s_part = NULL;
+static QueueHandle_t s_queue = NULL;
+static uint8_t s_queue_storage[QUEUE_LENGTH * sizeof(log_item_t)];
+static StaticQueue_t s_queue_buf;
+static StackType_t s_writer_stack[WRITER_STACK_SIZE];
+static StaticTask_t s_writer_tcb;
+static uint32_t s_num_sectors = 0;
+
+// Writer state (only touched by the writer task after init)
+static uint32_t s_sector = 0;           // Current sector index
+static uint32_t s_seq = 0;              // Its sequence number
+static uint32_t s_offset = 0;           // Bytes of the sector already in flash
+static uint8_t s_buf[WRITE_CHUNK];      // Staged bytes not yet written
+static size_t s_buf_len = 0;
+static session_log_cursor_t s_enc;      // Delta state of the current sector
+
+static int64_t s_clock_base_ms = 0;     // Log clock = base + uptime
+
+static uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static size_t put_varint(uint8_t *out, uint64_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+static bool get_varint(session_log_cursor_t *c, uint64_t *v)
+{
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && c->p < c->end; shift += 7) {
+        uint8_t b = *c->p++;
+        result |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *v = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t clamp_dt(uint64_t dt)
+{
+    return dt > UINT32_MAX ? UINT32_MAX : (uint32_t)dt;
+}
+
+static void reset_delta_state(session_log_cursor_t *c, uint64_t t_ms)
+{
+    c->t_ms = t_ms;
+    c->prev_dt = DEFAULT_DT_MS;
+    c->hr = 0;
+    c->rr = 0;
+}
+
+bool session_log_sector_open(session_log_cursor_t *c, const uint8_t *sector, size_t size,
+                             uint32_t *seq)
+{
+    uint32_t magic;
+    uint64_t start_ms;
+
+    if (size < SESSION_LOG_HEADER_SIZE) {
+        return false;
+    }
+    memcpy(&magic, sector, sizeof(magic));
+    if (magic != LOG_MAGIC) {
+        return false;
+    }
+    if (seq) {
+        memcpy(seq, sector + 4, sizeof(*seq));
+    }
+    memcpy(&start_ms, sector + 8, sizeof(start_ms));
+
+    c->p = sector + SESSION_LOG_HEADER_SIZE;
+    c->end = sector + size;
+    reset_delta_state(c, start_ms);
+    return true;
+}
+
+bool session_log_next(session_log_cursor_t *c, session_log_record_t *rec)
+{
+    if (c->p >= c->end || *c->p == 0xFF) {
+        return false;
+    }
+
+    const uint8_t *start = c->p;
+    uint8_t tag = *c->p++;
+    uint8_t field = tag >> 3;
+    uint64_t v;
+
+    memset(rec, 0, sizeof(*rec));
+    rec->type = tag & 0x07;
+
+    switch (rec->type) {
+    case SESSION_LOG_HR:
+        if (field == HR_ESCAPE) {
+            if (c->p >= c->end) goto truncated;
+            c->hr = *c->p++;
+        } else {
+            c->hr = (uint8_t)(c->hr + unzigzag(field));
+        }
+        if (!get_varint(c, &v)) goto truncated;
+        {
+            uint64_t dt = (uint64_t)((int64_t)c->prev_dt + unzigzag(v));
+            c->t_ms += dt;
+            c->prev_dt = clamp_dt(dt);
+        }
+        rec->value = c->hr;
+        break;
+
+    case SESSION_LOG_RR:
+        if (!get_varint(c, &v)) goto truncated;
+        c->rr = (uint16_t)(c->rr + unzigzag(v));
+        rec->rr = c->rr;
+        break;
+
+    case SESSION_LOG_SPEED:
+    case SESSION_LOG_EVENT:
+        if (!get_varint(c, &v)) goto truncated;
+        c->t_ms += v;
+        if (rec->type == SESSION_LOG_SPEED) {
+            rec->value = field & 0x03;
+            rec->flags = (field >> 2) & 0x01;
+        } else {
+            rec->value = field;
+        }
+        break;
+
+    default:
+        goto truncated;
+    }
+
+    rec->t_ms = c->t_ms;
+    return true;
+
+truncated:
+    // Torn or foreign data; stop decoding this sector here
+    c->p = start;
+    c->end = start;
+    return false;
+}
+
+// Encode one record against the delta state 'c' (which is updated)
+static size_t encode(session_log_cursor_t *c, const log_item_t *item, uint64_t t_ms, uint8_t *out)
+{
+    size_t n = 0;
+    if (t_ms < c->t_ms) {
+        t_ms = c->t_ms;
+    }
+    uint64_t dt = t_ms - c->t_ms;
+
+    switch (item->type) {
+    case SESSION_LOG_HR: {
+        uint64_t z = zigzag((int32_t)item->value - c->hr);
+        if (z < HR_ESCAPE) {
+            out[n++] = SESSION_LOG_HR | (uint8_t)(z << 3);
+        } else {
+            out[n++] = SESSION_LOG_HR | (HR_ESCAPE << 3);
+            out[n++] = item->value;
+        }
+        n += put_varint(out + n, zigzag((int64_t)dt - (int64_t)c->prev_dt));
+        c->hr = item->value;
+        c->t_ms = t_ms;
+        c->prev_dt = clamp_dt(dt);
+        break;
+    }
+
+    case SESSION_LOG_RR:
+        out[n++] = SESSION_LOG_RR;
+        n += put_varint(out + n, zigzag((int32_t)item->rr - c->rr));
+        c->rr = item->rr;
+        break;
+
+    case SESSION_LOG_SPEED:
+        out[n++] = SESSION_LOG_SPEED | (uint8_t)((item->value & 0x03) << 3) |
+                   (uint8_t)((item->flags & 0x01) << 5);
+        n += put_varint(out + n, dt);
+        c->t_ms = t_ms;
+        break;
+
+    default:
+        out[n++] = SESSION_LOG_EVENT | (uint8_t)((item->value & 0x1F) << 3);
+        n += put_varint(out + n, dt);
+        c->t_ms = t_ms;
+        break;
+    }
+    return n;
+}
+
+static void flush(void)
+{
+    if (s_buf_len == 0) {
+        return;
+    }
+    esp_err_t err = esp_partition_write(s_part, s_sector * SESSION_LOG_SECTOR_SIZE + s_offset,
+                                        s_buf, s_buf_len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Write failed: %s", esp_err_to_name(err));
+    }
+    s_offset += s_buf_len;
+    s_buf_len = 0;
+}
+
+// Move on to the next sector, overwriting the oldest data
+static void start_sector(uint64_t t_ms)
+{
+    flush();
+
+    s_sector = (s_sector + 1) % s_num_sectors;
+    s_seq++;
+
+    uint8_t header[SESSION_LOG_HEADER_SIZE] = { 0 };
+    uint32_t magic = LOG_MAGIC;
+    memcpy(header, &magic, sizeof(magic));
+    memcpy(header + 4, &s_seq, sizeof(s_seq));
+    memcpy(header + 8, &t_ms, sizeof(t_ms));
+
+    uint32_t addr = s_sector * SESSION_LOG_SECTOR_SIZE;
+    esp_err_t err = esp_partition_erase_range(s_part, addr, SESSION_LOG_SECTOR_SIZE);
+    if (err == ESP_OK) {
+        err = esp_partition_write(s_part, addr, header, sizeof(header));
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start sector %" PRIu32 ": %s", s_sector, esp_err_to_name(err));
+    }
+
+    s_offset = SESSION_LOG_HEADER_SIZE;
+    reset_delta_state(&s_enc, t_ms);
+}
+
+static void append(const log_item_t *item)
+{
+    uint8_t rec[MAX_RECORD_SIZE];
+    uint64_t t_ms = (uint64_t)(s_clock_base_ms + item->uptime_ms);
+
+    session_log_cursor_t state = s_enc;
+    size_t len = encode(&state, item, t_ms, rec);
+    if (s_offset + s_buf_len + len > SESSION_LOG_SECTOR_SIZE) {
+        start_sector(t_ms);
+        state = s_enc;
+        len = encode(&state, item, t_ms, rec);
+    }
+    s_enc = state;
+
+    // Stage into program-page sized chunks; a record may straddle two
+    size_t first = len;
+    if (s_buf_len + first > WRITE_CHUNK) {
+        first = WRITE_CHUNK - s_buf_len;
+    }
+    memcpy(s_buf + s_buf_len, rec, first);
+    s_buf_len += first;
+    if (s_buf_len == WRITE_CHUNK) {
+        flush();
+    }
+    if (first < len) {
+        memcpy(s_buf, rec + first, len - first);
+        s_buf_len = len - first;
+    }
+}
+
+static void session_log_task(void *pvParameters)
+{
+    log_item_t item;
+
+    while (1) {
+        TickType_t wait = s_buf_len ? pdMS_TO_TICKS(IDLE_FLUSH_MS) : portMAX_DELAY;
+        if (xQueueReceive(s_queue, &item, wait) == pdTRUE) {
+            append(&item);
+            if (item.type == SESSION_LOG_EVENT) {
+                // Session boundaries go to flash right away
+                flush();
+            }
+        } else {
+            flush();
+        }
+    }
+}
+
+// Find the newest sector and where writing stopped, so the log resumes
+// (and its clock continues) where the previous boot left off
+static void recover(void)
+{
+    uint32_t head = 0;
+    uint32_t head_seq = 0;
+    uint8_t header[SESSION_LOG_HEADER_SIZE];
+    session_log_cursor_t c;
+
+    for (uint32_t i = 0; i < s_num_sectors; i++) {
+        uint32_t seq;
+        if (esp_partition_read(s_part, i * SESSION_LOG_SECTOR_SIZE, header, sizeof(header)) == ESP_OK &&
+            session_log_sector_open(&c, header, sizeof(header), &seq) && seq > head_seq) {
+            head = i;
+            head_seq = seq;
+        }
+    }
+
+    int64_t uptime_ms = esp_timer_get_time() / 1000;
+
+    if (head_seq == 0) {
+        // Empty log: the first record goes into sector 0
+        s_sector = s_num_sectors - 1;
+        s_seq = 0;
+        s_offset = SESSION_LOG_SECTOR_SIZE;
+        s_clock_base_ms = 0;
+        ESP_LOGI(TAG, "Empty log, %" PRIu32 " sectors", s_num_sectors);
+        return;
+    }
+
+    s_sector = head;
+    s_seq = head_seq;
+    s_offset = SESSION_LOG_SECTOR_SIZE;     // Start a fresh sector unless we can resume
+
+    const void *map;
+    esp_partition_mmap_handle_t handle;
+    if (esp_partition_mmap(s_part, head * SESSION_LOG_SECTOR_SIZE, SESSION_LOG_SECTOR_SIZE,
+                           ESP_PARTITION_MMAP_DATA, &map, &handle) == ESP_OK) {
+        const uint8_t *sector = map;
+        session_log_record_t rec;
+
+        session_log_sector_open(&c, sector, SESSION_LOG_SECTOR_SIZE, NULL);
+        while (session_log_next(&c, &rec)) {
+        }
+
+        // Only append after clean (erased) space; a torn record can't be
+        // overwritten in place
+        size_t pos = c.p - sector;
+        if (pos == SESSION_LOG_SECTOR_SIZE || sector[pos] == 0xFF) {
+            s_offset = pos;
+            s_enc = c;
+        }
+        s_clock_base_ms = (int64_t)c.t_ms + 1 - uptime_ms;
+        esp_partition_munmap(handle);
+    }
+
+    ESP_LOGI(TAG, "Resuming log at sector %" PRIu32 " (seq %" PRIu32 ", offset %" PRIu32 ")",
+             s_sector, s_seq, s_offset);
+}
+
+esp_err_t session_log_init(void)
+{
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, PARTITION_SUBTYPE, PARTITION_LABEL);
+    if (!s_part) {
+        ESP_LOGW(TAG, "No '%s' partition, session logging disabled", PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_num_sectors = s_part->size / SESSION_LOG_SECTOR_SIZE;
+    if (s_num_sectors < 2) {
+        ESP_LOGE(TAG, "Log partition too small");
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    recover();
+
+    s_queue = xQueueCreateStatic(QUEUE_LENGTH, sizeof(log_item_t), s_queue_storage, &s_queue_buf);
+    TaskHandle_t task = xTaskCreateStatic(session_log_task, "session_log", WRITER_STACK_SIZE, NULL,
+                                          WRITER_PRIORITY, s_writer_stack, &s_writer_tcb);
+    mem_budget_add("session_log", sizeof(s_writer_stack) + sizeof(s_writer_tcb),
+                   WRITER_STACK_SIZE + sizeof(StaticTask_t), true, task);
+    mem_budget_add("session_queue", sizeof(s_queue_storage) + sizeof(s_queue_buf),
+                   sizeof(s_queue_storage) + sizeof(StaticQueue_t), true, NULL);
+
+    session_log_event(SESSION_LOG_EV_BOOT);
+    return ESP_OK;
+}
+
+// Sector holding the pos'th oldest data (pos == num_sectors - 1 is the head)
+static const uint8_t *reader_sector(const session_log_reader_t *r, uint32_t pos)
+{
+    uint32_t index = (r->head + 1 + pos) % r->num_sectors;
+    return r->base + index * SESSION_LOG_SECTOR_SIZE;
+}
+
+// Start time of a sector for the seek; erased sectors only occur before the
+// oldest data, so they sort first
+static uint64_t reader_sector_start(const session_log_reader_t *r, uint32_t pos)
+{
+    session_log_cursor_t c;
+    if (!session_log_sector_open(&c, reader_sector(r, pos), SESSION_LOG_HEADER_SIZE, NULL)) {
+        return 0;
+    }
+    return c.t_ms;
+}
+
+esp_err_t session_log_reader_open(session_log_reader_t *r, uint64_t from_ms)
+{
+    const void *map;
+
+    memset(r, 0, sizeof(*r));
+    if (!s_part) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    esp_err_t err = esp_partition_mmap(s_part, 0, s_num_sectors * SESSION_LOG_SECTOR_SIZE,
+                                       ESP_PARTITION_MMAP_DATA, &map, &r->handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    r->base = map;
+    r->num_sectors = s_num_sectors;
+    r->head = __atomic_load_n(&s_sector, __ATOMIC_RELAXED);
+
+    // Sector start times increase around the ring from the oldest sector to
+    // the head, so the headers form a sparse time index: binary search for
+    // the last sector starting at or before from_ms
+    uint32_t lo = 0;
+    uint32_t hi = r->num_sectors - 1;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo + 1) / 2;
+        if (reader_sector_start(r, mid) <= from_ms) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    r->pos = lo;
+    r->cursor.p = r->cursor.end = NULL;
+    return ESP_OK;
+}
+
+bool session_log_reader_next(session_log_reader_t *r, session_log_record_t *rec)
+{
+    if (!r->base) {
+        return false;
+    }
+    while (!session_log_next(&r->cursor, rec)) {
+        if (r->cursor.p) {
+            r->pos++;
+        }
+        // Skip erased sectors; stop after the head
+        while (r->pos < r->num_sectors &&
+               !session_log_sector_open(&r->cursor, reader_sector(r, r->pos),
+                                        SESSION_LOG_SECTOR_SIZE, NULL)) {
+            r->pos++;
+        }
+        if (r->pos >= r->num_sectors) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void session_log_reader_close(session_log_reader_t *r)
+{
+    if (r->base) {
+        esp_partition_munmap(r->handle);
+        r->base = NULL;
+    }
+}
+
+uint64_t session_log_now_ms(void)
+{
+    return (uint64_t)(s_clock_base_ms + esp_timer_get_time() / 1000);
+}
+
+static void enqueue(uint8_t type, uint8_t value, uint8_t flags, uint16_t rr)
+{
+    if (!s_queue) {
+        return;
+    }
+    log_item_t item = {
+        .type = type,
+        .value = value,
+        .flags = flags,
+        .rr = rr,
+        .uptime_ms = esp_timer_get_time() / 1000,
+    };
+    if (xQueueSend(s_queue, &item, 0) != pdTRUE) {
+        metrics_inc(METRIC_LOG_DROPPED);
+    }
+}
+
+void session_log_hr(uint8_t hr)
+{
+    enqueue(SESSION_LOG_HR, hr, 0, 0);
+}
+
+void session_log_rr(uint16_t rr)
+{
+    enqueue(SESSION_LOG_RR, 0, 0, rr);
+}
+
+void session_log_speed(uint8_t speed, bool matter_override)
+{
+    enqueue(SESSION_LOG_SPEED, speed, matter_override ? 1 : 0, 0);
+}
+
+void session_log_event(uint8_t event)
+{
+    enqueue(SESSION_LOG_EVENT, event, 0, 0);
+}
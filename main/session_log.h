@@ -0,0 +1,96 @@
+#ifndef SESSION_LOG_H
+#define SESSION_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Workout session log stored in the "histlog" data partition.
+//
+// The partition is a ring of 4 KB sectors. Each sector starts with a
+// header (magic, sequence number, start time) followed by compact records;
+// delta state resets at every sector so any sector can be decoded on its
+// own. Times are milliseconds on a log clock that keeps counting across
+// reboots (time spent powered off is not included).
+
+#define SESSION_LOG_SECTOR_SIZE     4096
+#define SESSION_LOG_HEADER_SIZE     16
+
+// Record types
+#define SESSION_LOG_HR              0   // value = heart rate (BPM)
+#define SESSION_LOG_RR              1   // rr = RR interval (1/1024 s)
+#define SESSION_LOG_SPEED           2   // value = fan speed, flags = override
+#define SESSION_LOG_EVENT           3   // value = SESSION_LOG_EV_*
+
+// Events
+#define SESSION_LOG_EV_BOOT             0
+#define SESSION_LOG_EV_HRM_CONNECTED    1
+#define SESSION_LOG_EV_HRM_DISCONNECTED 2
+
+typedef struct {
+    uint8_t type;
+    uint8_t value;
+    uint8_t flags;
+    uint16_t rr;
+    uint64_t t_ms;
+} session_log_record_t;
+
+// Decoding position within one sector
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+    uint64_t t_ms;
+    uint32_t prev_dt;
+    uint8_t hr;
+    uint16_t rr;
+} session_log_cursor_t;
+
+// Find the partition, recover the write position and start the writer task
+esp_err_t session_log_init(void);
+
+// Queue records for the writer. Never block; records are dropped (and
+// counted) if the writer has fallen behind.
+void session_log_hr(uint8_t hr);
+void session_log_rr(uint16_t rr);
+void session_log_speed(uint8_t speed, bool matter_override);
+void session_log_event(uint8_t event);
+
+// Current time on the log clock
+uint64_t session_log_now_ms(void);
+
+// Validate a sector header and prepare to decode it. Returns false for
+// erased or foreign sectors.
+bool session_log_sector_open(session_log_cursor_t *c, const uint8_t *sector, size_t size,
+                             uint32_t *seq);
+
+// Decode the next record; returns false at the end of the written data
+bool session_log_next(session_log_cursor_t *c, session_log_record_t *rec);
+
+// Sequential reader over the whole log through a memory-mapped view of the
+// partition. Records come out in time order starting at the sector that
+// covers 'from_ms'; records still staged in RAM by the writer (at most a few
+// seconds' worth) are not visible.
+typedef struct {
+    const uint8_t *base;
+    esp_partition_mmap_handle_t handle;
+    uint32_t num_sectors;
+    uint32_t head;              // Newest sector when the reader was opened
+    uint32_t pos;               // Sectors consumed, oldest first
+    session_log_cursor_t cursor;
+} session_log_reader_t;
+
+esp_err_t session_log_reader_open(session_log_reader_t *r, uint64_t from_ms);
+bool session_log_reader_next(session_log_reader_t *r, session_log_record_t *rec);
+void session_log_reader_close(session_log_reader_t *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SESSION_LOG_H
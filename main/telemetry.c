@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "lwip/sockets.h"
+#include "gale.h"
+#include "telemetry.h"
+#include "metrics.h"
+#include "mem_budget.h"
+
+static const char *TAG = "TELEMETRY";
+
+// Live telemetry fan-out for /api/live.
+//
+// Producers (BLE host task, fan task, Matter callbacks) append fixed-size
+// frames to one shared ring under a short spinlock and poke the sender task;
+// they never wait on the network. The sender keeps a read cursor per client.
+// On each wakeup it copies the frames from the oldest cursor up to the head
+// out of the ring once, under the lock, and sends every client its slice of
+// that copy, so a producer can't overwrite a frame while it is on its way
+// out. A client that falls more than a ring's worth behind skips ahead and
+// has the gap added to its dropped-frame counter.
+//
+// The sender works on a copy of each client slot taken under
+// s_clients_lock and writes it back only if the slot still belongs to the
+// same connection; live_ws_handler() may hand the slot to a new one
+// meanwhile.
+//
+// Sends block, so a client whose socket is full is passed over rather than
+// sent to, and the others don't wait behind it. One that stays full for
+// STALL_LIMIT_MS is closed.
+
+#define RING_SIZE           64      // Frames; must be a power of two
+#define RING_MASK           (RING_SIZE - 1)
+#define MAX_CLIENTS         4
+#define STALL_LIMIT_MS      10000
+#define SENDER_STACK_SIZE   3072
+#define SENDER_PRIORITY     3       // Below the control tasks
+
+typedef struct {
+    int fd;                 // -1 when the slot is free
+    uint32_t gen;           // Bumped each time the slot is handed out
+    uint32_t cursor;        // Sequence number of the next frame to send
+    uint32_t dropped;       // Frames skipped because the client was too slow
+    TickType_t stalled_at;  // When its socket was first seen full; 0 if not
+} live_client_t;
+
+static telemetry_frame_t s_ring[RING_SIZE];
+static uint32_t s_head = 0;     // Sequence number of the next frame to write
+static portMUX_TYPE s_ring_lock = portMUX_INITIALIZER_UNLOCKED;
+static telemetry_frame_t s_send_buf[RING_SIZE];     // Sender task only
+static uint32_t s_send_base;                        // Sequence number of s_send_buf[0]
+
+static live_client_t s_clients[MAX_CLIENTS];
+static portMUX_TYPE s_clients_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static httpd_handle_t s_server = NULL;
+static TaskHandle_t s_sender_task = NULL;
+static StackType_t s_sender_stack[SENDER_STACK_SIZE];
+static StaticTask_t s_sender_tcb;
+
+void telemetry_publish(uint8_t type, uint8_t value)
+{
+    uint32_t now = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    uint8_t flags = g_matter_override ? TELEMETRY_FLAG_OVERRIDE : 0;
+
+    portENTER_CRITICAL_SAFE(&s_ring_lock);
+    telemetry_frame_t *f = &s_ring[s_head & RING_MASK];
+    f->type = type;
+    f->value = value;
+    f->flags = flags;
+    f->reserved = 0;
+    f->seq = s_head;
+    f->time_ms = now;
+    s_head++;
+    portEXIT_CRITICAL_SAFE(&s_ring_lock);
+
+    if (s_sender_task) {
+        xTaskNotifyGive(s_sender_task);
+    }
+}
+
+// Write the sender's copy of a slot back, unless the slot has been handed
+// to another connection since it was read
+static void store_client(int index, const live_client_t *c)
+{
+    portENTER_CRITICAL(&s_clients_lock);
+    if (s_clients[index].gen == c->gen) {
+        s_clients[index] = *c;
+    }
+    portEXIT_CRITICAL(&s_clients_lock);
+}
+
+static void remove_client(int index, live_client_t *c)
+{
+    int fd = c->fd;
+
+    c->fd = -1;
+    store_client(index, c);
+    ESP_LOGI(TAG, "Live client fd=%d left (%" PRIu32 " frames dropped)", fd, c->dropped);
+}
+
+// Copy the frames from 'from' up to the current head into s_send_buf, or
+// as many of them as producers haven't overwritten yet. Sets s_send_base
+// to the first frame copied and returns the head.
+static uint32_t snapshot_frames(uint32_t from)
+{
+    portENTER_CRITICAL(&s_ring_lock);
+    uint32_t head = s_head;
+    if ((int32_t)(head - RING_SIZE - from) > 0) {
+        from = head - RING_SIZE;
+    }
+    uint32_t count = head - from;
+    uint32_t start = from & RING_MASK;
+    uint32_t first = (count < RING_SIZE - start) ? count : RING_SIZE - start;
+    memcpy(s_send_buf, &s_ring[start], first * sizeof(telemetry_frame_t));
+    memcpy(s_send_buf + first, s_ring, (count - first) * sizeof(telemetry_frame_t));
+    portEXIT_CRITICAL(&s_ring_lock);
+
+    s_send_base = from;
+    return head;
+}
+
+// True when the socket has room in its send buffer, so sending to it won't
+// hold up the other clients
+static bool client_writable(int fd)
+{
+    fd_set wfds;
+    FD_ZERO(&wfds);
+    FD_SET(fd, &wfds);
+    struct timeval tv = { 0 };
+    return select(fd + 1, NULL, &wfds, NULL, &tv) > 0;
+}
+
+static void telemetry_sender_task(void *pvParameters)
+{
+    ESP_LOGI(TAG, "Telemetry sender task started");
+
+    live_client_t clients[MAX_CLIENTS];
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        uint32_t head;
+        portENTER_CRITICAL(&s_ring_lock);
+        head = s_head;
+        portEXIT_CRITICAL(&s_ring_lock);
+
+        portENTER_CRITICAL(&s_clients_lock);
+        memcpy(clients, s_clients, sizeof(clients));
+        portEXIT_CRITICAL(&s_clients_lock);
+
+        // One copy out of the ring per wakeup, from the oldest cursor
+        bool pending = false;
+        uint32_t oldest = head;
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (clients[i].fd >= 0 && clients[i].cursor != head) {
+                if (!pending || (int32_t)(clients[i].cursor - oldest) < 0) {
+                    oldest = clients[i].cursor;
+                }
+                pending = true;
+            }
+        }
+        if (!pending) {
+            continue;
+        }
+        head = snapshot_frames(oldest);
+        TickType_t now = xTaskGetTickCount();
+
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            live_client_t *c = &clients[i];
+            int fd = c->fd;
+            if (fd < 0 || c->cursor == head) {
+                continue;
+            }
+
+            if (httpd_ws_get_fd_info(s_server, fd) != HTTPD_WS_CLIENT_WEBSOCKET) {
+                remove_client(i, c);
+                continue;
+            }
+
+            if (!client_writable(fd)) {
+                if (!c->stalled_at) {
+                    c->stalled_at = now ? now : 1;
+                } else if (now - c->stalled_at > pdMS_TO_TICKS(STALL_LIMIT_MS)) {
+                    ESP_LOGW(TAG, "Live client fd=%d stalled, closing", fd);
+                    httpd_sess_trigger_close(s_server, fd);
+                    remove_client(i, c);
+                    continue;
+                }
+                store_client(i, c);
+                continue;
+            }
+            c->stalled_at = 0;
+
+            if ((int32_t)(s_send_base - c->cursor) > 0) {
+                c->dropped += s_send_base - c->cursor;
+                metrics_add(METRIC_LIVE_DROPPED, s_send_base - c->cursor);
+                c->cursor = s_send_base;
+            }
+
+            httpd_ws_frame_t ws = {
+                .type = HTTPD_WS_TYPE_BINARY,
+                .final = true,
+                .payload = (uint8_t *)&s_send_buf[c->cursor - s_send_base],
+                .len = (head - c->cursor) * sizeof(telemetry_frame_t),
+            };
+            if (httpd_ws_send_data(s_server, fd, &ws) != ESP_OK) {
+                remove_client(i, c);
+                continue;
+            }
+            c->cursor = head;
+            store_client(i, c);
+        }
+    }
+}
+
+// WebSocket handler for /api/live. The GET is the handshake; any data frames
+// sent by the client afterwards are read and ignored.
+static esp_err_t live_ws_handler(httpd_req_t *req)
+{
+    if (req->method == HTTP_GET) {
+        int fd = httpd_req_to_sockfd(req);
+        int slot = -1;
+
+        portENTER_CRITICAL(&s_clients_lock);
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            // A socket number can be reused before we noticed the old
+            // client went away
+            if (s_clients[i].fd == fd || (slot < 0 && s_clients[i].fd < 0)) {
+                slot = i;
+            }
+        }
+        if (slot >= 0) {
+            s_clients[slot].fd = fd;
+            s_clients[slot].gen++;
+            s_clients[slot].cursor = s_head;
+            s_clients[slot].dropped = 0;
+            s_clients[slot].stalled_at = 0;
+        }
+        portEXIT_CRITICAL(&s_clients_lock);
+
+        if (slot < 0) {
+            ESP_LOGW(TAG, "Too many live clients, rejecting fd=%d", fd);
+            return ESP_FAIL;
+        }
+        ESP_LOGI(TAG, "Live client fd=%d connected", fd);
+        return ESP_OK;
+    }
+
+    uint8_t buf[16];
+    httpd_ws_frame_t ws = { .payload = buf };
+    esp_err_t err = httpd_ws_recv_frame(req, &ws, 0);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (ws.len > sizeof(buf)) {
+        // Clients have nothing to tell us; close on oversized messages
+        return ESP_FAIL;
+    }
+    return httpd_ws_recv_frame(req, &ws, ws.len);
+}
+
+static const httpd_uri_t live_uri = {
+    .uri          = "/api/live",
+    .method       = HTTP_GET,
+    .handler      = live_ws_handler,
+    .user_ctx     = NULL,
+    .is_websocket = true,
+};
+
+esp_err_t telemetry_register(httpd_handle_t server)
+{
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        s_clients[i].fd = -1;
+    }
+    s_server = server;
+
+    esp_err_t err = httpd_register_uri_handler(server, &live_uri);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register /api/live: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    s_sender_task = xTaskCreateStatic(telemetry_sender_task, "telemetry", SENDER_STACK_SIZE,
+                                      NULL, SENDER_PRIORITY, s_sender_stack, &s_sender_tcb);
+    mem_budget_add("telemetry", sizeof(s_sender_stack) + sizeof(s_sender_tcb),
+                   SENDER_STACK_SIZE + sizeof(StaticTask_t), true, s_sender_task);
+    mem_budget_add("live_ring", sizeof(s_ring) + sizeof(s_send_buf), 0, true, NULL);
+    return ESP_OK;
+}
@@ -0,0 +1,45 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Frame types pushed to /api/live clients
+#define TELEMETRY_HR        1   // value = heart rate (BPM)
+#define TELEMETRY_SPEED     2   // value = fan speed (0-3)
+#define TELEMETRY_HRM       3   // value = 1 when the HRM connected, 0 when it dropped
+#define TELEMETRY_OTA       4   // value = Matter OTA download progress (percent)
+
+// Frame flags
+#define TELEMETRY_FLAG_OVERRIDE  0x01   // Matter override active
+
+// Wire format of one frame (little endian, 12 bytes). A WebSocket binary
+// message carries one or more consecutive frames; gaps in 'seq' mean the
+// client fell behind and frames were dropped.
+typedef struct __attribute__((packed)) {
+    uint8_t type;
+    uint8_t value;
+    uint8_t flags;
+    uint8_t reserved;
+    uint32_t seq;
+    uint32_t time_ms;   // Milliseconds since boot
+} telemetry_frame_t;
+
+// Register the /api/live WebSocket endpoint on the server and start the
+// fan-out task
+esp_err_t telemetry_register(httpd_handle_t server);
+
+// Append a frame to the shared ring buffer. Never blocks; safe to call from
+// any task on the control path.
+void telemetry_publish(uint8_t type, uint8_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TELEMETRY_H
@@ -0,0 +1,161 @@
+#include "tracepoint.h"
+
+#ifdef CONFIG_GALE_TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "mem_budget.h"
+
+// Each core has its own ring, so a tracepoint is a relaxed atomic increment
+// of that ring's head plus a 12-byte store; no locks, nothing blocks. A task
+// migrated between reading its core ID and claiming a slot just lands in the
+// other core's ring, which the atomic claim keeps safe. Old events are
+// overwritten. The rings come from the heap on the first start, so a device
+// that never records a trace does not pay for them.
+//
+// Timestamps are the low 32 bits of esp_timer (µs); the export widens them
+// against the current time, so events older than ~71 minutes come out wrong.
+// The rings wrap long before that at HRM notification rates.
+
+#define TP_RING_SIZE    CONFIG_GALE_TRACE_EVENTS
+_Static_assert((TP_RING_SIZE & (TP_RING_SIZE - 1)) == 0, "GALE_TRACE_EVENTS must be a power of two");
+
+#define PHASE_INSTANT   0
+#define PHASE_SPAN      1
+
+typedef struct {
+    uint32_t ts_us;
+    uint32_t dur_us;
+    uint16_t arg;
+    uint8_t id;
+    uint8_t phase;
+} tp_event_t;
+
+typedef struct {
+    uint32_t head;          // Total events claimed; slot = head % TP_RING_SIZE
+    tp_event_t events[TP_RING_SIZE];
+} tp_ring_t;
+
+static const char *const s_names[TP_COUNT][3] = {
+    // name, category, arg name
+    [TP_NOTIFY_RX]      = { "notify_rx",      "ble",     "len" },
+    [TP_HR_MEASUREMENT] = { "hr_measurement", "control", "hr" },
+    [TP_DECISION]       = { "decision",       "control", "speed" },
+    [TP_APPLY_SPEED]    = { "apply_speed",    "fan",     "speed" },
+    [TP_RELAY_ON]       = { "relay_on",       "fan",     "relay" },
+    [TP_RELAY_OFF]      = { "relay_off",      "fan",     "relay" },
+    [TP_MATTER_UPDATE]  = { "matter_update",  "matter",  "attribute" },
+    [TP_FANOUT]         = { "fanout",         "matter",  "percent" },
+    [TP_LED_FADE]       = { "led_fade",       "led",     "duty" },
+};
+
+volatile bool g_tracepoint_on = false;
+
+static tp_ring_t *s_rings = NULL;          // portNUM_PROCESSORS rings
+static volatile bool s_paused = false;
+
+esp_err_t tracepoint_start(void)
+{
+    if (!s_rings) {
+        s_rings = calloc(portNUM_PROCESSORS, sizeof(tp_ring_t));
+        if (!s_rings) {
+            return ESP_ERR_NO_MEM;
+        }
+        mem_budget_add("tracepoints", portNUM_PROCESSORS * sizeof(tp_ring_t), 0, false, NULL);
+    }
+    g_tracepoint_on = true;
+    return ESP_OK;
+}
+
+void tracepoint_stop(void)
+{
+    g_tracepoint_on = false;
+}
+
+uint32_t tracepoint_now(void)
+{
+    return (uint32_t)esp_timer_get_time();
+}
+
+static void record(tracepoint_id_t id, uint16_t arg, uint8_t phase, uint32_t ts_us, uint32_t dur_us)
+{
+    if (s_paused || !s_rings) {
+        return;
+    }
+    tp_ring_t *ring = &s_rings[esp_cpu_get_core_id()];
+    uint32_t slot = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED) & (TP_RING_SIZE - 1);
+    tp_event_t *ev = &ring->events[slot];
+    ev->ts_us = ts_us;
+    ev->dur_us = dur_us;
+    ev->arg = arg;
+    ev->id = id;
+    ev->phase = phase;
+}
+
+void tracepoint_instant(tracepoint_id_t id, uint16_t arg)
+{
+    record(id, arg, PHASE_INSTANT, tracepoint_now(), 0);
+}
+
+void tracepoint_span(tracepoint_id_t id, uint16_t arg, uint32_t start_us)
+{
+    record(id, arg, PHASE_SPAN, start_us, tracepoint_now() - start_us);
+}
+
+void tracepoint_export(tracepoint_emit_t emit, void *ctx)
+{
+    char buf[192];
+    int n;
+
+    s_paused = true;
+
+    int64_t now = esp_timer_get_time();
+    uint32_t now32 = (uint32_t)now;
+
+    n = snprintf(buf, sizeof(buf), "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    emit(buf, n, ctx);
+
+    bool first = true;
+    for (int core = 0; s_rings && core < portNUM_PROCESSORS; core++) {
+        n = snprintf(buf, sizeof(buf),
+                     "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"core %d\"}}",
+                     first ? "" : ",", core, core);
+        emit(buf, n, ctx);
+        first = false;
+
+        const tp_ring_t *ring = &s_rings[core];
+        uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint32_t start = head > TP_RING_SIZE ? head - TP_RING_SIZE : 0;
+
+        for (uint32_t i = start; i != head; i++) {
+            const tp_event_t *ev = &ring->events[i & (TP_RING_SIZE - 1)];
+            if (ev->id >= TP_COUNT) {
+                continue;
+            }
+            int64_t ts = now - (uint32_t)(now32 - ev->ts_us);
+            const char *const *names = s_names[ev->id];
+
+            n = snprintf(buf, sizeof(buf),
+                         ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%lld,",
+                         names[0], names[1], core, (long long)ts);
+            if (ev->phase == PHASE_SPAN) {
+                n += snprintf(buf + n, sizeof(buf) - n, "\"ph\":\"X\",\"dur\":%lu,",
+                              (unsigned long)ev->dur_us);
+            } else {
+                n += snprintf(buf + n, sizeof(buf) - n, "\"ph\":\"i\",\"s\":\"t\",");
+            }
+            n += snprintf(buf + n, sizeof(buf) - n, "\"args\":{\"%s\":%u}}", names[2], ev->arg);
+            emit(buf, n, ctx);
+        }
+    }
+
+    emit("\n]}\n", 4, ctx);
+    s_paused = false;
+}
+
+#endif // CONFIG_GALE_TRACE
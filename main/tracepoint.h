@@ -0,0 +1,74 @@
+#ifndef TRACEPOINT_H
+#define TRACEPOINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Control-path tracepoints, from the BLE notification to the relay switch.
+//
+// Compiled in with CONFIG_GALE_TRACE (the default); when it is off the
+// macros expand to nothing (their arguments are not evaluated). Compiled-in
+// tracepoints record nothing until tracepoint_start() (the console's
+// "gale trace start", or POST /metrics/trace?action=start) and cost a load
+// and a branch until then. Events land in a per-core ring with µs
+// timestamps and are exported as Chrome trace JSON (chrome://tracing,
+// ui.perfetto.dev) from GET /metrics/trace or the console.
+typedef enum {
+    TP_NOTIFY_RX = 0,       // HRM notification received; arg = payload length
+    TP_HR_MEASUREMENT,      // Span: notification handled; arg = heart rate
+    TP_DECISION,            // Target speed changed; arg = new speed
+    TP_APPLY_SPEED,         // Span: relays, LED mode, Matter hand-off; arg = speed
+    TP_RELAY_ON,            // Relay energized; arg = relay (1-3)
+    TP_RELAY_OFF,           // Relay released; arg = relay (1-3)
+    TP_MATTER_UPDATE,       // Span: Matter attribute update; arg = attribute id
+    TP_FANOUT,              // Speed write sent to bound fans; arg = percent
+    TP_LED_FADE,            // Span: one LED fade; arg = target duty
+    TP_COUNT
+} tracepoint_id_t;
+
+#ifdef CONFIG_GALE_TRACE
+
+#define TRACEPOINT(id, arg) \
+    do { if (g_tracepoint_on) tracepoint_instant((id), (arg)); } while (0)
+#define TRACEPOINT_BEGIN(var) \
+    uint32_t var = g_tracepoint_on ? tracepoint_now() : 0
+#define TRACEPOINT_END(var, id, arg) \
+    do { if (g_tracepoint_on && (var)) tracepoint_span((id), (arg), (var)); } while (0)
+
+extern volatile bool g_tracepoint_on;
+
+// Start recording, allocating the rings on first use (ESP_ERR_NO_MEM if
+// that fails); stop keeps what was recorded for export
+esp_err_t tracepoint_start(void);
+void tracepoint_stop(void);
+
+uint32_t tracepoint_now(void);
+void tracepoint_instant(tracepoint_id_t id, uint16_t arg);
+void tracepoint_span(tracepoint_id_t id, uint16_t arg, uint32_t start_us);
+
+// Write everything in the rings as Chrome trace JSON, in pieces, to emit().
+// Recording is paused while exporting. With nothing recorded yet the trace
+// is empty.
+typedef void (*tracepoint_emit_t)(const char *data, size_t len, void *ctx);
+void tracepoint_export(tracepoint_emit_t emit, void *ctx);
+
+#else
+
+#define TRACEPOINT(id, arg)             do { } while (0)
+#define TRACEPOINT_BEGIN(var)           do { } while (0)
+#define TRACEPOINT_END(var, id, arg)    do { } while (0)
+
+#endif // CONFIG_GALE_TRACE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRACEPOINT_H
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "web_jobs.h"
+#include "mem_budget.h"
+
+static const char *TAG = "WEB_JOBS";
+
+#define MAX_JOBS            8       // Status is kept for the last MAX_JOBS jobs
+#define QUEUE_LENGTH        4
+#define WORKER_STACK_SIZE   8192    // OTA image verification (esp_ota_end) needs the most
+#define WORKER_PRIORITY     2       // Below httpd and the control tasks
+
+typedef enum {
+    JOB_QUEUED = 0,
+    JOB_RUNNING,
+    JOB_DONE,
+    JOB_FAILED,
+} job_state_t;
+
+typedef struct {
+    uint32_t id;                // 0 = slot never used
+    const char *name;
+    web_job_fn_t fn;
+    void *arg;
+    job_state_t state;
+    esp_err_t result;
+} web_job_t;
+
+static const char *const s_state_names[] = { "queued", "running", "done", "failed" };
+
+static web_job_t s_jobs[MAX_JOBS];
+static uint32_t s_next_id = 1;
+static portMUX_TYPE s_jobs_lock = portMUX_INITIALIZER_UNLOCKED;
+static QueueHandle_t s_queue = NULL;
+static uint8_t s_queue_storage[QUEUE_LENGTH * sizeof(uint32_t)];
+static StaticQueue_t s_queue_buf;
+static StackType_t s_worker_stack[WORKER_STACK_SIZE];
+static StaticTask_t s_worker_tcb;
+
+static void web_jobs_task(void *pvParameters)
+{
+    uint32_t id;
+
+    while (1) {
+        if (xQueueReceive(s_queue, &id, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        web_job_t *job = &s_jobs[id % MAX_JOBS];
+        web_job_fn_t fn;
+        void *arg;
+        const char *name;
+
+        portENTER_CRITICAL(&s_jobs_lock);
+        job->state = JOB_RUNNING;
+        fn = job->fn;
+        arg = job->arg;
+        name = job->name;
+        portEXIT_CRITICAL(&s_jobs_lock);
+
+        ESP_LOGI(TAG, "Running job %" PRIu32 " (%s)", id, name);
+        esp_err_t err = fn(arg);
+
+        portENTER_CRITICAL(&s_jobs_lock);
+        if (job->id == id) {
+            job->result = err;
+            job->state = (err == ESP_OK) ? JOB_DONE : JOB_FAILED;
+        }
+        portEXIT_CRITICAL(&s_jobs_lock);
+
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Job %" PRIu32 " (%s) failed: %s", id, name, esp_err_to_name(err));
+        }
+    }
+}
+
+esp_err_t web_jobs_submit(httpd_req_t *req, const char *name, web_job_fn_t fn, void *arg)
+{
+    uint32_t id = 0;
+
+    // Only the httpd task submits, so a free queue entry stays free until
+    // the job is queued below
+    portENTER_CRITICAL(&s_jobs_lock);
+    web_job_t *job = &s_jobs[s_next_id % MAX_JOBS];
+    // Never recycle a slot whose job hasn't finished yet
+    if (uxQueueSpacesAvailable(s_queue) > 0 &&
+        (job->id == 0 || job->state == JOB_DONE || job->state == JOB_FAILED)) {
+        id = s_next_id++;
+        job->id = id;
+        job->name = name;
+        job->fn = fn;
+        job->arg = arg;
+        job->state = JOB_QUEUED;
+        job->result = ESP_OK;
+    }
+    portEXIT_CRITICAL(&s_jobs_lock);
+
+    if (id == 0) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        httpd_resp_sendstr(req, "Busy, try again");
+        return ESP_ERR_NO_MEM;
+    }
+
+    char location[32];
+    char body[80];
+    snprintf(location, sizeof(location), "/api/jobs/%" PRIu32, id);
+    snprintf(body, sizeof(body), "{\"id\":%" PRIu32 ",\"status\":\"%s\"}", id, location);
+
+    // Answered before the job is queued, so the job may go on to use an
+    // async copy of the request (see ota_update.c)
+    httpd_resp_set_status(req, "202 Accepted");
+    httpd_resp_set_hdr(req, "Location", location);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, body);
+
+    xQueueSend(s_queue, &id, 0);
+    return ESP_OK;
+}
+
+// HTTP GET handler for /api/jobs/<id>
+static esp_err_t jobs_get_handler(httpd_req_t *req)
+{
+    const char *id_str = req->uri + strlen("/api/jobs/");
+    char *end;
+    uint32_t id = strtoul(id_str, &end, 10);
+
+    web_job_t job = { 0 };
+    if (end != id_str && (*end == '\0' || *end == '?')) {
+        portENTER_CRITICAL(&s_jobs_lock);
+        job = s_jobs[id % MAX_JOBS];
+        portEXIT_CRITICAL(&s_jobs_lock);
+    }
+
+    if (job.id == 0 || job.id != id) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown or expired job");
+        return ESP_OK;
+    }
+
+    char body[128];
+    snprintf(body, sizeof(body),
+             "{\"id\":%" PRIu32 ",\"job\":\"%s\",\"state\":\"%s\",\"error\":\"%s\"}",
+             job.id, job.name, s_state_names[job.state], esp_err_to_name(job.result));
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, body);
+    return ESP_OK;
+}
+
+static const httpd_uri_t jobs_get_uri = {
+    .uri       = "/api/jobs/*",
+    .method    = HTTP_GET,
+    .handler   = jobs_get_handler,
+    .user_ctx  = NULL
+};
+
+esp_err_t web_jobs_register(httpd_handle_t server)
+{
+    s_queue = xQueueCreateStatic(QUEUE_LENGTH, sizeof(uint32_t), s_queue_storage, &s_queue_buf);
+    TaskHandle_t task = xTaskCreateStatic(web_jobs_task, "web_jobs", WORKER_STACK_SIZE, NULL,
+                                          WORKER_PRIORITY, s_worker_stack, &s_worker_tcb);
+    mem_budget_add("web_jobs", sizeof(s_worker_stack) + sizeof(s_worker_tcb),
+                   WORKER_STACK_SIZE + sizeof(StaticTask_t), true, task);
+    mem_budget_add("jobs_queue", sizeof(s_queue_storage) + sizeof(s_queue_buf),
+                   sizeof(s_queue_storage) + sizeof(StaticQueue_t), true, NULL);
+    return httpd_register_uri_handler(server, &jobs_get_uri);
+}
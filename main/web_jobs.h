@@ -0,0 +1,29 @@
+#ifndef WEB_JOBS_H
+#define WEB_JOBS_H
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Work that must not run on the httpd task (flash writes, OTA finalisation,
+// restarts) is handed to a worker as a job. The handler answers right away
+// with 202 Accepted and a status resource at /api/jobs/<id> to poll.
+typedef esp_err_t (*web_job_fn_t)(void *arg);
+
+// Start the job worker and register the /api/jobs/* status endpoint. The
+// server must be started with httpd_uri_match_wildcard.
+esp_err_t web_jobs_register(httpd_handle_t server);
+
+// Send the 202 response and queue 'fn(arg)' on the worker. When the queue
+// is full, sends 503 instead and returns ESP_ERR_NO_MEM. 'name' must be a
+// string literal.
+esp_err_t web_jobs_submit(httpd_req_t *req, const char *name, web_job_fn_t fn, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WEB_JOBS_H
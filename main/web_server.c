@@ -1,6 +1,5 @@
 #include <stdio.h>
 #include <string.h>
-#include <stdlib.h>
 #include <stdbool.h>
 #include <inttypes.h>
 #include "esp_http_server.h"
@@ -9,6 +8,17 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "gale.h"
+#include "config_json.h"
+#include "telemetry.h"
+#include "metrics.h"
+#include "web_jobs.h"
+#include "history.h"
+#include "ota_update.h"
+#include "hr_recorder.h"
+#include "hr_synth.h"
+#include "control_jitter.h"
+#include "mem_budget.h"
+#include "matter_device.h"
 
 static const char *TAG = "WEB_SERVER";
 static httpd_handle_t server = NULL;
@@ -17,6 +27,10 @@ static httpd_handle_t server = NULL;
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #endif
 
+// Config POST bodies are parsed in chunks of this size as they arrive
+#define POST_RECV_CHUNK 128
+#define POST_MAX_BODY   2048
+
 // HTML page content (embedded)
 static const char index_html[] =
 "<!DOCTYPE html>"
@@ -55,37 +69,9 @@ static const char index_html[] =
 "<div class=\"container\">"
 "<h1>Gale</h1>"
 "<p class=\"subtitle\">Heart Rate Controlled Fan Configuration</p>"
+"<p id=\"live\" class=\"help-text\">Live: -</p>"
 "<form id=\"configForm\">"
 "<div class=\"section\">"
-"<h2>WiFi Settings</h2>"
-"<div class=\"form-group\">"
-"<label for=\"apSSID\">Access Point Name</label>"
-"<input type=\"text\" id=\"apSSID\" name=\"apSSID\" required>"
-"<div class=\"help-text\">Name of the WiFi network Gale creates</div>"
-"</div>"
-"<div class=\"form-group\">"
-"<label for=\"apPassword\">Access Point Password</label>"
-"<input type=\"password\" id=\"apPassword\" name=\"apPassword\" minlength=\"8\" required>"
-"<div class=\"help-text\">Password must be at least 8 characters</div>"
-"</div>"
-"<div class=\"form-group\">"
-"<div class=\"checkbox-group\">"
-"<input type=\"checkbox\" id=\"useStationMode\" name=\"useStationMode\">"
-"<label for=\"useStationMode\" style=\"margin-bottom: 0;\">Connect to existing WiFi network</label>"
-"</div>"
-"</div>"
-"<div id=\"stationFields\" style=\"display: none;\">"
-"<div class=\"form-group\">"
-"<label for=\"wifiSSID\">WiFi Network Name</label>"
-"<input type=\"text\" id=\"wifiSSID\" name=\"wifiSSID\">"
-"</div>"
-"<div class=\"form-group\">"
-"<label for=\"wifiPassword\">WiFi Password</label>"
-"<input type=\"password\" id=\"wifiPassword\" name=\"wifiPassword\">"
-"</div>"
-"</div>"
-"</div>"
-"<div class=\"section\">"
 "<h2>Heart Rate Zones</h2>"
 "<div class=\"row\">"
 "<div class=\"form-group\">"
@@ -125,33 +111,37 @@ static const char index_html[] =
 "</form>"
 "</div>"
 "<script>"
+"let hr='-',spd='-',ota='';"
+"const ws=new WebSocket('ws://'+location.host+'/api/live');"
+"ws.binaryType='arraybuffer';"
+"ws.onmessage=(m)=>{"
+"const v=new DataView(m.data);"
+"for(let o=0;o+12<=v.byteLength;o+=12){"
+"const t=v.getUint8(o),x=v.getUint8(o+1);"
+"if(t==1)hr=x;else if(t==2)spd=x;else if(t==3&&!x)hr='-';"
+"else if(t==4)ota=x<100?', firmware update '+x+'%':'';"
+"}"
+"document.getElementById('live').textContent='Live: HR '+hr+' BPM, fan speed '+spd+ota;"
+"};"
 "fetch('/api/config').then(r=>r.json()).then(data=>{"
-"document.getElementById('apSSID').value=data.apSSID;"
-"document.getElementById('apPassword').value=data.apPassword;"
-"document.getElementById('useStationMode').checked=data.useStationMode;"
-"document.getElementById('wifiSSID').value=data.wifiSSID;"
-"document.getElementById('wifiPassword').value=data.wifiPassword;"
 "document.getElementById('hrMax').value=data.hrMax;"
 "document.getElementById('hrResting').value=data.hrResting;"
 "document.getElementById('alwaysOn').checked=data.alwaysOn==1;"
 "document.getElementById('fanDelay').value=data.fanDelay/1000;"
 "document.getElementById('hrHysteresis').value=data.hrHysteresis;"
-"updateZoneDisplay();toggleStationFields();"
+"zonePct=[data.zone1Percent,data.zone2Percent,data.zone3Percent];"
+"updateZoneDisplay();"
 "});"
-"document.getElementById('useStationMode').addEventListener('change',toggleStationFields);"
-"function toggleStationFields(){"
-"const stationFields=document.getElementById('stationFields');"
-"stationFields.style.display=document.getElementById('useStationMode').checked?'block':'none';"
-"}"
+"let zonePct=[0.33,0.64,0.76];"
 "document.getElementById('hrMax').addEventListener('input',updateZoneDisplay);"
 "document.getElementById('hrResting').addEventListener('input',updateZoneDisplay);"
 "function updateZoneDisplay(){"
 "const hrMax=parseInt(document.getElementById('hrMax').value)||0;"
 "const hrRest=parseInt(document.getElementById('hrResting').value)||0;"
 "const reserve=hrMax-hrRest;"
-"const zone1=Math.round(hrRest+(0.4*reserve));"
-"const zone2=Math.round(0.7*hrMax);"
-"const zone3=Math.round(0.8*hrMax);"
+"const zone1=Math.round(hrRest+(zonePct[0]*reserve));"
+"const zone2=Math.round(zonePct[1]*hrMax);"
+"const zone3=Math.round(zonePct[2]*hrMax);"
 "document.getElementById('zone1Display').textContent=zone1;"
 "document.getElementById('zone2Display').textContent=zone2;"
 "document.getElementById('zone3Display').textContent=zone3;"
@@ -160,11 +150,6 @@ static const char index_html[] =
 "e.preventDefault();"
 "const formData=new FormData(e.target);"
 "const data={"
-"apSSID:formData.get('apSSID'),"
-"apPassword:formData.get('apPassword'),"
-"useStationMode:formData.get('useStationMode')?1:0,"
-"wifiSSID:formData.get('wifiSSID')||'',"
-"wifiPassword:formData.get('wifiPassword')||'',"
 "hrMax:parseInt(formData.get('hrMax')),"
 "hrResting:parseInt(formData.get('hrResting')),"
 "alwaysOn:formData.get('alwaysOn')?1:0,"
@@ -176,10 +161,17 @@ static const char index_html[] =
 "const status=document.getElementById('status');"
 "if(response.ok){"
 "status.className='status success';"
-"status.textContent='Configuration saved! Device will restart in 3 seconds...';"
+"status.textContent='Configuration applied, saving...';"
+"const job=await response.json();"
+"for(let i=0;i<20;i++){"
+"await new Promise(r=>setTimeout(r,250));"
+"const s=await (await fetch(job.status)).json();"
+"if(s.state=='done'){status.textContent='Configuration saved!';break;}"
+"if(s.state=='failed'){status.className='status error';status.textContent='Failed to save configuration: '+s.error;break;}"
+"}"
 "}else{"
 "status.className='status error';"
-"status.textContent='Failed to save configuration';"
+"status.textContent='Failed to save configuration: '+await response.text();"
 "}"
 "}catch(err){"
 "const status=document.getElementById('status');"
@@ -202,19 +194,16 @@ static esp_err_t root_get_handler(httpd_req_t *req)
 // HTTP GET handler for /api/config
 static esp_err_t config_get_handler(httpd_req_t *req)
 {
-    char json_response[512];
+    static char json_response[256];
     snprintf(json_response, sizeof(json_response),
-             "{\"apSSID\":\"%s\",\"apPassword\":\"%s\",\"useStationMode\":%s,"
-             "\"wifiSSID\":\"%s\",\"wifiPassword\":\"%s\","
-             "\"hrMax\":%d,\"hrResting\":%d,\"alwaysOn\":%d,"
-             "\"fanDelay\":%" PRIu32 ",\"hrHysteresis\":%d}",
-             g_config.apSSID,
-             g_config.apPassword,
-             g_config.useStationMode ? "true" : "false",
-             g_config.wifiSSID,
-             g_config.wifiPassword,
+             "{\"hrMax\":%d,\"hrResting\":%d,"
+             "\"zone1Percent\":%.2f,\"zone2Percent\":%.2f,\"zone3Percent\":%.2f,"
+             "\"alwaysOn\":%d,\"fanDelay\":%" PRIu32 ",\"hrHysteresis\":%d}",
              g_config.hrMax,
              g_config.hrResting,
+             g_config.zone1Percent,
+             g_config.zone2Percent,
+             g_config.zone3Percent,
              g_config.alwaysOn,
              g_config.fanDelay,
              g_config.hrHysteresis);
@@ -224,100 +213,76 @@ static esp_err_t config_get_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
-// Simple JSON string extraction helper
-static bool extract_json_string(const char *json, const char *key, char *out, size_t out_size)
+// Job: persist the current configuration (runs on the job worker)
+static esp_err_t save_config_job(void *arg)
 {
-    char search_key[64];
-    snprintf(search_key, sizeof(search_key), "\"%s\":\"", key);
-
-    const char *start = strstr(json, search_key);
-    if (!start) return false;
-
-    start += strlen(search_key);
-    const char *end = strchr(start, '"');
-    if (!end) return false;
-
-    size_t len = end - start;
-    if (len >= out_size) len = out_size - 1;
-
-    strncpy(out, start, len);
-    out[len] = '\0';
-    return true;
+    return nvs_config_save();
 }
 
-// Simple JSON number extraction helper
-static bool extract_json_int(const char *json, const char *key, int *out)
+// Job: restart the device, giving the HTTP response time to go out
+static esp_err_t restart_job(void *arg)
 {
-    char search_key[64];
-    snprintf(search_key, sizeof(search_key), "\"%s\":", key);
-
-    const char *start = strstr(json, search_key);
-    if (!start) return false;
-
-    start += strlen(search_key);
-    *out = atoi(start);
-    return true;
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    esp_restart();
+    return ESP_OK;
 }
 
 // HTTP POST handler for /api/config
+// The body is parsed as it arrives, chunk by chunk, into a staged copy of the
+// config; g_config is only touched once the whole object has been validated.
+// The new settings take effect immediately; the flash write is handed to the
+// job worker so the httpd task never blocks on NVS.
 static esp_err_t config_post_handler(httpd_req_t *req)
 {
-    char buf[1024];
-    int ret, remaining = req->content_len;
+    char buf[POST_RECV_CHUNK];
+    int remaining = req->content_len;
 
-    if (remaining >= sizeof(buf)) {
+    if (remaining > POST_MAX_BODY) {
         httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Content too long");
         return ESP_FAIL;
     }
 
-    ret = httpd_req_recv(req, buf, MIN(remaining, sizeof(buf)));
-    if (ret <= 0) {
-        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
-            httpd_resp_send_408(req);
-        }
-        return ESP_FAIL;
-    }
-
-    buf[ret] = '\0';
-    ESP_LOGI(TAG, "Received config: %s", buf);
+    config_json_parser_t parser;
+    config_json_init(&parser, &g_config);
 
-    // Parse JSON manually
-    extract_json_string(buf, "apSSID", g_config.apSSID, sizeof(g_config.apSSID));
-    extract_json_string(buf, "apPassword", g_config.apPassword, sizeof(g_config.apPassword));
-    extract_json_string(buf, "wifiSSID", g_config.wifiSSID, sizeof(g_config.wifiSSID));
-    extract_json_string(buf, "wifiPassword", g_config.wifiPassword, sizeof(g_config.wifiPassword));
+    while (remaining > 0) {
+        int ret = httpd_req_recv(req, buf, MIN(remaining, (int)sizeof(buf)));
+        if (ret <= 0) {
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+                httpd_resp_send_408(req);
+            }
+            return ESP_FAIL;
+        }
+        remaining -= ret;
 
-    int temp_val;
-    if (extract_json_int(buf, "useStationMode", &temp_val)) {
-        g_config.useStationMode = (temp_val != 0);
-    }
-    if (extract_json_int(buf, "hrMax", &temp_val)) {
-        g_config.hrMax = temp_val;
-    }
-    if (extract_json_int(buf, "hrResting", &temp_val)) {
-        g_config.hrResting = temp_val;
-    }
-    if (extract_json_int(buf, "alwaysOn", &temp_val)) {
-        g_config.alwaysOn = temp_val;
-    }
-    if (extract_json_int(buf, "fanDelay", &temp_val)) {
-        g_config.fanDelay = temp_val;
+        if (config_json_feed(&parser, buf, ret) != CONFIG_JSON_MORE) {
+            // Stop reading on the first error; httpd drains the rest
+            break;
+        }
     }
-    if (extract_json_int(buf, "hrHysteresis", &temp_val)) {
-        g_config.hrHysteresis = temp_val;
+
+    if (config_json_finish(&parser) != CONFIG_JSON_DONE) {
+        ESP_LOGW(TAG, "Rejected config: %s", parser.error);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, parser.error);
+        return ESP_FAIL;
     }
 
-    // Save config
-    nvs_config_save();
+    g_config = parser.staged;
+    ESP_LOGI(TAG, "Received config: hrMax=%d hrResting=%d fanDelay=%" PRIu32 " hrHysteresis=%d alwaysOn=%d",
+             g_config.hrMax, g_config.hrResting, g_config.fanDelay,
+             g_config.hrHysteresis, g_config.alwaysOn);
 
-    // Send response
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, "{\"status\":\"ok\"}");
+    calculate_zones();
+    matter_device_config_changed();
 
-    // Restart after delay
-    vTaskDelay(pdMS_TO_TICKS(3000));
-    esp_restart();
+    web_jobs_submit(req, "save_config", save_config_job, NULL);
+    return ESP_OK;
+}
 
+// HTTP POST handler for /api/restart
+static esp_err_t restart_post_handler(httpd_req_t *req)
+{
+    web_jobs_submit(req, "restart", restart_job, NULL);
     return ESP_OK;
 }
 
@@ -342,6 +307,13 @@ static const httpd_uri_t config_post_uri = {
     .user_ctx  = NULL
 };
 
+static const httpd_uri_t restart_post_uri = {
+    .uri       = "/api/restart",
+    .method    = HTTP_POST,
+    .handler   = restart_post_handler,
+    .user_ctx  = NULL
+};
+
 void web_server_init(void)
 {
     ESP_LOGI(TAG, "Initializing web server");
@@ -350,14 +322,34 @@ void web_server_init(void)
 void web_server_start(void)
 {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    config.max_uri_handlers = 8;
+    config.max_uri_handlers = 20;
     config.stack_size = 8192;
+    config.uri_match_fn = httpd_uri_match_wildcard;
+    config.lru_purge_enable = true;
+    config.task_priority = 4;       // Below the fan loop
+#if CONFIG_GALE_CONTROL_CORE_APP
+    config.core_id = 0;             // With the network stack, off the control core
+#endif
 
+    // All requests are served by the one httpd task, one at a time, so
+    // handlers may keep large response buffers in static storage instead of
+    // on its stack
     ESP_LOGI(TAG, "Starting web server on port: '%d'", config.server_port);
     if (httpd_start(&server, &config) == ESP_OK) {
         httpd_register_uri_handler(server, &root_uri);
         httpd_register_uri_handler(server, &config_get_uri);
         httpd_register_uri_handler(server, &config_post_uri);
+        httpd_register_uri_handler(server, &restart_post_uri);
+        web_jobs_register(server);
+        telemetry_register(server);
+        metrics_register(server);
+        history_register(server);
+        ota_update_register(server);
+        hr_recorder_register(server);
+        hr_synth_register(server);
+        control_jitter_register(server);
+        mem_budget_register(server);
+        mem_budget_add("httpd", config.stack_size, 8192, false, xTaskGetHandle("httpd"));
         ESP_LOGI(TAG, "Web server started successfully");
     } else {
         ESP_LOGE(TAG, "Error starting web server!");
@@ -1,168 +1,264 @@
 #include <stdio.h>
 #include <string.h>
+#include <inttypes.h>
 #include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
-#include "freertos/event_groups.h"
-#include "esp_system.h"
 #include "esp_wifi.h"
+#include "esp_coexist.h"
 #include "esp_event.h"
+#include "esp_netif.h"
 #include "esp_log.h"
 #include "esp_mac.h"
-#include "nvs_flash.h"
+#include "esp_timer.h"
+#include "nvs.h"
 #include "gale.h"
+#include "matter_device.h"
+#include "metrics.h"
+#include "wifi_manager.h"
 
 static const char *TAG = "WIFI_MGR";
-static EventGroupHandle_t s_wifi_event_group;
-#define WIFI_CONNECTED_BIT BIT0
-#define WIFI_FAIL_BIT      BIT1
+static const char *NAMESPACE = "gale";
+static const char *CACHE_KEY = "wifiAp";
 
-static int s_retry_num = 0;
-#define MAX_RETRY 20
+// Everything here runs from the default event loop, alongside (and before)
+// Matter's own WiFi event handling; nothing blocks waiting for a connection.
 
-static void event_handler(void* arg, esp_event_base_t event_base,
-                         int32_t event_id, void* event_data)
+#define BACKOFF_BASE_MS     500     // First reconnect attempt
+#define BACKOFF_MAX_MS      60000
+#define FALLBACK_AP_AFTER   5       // Consecutive failures before the AP comes up
+
+// Last access point we got an IP from
+typedef struct {
+    uint8_t ssid[32];
+    uint8_t bssid[6];
+    uint8_t channel;
+} wifi_cache_t;
+
+static wifi_cache_t s_cache;
+static bool s_cache_valid = false;
+static bool s_fast_connect = false;     // Cached BSSID applied, not yet confirmed
+static bool s_connected_fast = false;   // Last association used the cached BSSID
+static int64_t s_attempt_start_us = 0;  // 0 = connected (or idle)
+static uint32_t s_failures = 0;
+static bool s_fallback_ap = false;
+
+static bool s_workout_mode = false;
+static wifi_ps_type_t s_saved_ps = WIFI_PS_MIN_MODEM;
+
+static void cache_load(void)
 {
-    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
-        esp_wifi_connect();
-    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        if (s_retry_num < MAX_RETRY) {
-            esp_wifi_connect();
-            s_retry_num++;
-            ESP_LOGI(TAG, "Retry connecting to AP");
-        } else {
-            xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
-        }
-        ESP_LOGI(TAG,"Connect to AP failed");
-    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
-        ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
-        ESP_LOGI(TAG, "Got IP:" IPSTR, IP2STR(&event->ip_info.ip));
-        s_retry_num = 0;
-        xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
-    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_AP_STACONNECTED) {
-        wifi_event_ap_staconnected_t* event = (wifi_event_ap_staconnected_t*) event_data;
-        ESP_LOGI(TAG, "Station "MACSTR" joined, AID=%d",
-                 MAC2STR(event->mac), event->aid);
-    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_AP_STADISCONNECTED) {
-        wifi_event_ap_stadisconnected_t* event = (wifi_event_ap_stadisconnected_t*) event_data;
-        ESP_LOGI(TAG, "Station "MACSTR" left, AID=%d",
-                 MAC2STR(event->mac), event->aid);
+    nvs_handle_t nvs_handle;
+    size_t size = sizeof(s_cache);
+
+    if (nvs_open(NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK) {
+        return;
     }
+    s_cache_valid = (nvs_get_blob(nvs_handle, CACHE_KEY, &s_cache, &size) == ESP_OK &&
+                     size == sizeof(s_cache) && s_cache.channel != 0);
+    nvs_close(nvs_handle);
 }
 
-static bool wifi_init_sta(void)
+static void cache_store(const wifi_cache_t *cache)
 {
-    s_wifi_event_group = xEventGroupCreate();
-
-    ESP_ERROR_CHECK(esp_netif_init());
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
-
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
-
-    esp_event_handler_instance_t instance_any_id;
-    esp_event_handler_instance_t instance_got_ip;
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
-                                                        ESP_EVENT_ANY_ID,
-                                                        &event_handler,
-                                                        NULL,
-                                                        &instance_any_id));
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
-                                                        IP_EVENT_STA_GOT_IP,
-                                                        &event_handler,
-                                                        NULL,
-                                                        &instance_got_ip));
-
-    wifi_config_t wifi_config = {
-        .sta = {
-            .threshold.authmode = WIFI_AUTH_WPA2_PSK,
-        },
-    };
-
-    strncpy((char *)wifi_config.sta.ssid, g_config.wifiSSID, sizeof(wifi_config.sta.ssid));
-    strncpy((char *)wifi_config.sta.password, g_config.wifiPassword, sizeof(wifi_config.sta.password));
-
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
-    ESP_ERROR_CHECK(esp_wifi_start());
-
-    ESP_LOGI(TAG, "Connecting to WiFi: %s", g_config.wifiSSID);
-
-    /* Waiting until either the connection is established (WIFI_CONNECTED_BIT) or connection failed for the maximum
-     * number of re-tries (WIFI_FAIL_BIT). The bits are set by event_handler() (see above) */
-    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-            WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-            pdFALSE,
-            pdFALSE,
-            pdMS_TO_TICKS(10000)); // Wait up to 10 seconds
-
-    if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG, "Connected to WiFi");
-        return true;
-    } else if (bits & WIFI_FAIL_BIT) {
-        ESP_LOGI(TAG, "Failed to connect to WiFi");
-        return false;
+    nvs_handle_t nvs_handle;
+
+    if (nvs_open(NAMESPACE, NVS_READWRITE, &nvs_handle) != ESP_OK) {
+        return;
+    }
+    if (cache) {
+        nvs_set_blob(nvs_handle, CACHE_KEY, cache, sizeof(*cache));
     } else {
-        ESP_LOGE(TAG, "WiFi connection timeout");
-        return false;
+        nvs_erase_key(nvs_handle, CACHE_KEY);
     }
+    nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
 }
 
-static void wifi_init_ap(void)
+// Update the station config for this boot only; the credentials Matter
+// stored in flash are left as they were
+static void set_sta_config_ram(wifi_config_t *cfg)
 {
-    ESP_ERROR_CHECK(esp_netif_init());
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_ap();
+    esp_wifi_set_storage(WIFI_STORAGE_RAM);
+    esp_err_t err = esp_wifi_set_config(WIFI_IF_STA, cfg);
+    esp_wifi_set_storage(WIFI_STORAGE_FLASH);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to update station config: %s", esp_err_to_name(err));
+    }
+}
 
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+// Point the station straight at the cached AP so the connect needs no scan
+static void apply_cache(void)
+{
+    wifi_config_t cfg;
 
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
-                                                        ESP_EVENT_ANY_ID,
-                                                        &event_handler,
-                                                        NULL,
-                                                        NULL));
+    if (!s_cache_valid || esp_wifi_get_config(WIFI_IF_STA, &cfg) != ESP_OK ||
+        cfg.sta.ssid[0] == 0 || memcmp(cfg.sta.ssid, s_cache.ssid, sizeof(s_cache.ssid)) != 0) {
+        return;
+    }
+    cfg.sta.bssid_set = true;
+    memcpy(cfg.sta.bssid, s_cache.bssid, sizeof(cfg.sta.bssid));
+    cfg.sta.channel = s_cache.channel;
+    set_sta_config_ram(&cfg);
+    s_fast_connect = true;
 
-    wifi_config_t wifi_config = {
-        .ap = {
-            .max_connection = 4,
-            .authmode = WIFI_AUTH_WPA_WPA2_PSK
-        },
-    };
+    ESP_LOGI(TAG, "Fast connect to " MACSTR " on channel %d",
+             MAC2STR(s_cache.bssid), s_cache.channel);
+}
 
-    strncpy((char *)wifi_config.ap.ssid, g_config.apSSID, sizeof(wifi_config.ap.ssid));
-    wifi_config.ap.ssid_len = strlen(g_config.apSSID);
-    strncpy((char *)wifi_config.ap.password, g_config.apPassword, sizeof(wifi_config.ap.password));
+// The cached AP didn't work (moved, replaced, different channel): scan again
+static void drop_cache(void)
+{
+    wifi_config_t cfg;
 
-    if (strlen(g_config.apPassword) == 0) {
-        wifi_config.ap.authmode = WIFI_AUTH_OPEN;
+    if (esp_wifi_get_config(WIFI_IF_STA, &cfg) == ESP_OK) {
+        cfg.sta.bssid_set = false;
+        cfg.sta.channel = 0;
+        set_sta_config_ram(&cfg);
     }
+    s_fast_connect = false;
+    s_cache_valid = false;
+    cache_store(NULL);
+    ESP_LOGW(TAG, "Cached AP unreachable, falling back to a full scan");
+}
+
+static void on_connected(const wifi_event_sta_connected_t *event)
+{
+    wifi_cache_t cache = { 0 };
+
+    memcpy(cache.ssid, event->ssid, event->ssid_len < sizeof(cache.ssid) ? event->ssid_len
+                                                                         : sizeof(cache.ssid));
+    memcpy(cache.bssid, event->bssid, sizeof(cache.bssid));
+    cache.channel = event->channel;
 
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_AP));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_AP, &wifi_config));
-    ESP_ERROR_CHECK(esp_wifi_start());
+    s_connected_fast = s_fast_connect;
+    s_fast_connect = false;
 
-    ESP_LOGI(TAG, "WiFi AP started. SSID: %s", g_config.apSSID);
+    // Only touch flash when the AP actually changed
+    if (!s_cache_valid || memcmp(&cache, &s_cache, sizeof(cache)) != 0) {
+        s_cache = cache;
+        s_cache_valid = true;
+        cache_store(&cache);
+        ESP_LOGI(TAG, "Cached AP " MACSTR " channel %d", MAC2STR(cache.bssid), cache.channel);
+    }
 }
 
-void wifi_manager_init(void)
+static void on_disconnected(const wifi_event_sta_disconnected_t *event)
 {
-    ESP_LOGI(TAG, "Initializing WiFi");
+    if (s_attempt_start_us == 0) {
+        // Lost an established connection; time the way back
+        s_attempt_start_us = esp_timer_get_time();
+    }
+    if (s_fast_connect) {
+        drop_cache();
+    }
+
+    s_failures++;
+    uint32_t shift = s_failures < 8 ? s_failures - 1 : 7;
+    uint32_t interval = BACKOFF_BASE_MS << shift;
+    if (interval > BACKOFF_MAX_MS) {
+        interval = BACKOFF_MAX_MS;
+    }
+    matter_device_set_wifi_retry_interval(interval);
+    ESP_LOGI(TAG, "Disconnected (reason %d), retry %" PRIu32 " in %" PRIu32 " ms",
+             event->reason, s_failures, interval);
+
+    if (s_failures == FALLBACK_AP_AFTER && !s_fallback_ap) {
+        ESP_LOGW(TAG, "Starting fallback AP; station keeps retrying");
+        matter_device_set_fallback_ap(true);
+        s_fallback_ap = true;
+    }
+}
+
+static void on_got_ip(const ip_event_got_ip_t *event)
+{
+    if (s_attempt_start_us != 0) {
+        int64_t elapsed_us = esp_timer_get_time() - s_attempt_start_us;
+        metrics_observe(HIST_WIFI_CONNECT, (uint32_t)elapsed_us);
+        ESP_LOGI(TAG, "Got IP " IPSTR " in %lld ms (%s)", IP2STR(&event->ip_info.ip),
+                 elapsed_us / 1000, s_connected_fast ? "fast connect" : "scan");
+        s_attempt_start_us = 0;
+    }
+
+    if (s_failures > 0) {
+        s_failures = 0;
+        matter_device_set_wifi_retry_interval(BACKOFF_BASE_MS);
+    }
+    if (s_fallback_ap) {
+        ESP_LOGI(TAG, "Station connected, stopping fallback AP");
+        matter_device_set_fallback_ap(false);
+        s_fallback_ap = false;
+    }
+}
+
+static void event_handler(void* arg, esp_event_base_t event_base,
+                          int32_t event_id, void* event_data)
+{
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
+        s_attempt_start_us = esp_timer_get_time();
+        apply_cache();
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        on_connected((wifi_event_sta_connected_t *)event_data);
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        on_disconnected((wifi_event_sta_disconnected_t *)event_data);
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        on_got_ip((ip_event_got_ip_t *)event_data);
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_AP_STACONNECTED) {
+        wifi_event_ap_staconnected_t* event = (wifi_event_ap_staconnected_t*) event_data;
+        ESP_LOGI(TAG, "Station "MACSTR" joined, AID=%d",
+                 MAC2STR(event->mac), event->aid);
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_AP_STADISCONNECTED) {
+        wifi_event_ap_stadisconnected_t* event = (wifi_event_ap_stadisconnected_t*) event_data;
+        ESP_LOGI(TAG, "Station "MACSTR" left, AID=%d",
+                 MAC2STR(event->mac), event->aid);
+    }
 }
 
-void wifi_manager_start(void)
+void wifi_manager_set_workout_mode(bool active)
 {
-    if (g_config.useStationMode && strlen(g_config.wifiSSID) > 0) {
-        if (!wifi_init_sta()) {
-            ESP_LOGI(TAG, "Falling back to AP mode");
-            // Clean up STA mode
-            esp_wifi_stop();
-            esp_wifi_deinit();
-            vTaskDelay(pdMS_TO_TICKS(100));
-            // Start AP mode
-            wifi_init_ap();
+#ifdef CONFIG_GALE_WORKOUT_RADIO_PROFILE
+    if (active == s_workout_mode) {
+        return;
+    }
+
+    if (active) {
+        // Modem sleep lets the radio spend the gaps between DTIM beacons on
+        // BLE; the coexistence preference settles conflicts in BLE's favor
+        if (esp_wifi_get_ps(&s_saved_ps) != ESP_OK) {
+            s_saved_ps = WIFI_PS_MIN_MODEM;
         }
+        esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+        esp_coex_preference_set(ESP_COEX_PREFER_BT);
     } else {
-        wifi_init_ap();
+        esp_coex_preference_set(ESP_COEX_PREFER_BALANCE);
+        esp_wifi_set_ps(s_saved_ps);
+    }
+    s_workout_mode = active;
+    ESP_LOGI(TAG, "Workout radio profile %s", active ? "on (BLE preferred)" : "off");
+#endif
+}
+
+esp_err_t wifi_manager_init(void)
+{
+    ESP_LOGI(TAG, "Initializing WiFi");
+
+    cache_load();
+
+    // Matter creates the default loop too and accepts it already existing.
+    // Registering first puts these handlers ahead of Matter's, so the cached
+    // AP is in the station config before Matter issues the connect.
+    esp_err_t err = esp_event_loop_create_default();
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+        ESP_LOGE(TAG, "Failed to create event loop: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID,
+                                              &event_handler, NULL, NULL);
+    if (err == ESP_OK) {
+        err = esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP,
+                                                  &event_handler, NULL, NULL);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register event handlers: %s", esp_err_to_name(err));
     }
+    return err;
 }
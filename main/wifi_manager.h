@@ -0,0 +1,28 @@
+#ifndef WIFI_MANAGER_H
+#define WIFI_MANAGER_H
+
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Hook into WiFi/IP events before the Matter stack brings WiFi up. Matter
+// owns the station (credentials come from commissioning); this adds:
+//  - fast connect: the last good BSSID/channel are kept in NVS and applied
+//    to the station config at start, so warm boots skip the channel scan
+//  - retry backoff for Matter's station reconnect interval
+//  - a fallback access point that runs alongside the retrying station
+//  - time-to-IP measurement (log and /metrics)
+esp_err_t wifi_manager_init(void);
+
+// Favor BLE in radio coexistence while an HRM is connected
+// (CONFIG_GALE_WORKOUT_RADIO_PROFILE); false restores the previous settings
+void wifi_manager_set_workout_mode(bool active);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WIFI_MANAGER_H